@@ -0,0 +1,198 @@
+/*
+ * bm_simd.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internal.h"
+#include <string.h>
+
+/*
+ * Vectorized inversionless Berlekamp-Massey algorithm, for symsize <= 8.
+ *
+ * The steps are those of bm_inversionless() in reed_solomon.c, reformulated
+ * as in the RiBM architecture so that every product is with one of the two
+ * constants of the step. Along with lambda(x) and B(x), the kernel keeps
+ * D(x) = lambda(x) * S(x) and E(x) = B(x) * S(x), shifted down by the step
+ * number r, so that the discrepancy of the next step is d_0 and no dot
+ * product is needed. The updates
+ *
+ *   lambda_j <-- gamma * lambda_j - discr * B_(j-1)
+ *   d_i      <-- gamma * d_(i+1)  - discr * e_i
+ *
+ * and the choices B_j <-- lambda_j or B_(j-1), e_i <-- d_(i+1) or e_i are
+ * then the same for all coefficients. The products with a constant are
+ * PSHUFB lookups on the nibbles of the bytes, from tables built from the
+ * constant times x^k, k = 0..7, at every step. The coefficients of D and E
+ * past the remaining steps are never used, so they are not kept exact.
+ *
+ * Unlike the RiBM, lambda and D are kept apart, so the degree of lambda may
+ * exceed nroots / 2 as in bm_classic, and the result is the same.
+ */
+
+#ifdef RS_HAVE_X86_SIMD
+
+#include <immintrin.h>
+
+/* Masks of the bits of the table index n, for k = 0..3 */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i nibble_bit(int k)
+{
+	const __m256i n = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+					   11, 12, 13, 14, 15, 0, 1, 2, 3, 4,
+					   5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+					   15);
+	__m256i bit = _mm256_set1_epi8(1 << k);
+
+	return _mm256_cmpeq_epi8(_mm256_and_si256(n, bit), bit);
+}
+
+/* Tables of the products with alpha^lc, or with 0 if zero is 0 */
+__attribute__((target("avx2"), always_inline))
+static inline void tables(struct rs_code *rs, int lc, uint8_t zero,
+			  const __m256i *bits, __m256i *lo, __m256i *hi)
+{
+	const uint16_t *p = rs->alpha_to + lc;
+
+	*lo = _mm256_setzero_si256();
+	*hi = _mm256_setzero_si256();
+	for (int k = 0; k < 4; k++) {
+		*lo = _mm256_xor_si256(*lo, _mm256_and_si256(
+			_mm256_set1_epi8(p[k] & zero), bits[k]));
+		*hi = _mm256_xor_si256(*hi, _mm256_and_si256(
+			_mm256_set1_epi8(p[k + 4] & zero), bits[k]));
+	}
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i mulc(__m256i x, __m256i lo, __m256i hi)
+{
+	__m256i m = _mm256_set1_epi8(0x0f);
+
+	return _mm256_xor_si256(
+		_mm256_shuffle_epi8(lo, _mm256_and_si256(x, m)),
+		_mm256_shuffle_epi8(hi, _mm256_and_si256(
+			_mm256_srli_epi16(x, 4), m)));
+}
+
+/*
+ * d, e, lam and b are nb vectors of 32 coefficients; d has an extra zero
+ * vector at the end.
+ */
+__attribute__((target("avx2")))
+static void bm_avx2(struct rs_code *rs, __m256i *d, __m256i *e,
+		    __m256i *lam, __m256i *b, int nb, int no_eras)
+{
+	uint16_t *index_of = rs->index_of;
+	int nroots = rs->nroots;
+	int el = no_eras;
+	__m256i bits[4], glo, ghi, dlo, dhi;
+
+	for (int k = 0; k < 4; k++)
+		bits[k] = nibble_bit(k);
+	tables(rs, 0, 0xff, bits, &glo, &ghi);
+
+	for (int r = no_eras + 1; r <= nroots; r++) {
+		uint8_t discr = _mm256_cvtsi256_si32(d[0]);
+		uint8_t dmask = -(discr != 0);
+		int upd = dmask & -(2 * el <= r + no_eras - 1);
+		__m256i vupd = _mm256_set1_epi8(upd);
+
+		tables(rs, index_of[discr], dmask, bits, &dlo, &dhi);
+
+		/* d_(i+1) comes from the next vector, which is not updated yet */
+		for (int k = 0; k < nb; k++) {
+			__m256i x = _mm256_permute2x128_si256(d[k], d[k + 1],
+							      0x21);
+			__m256i dn = _mm256_alignr_epi8(x, d[k], 1);
+
+			d[k] = _mm256_xor_si256(mulc(dn, glo, ghi),
+						mulc(e[k], dlo, dhi));
+			e[k] = _mm256_blendv_epi8(e[k], dn, vupd);
+		}
+
+		/* B_(j-1) from the previous vector, so go down */
+		for (int k = nb - 1; k >= 0; k--) {
+			__m256i prev = k ? b[k - 1] : _mm256_setzero_si256();
+			__m256i x = _mm256_permute2x128_si256(prev, b[k], 0x21);
+			__m256i bp = _mm256_alignr_epi8(b[k], x, 15);
+			__m256i l = lam[k];
+
+			lam[k] = _mm256_xor_si256(mulc(l, glo, ghi),
+						  mulc(bp, dlo, dhi));
+			b[k] = _mm256_blendv_epi8(bp, l, vupd);
+		}
+
+		glo = _mm256_blendv_epi8(glo, dlo, vupd);
+		ghi = _mm256_blendv_epi8(ghi, dhi, vupd);
+		el = upd ? r + no_eras - el : el;
+	}
+}
+
+int rs_bm_simd(struct rs_code *rs, uint16_t *lambda, const uint16_t *s,
+	       int no_eras)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nroots = rs->nroots;
+	int nn = rs->nn;
+
+	if (rs->mm > 8 || rs_simd_level() != RS_SIMD_AVX2)
+		return -1;
+
+	int nb = (nroots + 1 + 31) / 32;
+	__m256i d[nb + 1], e[nb], lam[nb], b[nb];
+	uint8_t *d8 = (uint8_t *) d, *lam8 = (uint8_t *) lam;
+
+	memset(d, 0, sizeof(d));
+	memset(lam, 0, sizeof(lam));
+
+	/* D(x) = lambda(x) * S(x), from x^no_eras on */
+	for (int i = 0; i < nroots - no_eras; i++) {
+		uint16_t x = 0;
+		for (int j = 0; j <= no_eras; j++) {
+			uint16_t sj = s[i + no_eras - j];
+			if (lambda[j] && sj)
+				x ^= alpha_to[index_of[lambda[j]]
+					      + index_of[sj]];
+		}
+		d8[i] = x;
+	}
+	for (int j = 0; j <= nroots; j++)
+		lam8[j] = lambda[j];
+	memcpy(e, d, sizeof(e));
+	memcpy(b, lam, sizeof(b));
+
+	bm_avx2(rs, d, e, lam, b, nb, no_eras);
+
+	/* Divide by lambda_0, which is not zero */
+	int norm = nn - index_of[lam8[0]];
+	for (int j = 0; j <= nroots; j++)
+		lambda[j] = lam8[j] ? alpha_to[index_of[lam8[j]] + norm] : 0;
+
+	return 0;
+}
+
+#else
+
+int rs_bm_simd(struct rs_code *rs, uint16_t *lambda, const uint16_t *s,
+	       int no_eras)
+{
+	(void) rs; (void) lambda; (void) s; (void) no_eras;
+	return -1;
+}
+
+#endif /* RS_HAVE_X86_SIMD */
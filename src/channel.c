@@ -0,0 +1,423 @@
+/*
+ * channel.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Channel models. The random numbers come in bulk from four xoshiro256**
+ * generators run side by side, one per 64-bit lane of an AVX2 vector, and
+ * are consumed CHUNK symbols at a time. The AVX2 and the scalar generators
+ * give the same sequence, so a seed gives the same errors on every CPU.
+ *
+ * An event of probability p is r >> 11 < p * 2^53, and the symbol is XORed
+ * with the random value masked by the event, so the loops over the symbols
+ * do not branch on the random numbers. The fixed-weight channel picks its
+ * positions with a partial Fisher-Yates shuffle of a permutation of the
+ * positions, which needs no retries.
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Symbols per batch of random numbers */
+#define CHUNK 256
+
+#define LOAD(p, i) (wide ? ((const uint16_t *) (p))[i] \
+		  : ((const uint8_t *) (p))[i])
+
+#define STORE(p, i, x) do {					\
+		if (wide)					\
+			((uint16_t *) (p))[i] = (x);		\
+		else						\
+			((uint8_t *) (p))[i] = (x);		\
+	} while (0)
+
+struct rs_channel {
+	struct rs_code *rs;
+	struct rs_channel_params p;
+	uint64_t s[4][4];       /* Generator states, s[word][lane] */
+	uint64_t thr_err[2];    /* Error thresholds in the good and bad state */
+	uint64_t thr_state[2];  /* Thresholds for being in the bad state next */
+	uint64_t thr_eras;      /* Erasure threshold */
+	int bad;                /* Gilbert-Elliott state */
+	int avx2;               /* Non-zero to generate with AVX2 */
+	int perm_len;           /* Length of the permutation in perm */
+	int *perm;              /* Positions; erasure sink of random channels */
+	uint64_t buf[4 * CHUNK];
+};
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Fills out with n random numbers, n a multiple of 4 */
+static void fill_generic(uint64_t s[4][4], uint64_t *out, int n)
+{
+	for (int i = 0; i < n; i += 4) {
+		for (int l = 0; l < 4; l++) {
+			uint64_t t = s[1][l] << 17;
+
+			out[i + l] = rotl(s[1][l] * 5, 7) * 9;
+			s[2][l] ^= s[0][l];
+			s[3][l] ^= s[1][l];
+			s[1][l] ^= s[2][l];
+			s[0][l] ^= s[3][l];
+			s[2][l] ^= t;
+			s[3][l] = rotl(s[3][l], 45);
+		}
+	}
+}
+
+#ifdef RS_HAVE_X86_SIMD
+
+#include <immintrin.h>
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i rotl_avx2(__m256i x, int k)
+{
+	return _mm256_or_si256(_mm256_slli_epi64(x, k),
+			       _mm256_srli_epi64(x, 64 - k));
+}
+
+/* The same with the lanes in vectors; x * 5 and x * 9 are shifts and adds */
+__attribute__((target("avx2")))
+static void fill_avx2(uint64_t s[4][4], uint64_t *out, int n)
+{
+	__m256i s0 = _mm256_loadu_si256((const __m256i *) s[0]);
+	__m256i s1 = _mm256_loadu_si256((const __m256i *) s[1]);
+	__m256i s2 = _mm256_loadu_si256((const __m256i *) s[2]);
+	__m256i s3 = _mm256_loadu_si256((const __m256i *) s[3]);
+
+	for (int i = 0; i < n; i += 4) {
+		__m256i x = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+		x = rotl_avx2(x, 7);
+		x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+		_mm256_storeu_si256((__m256i *) (out + i), x);
+
+		__m256i t = _mm256_slli_epi64(s1, 17);
+		s2 = _mm256_xor_si256(s2, s0);
+		s3 = _mm256_xor_si256(s3, s1);
+		s1 = _mm256_xor_si256(s1, s2);
+		s0 = _mm256_xor_si256(s0, s3);
+		s2 = _mm256_xor_si256(s2, t);
+		s3 = rotl_avx2(s3, 45);
+	}
+
+	_mm256_storeu_si256((__m256i *) s[0], s0);
+	_mm256_storeu_si256((__m256i *) s[1], s1);
+	_mm256_storeu_si256((__m256i *) s[2], s2);
+	_mm256_storeu_si256((__m256i *) s[3], s3);
+}
+
+#endif /* RS_HAVE_X86_SIMD */
+
+/* Returns n random numbers, n <= 4 * CHUNK */
+static uint64_t *rng_fill(struct rs_channel *ch, int n)
+{
+	n = (n + 3) & ~3;
+
+#ifdef RS_HAVE_X86_SIMD
+	if (ch->avx2) {
+		fill_avx2(ch->s, ch->buf, n);
+		return ch->buf;
+	}
+#endif
+	fill_generic(ch->s, ch->buf, n);
+	return ch->buf;
+}
+
+/* Uniform in [0, n), from the high half of r */
+static inline int below(uint64_t r, int n)
+{
+	return ((r >> 32) * (uint64_t) n) >> 32;
+}
+
+static uint64_t threshold(double p)
+{
+	return p * 9007199254740992.0;
+}
+
+void rs_channel_seed_internal(struct rs_channel *ch, uint64_t seed,
+			      uint64_t stream)
+{
+	uint64_t x = seed ^ stream * 0xd1342543de82ef95;
+
+	/* splitmix64 */
+	for (int k = 0; k < 4; k++) {
+		for (int l = 0; l < 4; l++) {
+			uint64_t z = (x += 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			ch->s[k][l] = z ^ (z >> 31);
+		}
+	}
+	ch->bad = 0;
+	ch->perm_len = 0;
+}
+
+void rs_channel_weight_internal(struct rs_channel *ch, int errors,
+				int erasures)
+{
+	ch->p.errors = errors;
+	ch->p.erasures = erasures;
+}
+
+const int *rs_channel_positions_internal(struct rs_channel *ch)
+{
+	return ch->perm;
+}
+
+static int valid_prob(double p)
+{
+	return p >= 0 && p <= 1;
+}
+
+struct rs_channel *rs_channel_create_internal(struct rs_code *rs,
+					      const struct rs_channel_params *p,
+					      uint64_t seed)
+{
+	switch (p->model) {
+	case RS_CHANNEL_FIXED:
+		if (p->errors < 0 || p->erasures < 0)
+			return NULL;
+		break;
+	case RS_CHANNEL_GILBERT_ELLIOTT:
+		if (!valid_prob(p->p_bad) || !valid_prob(p->p_gb)
+		    || !valid_prob(p->p_bg))
+			return NULL;
+		/* fall through */
+	case RS_CHANNEL_SYMMETRIC:
+		if (!valid_prob(p->p) || !valid_prob(p->p_erasure))
+			return NULL;
+		break;
+	default:
+		return NULL;
+	}
+
+	struct rs_channel *ch = calloc(1, sizeof(*ch));
+	if (!ch)
+		return NULL;
+
+	ch->perm = malloc(sizeof(*ch->perm) * rs->nn);
+	if (!ch->perm) {
+		free(ch);
+		return NULL;
+	}
+
+	ch->rs = rs;
+	ch->p = *p;
+	ch->thr_err[0] = threshold(p->p);
+	ch->thr_err[1] = threshold(p->p_bad);
+	ch->thr_state[0] = threshold(p->p_gb);
+	ch->thr_state[1] = threshold(1 - p->p_bg);
+	ch->thr_eras = threshold(p->p_erasure);
+	ch->avx2 = rs_simd_level() == RS_SIMD_AVX2;
+	rs_channel_seed_internal(ch, seed, 0);
+
+	return ch;
+}
+
+void rs_channel_destroy_internal(struct rs_channel *ch)
+{
+	if (!ch)
+		return;
+
+	free(ch->perm);
+	free(ch);
+}
+
+/*
+ * Exactly p.erasures erasures and p.errors errors at distinct positions.
+ * perm[0..k-1] become the positions, the erasures first.
+ */
+static inline int apply_fixed(struct rs_channel *ch, void *data, int len,
+			      int stride, int *eras, int wide)
+{
+	int nn = ch->rs->nn;
+	int nf = ch->p.erasures;
+	int k = nf + ch->p.errors;
+	int *perm = ch->perm;
+
+	if (ch->perm_len != len) {
+		for (int i = 0; i < len; i++)
+			perm[i] = i;
+		ch->perm_len = len;
+	}
+
+	for (int i0 = 0; i0 < k; i0 += CHUNK) {
+		int m = MIN(CHUNK, k - i0);
+		uint64_t *r = rng_fill(ch, 2 * m);
+
+		for (int j = 0; j < m; j++) {
+			int i = i0 + j;
+			int s = i + below(r[j], len - i);
+			int pos = perm[s];
+
+			perm[s] = perm[i];
+			perm[i] = pos;
+
+			/* Erasures take any value, errors a non-zero one */
+			int v = i < nf ? below(r[m + j], nn + 1)
+				       : 1 + below(r[m + j], nn);
+			int at = pos * stride;
+			STORE(data, at, LOAD(data, at) ^ v);
+		}
+	}
+
+	if (eras)
+		memcpy(eras, perm, sizeof(*eras) * nf);
+
+	return nf;
+}
+
+/*
+ * Memoryless erasures with probability p_erasure. The random numbers in r
+ * for the values are reused, from the low half. The positions go to out,
+ * which has room for len entries.
+ */
+static inline int add_erasures(struct rs_channel *ch, void *data, int i0,
+			       int m, int stride, const uint64_t *er,
+			       const uint64_t *val, int *out, int n, int wide)
+{
+	uint64_t thr = ch->thr_eras;
+	uint64_t q = ch->rs->nn + 1;
+
+	for (int j = 0; j < m; j++) {
+		int f = (er[j] >> 11) < thr;
+		int v = -f & (int) (((uint32_t) val[j] * q) >> 32);
+		int at = (i0 + j) * stride;
+
+		STORE(data, at, LOAD(data, at) ^ v);
+		out[n] = i0 + j;
+		n += f;
+	}
+
+	return n;
+}
+
+/* Independent errors with probability p, and erasures */
+static inline int apply_symmetric(struct rs_channel *ch, void *data, int len,
+				  int stride, int *out, int wide)
+{
+	int nn = ch->rs->nn;
+	uint64_t thr = ch->thr_err[0];
+	int draws = ch->thr_eras ? 3 : 2;
+	int n = 0;
+
+	for (int i0 = 0; i0 < len; i0 += CHUNK) {
+		int m = MIN(CHUNK, len - i0);
+		uint64_t *r = rng_fill(ch, draws * m);
+
+		for (int j = 0; j < m; j++) {
+			int e = (r[j] >> 11) < thr;
+			int v = -e & (1 + below(r[m + j], nn));
+			int at = (i0 + j) * stride;
+
+			STORE(data, at, LOAD(data, at) ^ v);
+		}
+
+		if (ch->thr_eras)
+			n = add_erasures(ch, data, i0, m, stride, r + 2 * m,
+					 r + m, out, n, wide);
+	}
+
+	return n;
+}
+
+/*
+ * Gilbert-Elliott channel: a Markov chain of a good and a bad state, with
+ * independent errors of probability p and p_bad in them. The state moves
+ * before every symbol and carries over to the next word.
+ */
+static inline int apply_ge(struct rs_channel *ch, void *data, int len,
+			   int stride, int *out, int wide)
+{
+	int nn = ch->rs->nn;
+	int draws = ch->thr_eras ? 4 : 3;
+	int bad = ch->bad;
+	int n = 0;
+
+	for (int i0 = 0; i0 < len; i0 += CHUNK) {
+		int m = MIN(CHUNK, len - i0);
+		uint64_t *r = rng_fill(ch, draws * m);
+
+		for (int j = 0; j < m; j++) {
+			bad = (r[j] >> 11) < ch->thr_state[bad];
+
+			int e = (r[m + j] >> 11) < ch->thr_err[bad];
+			int v = -e & (1 + below(r[2 * m + j], nn));
+			int at = (i0 + j) * stride;
+
+			STORE(data, at, LOAD(data, at) ^ v);
+		}
+
+		if (ch->thr_eras)
+			n = add_erasures(ch, data, i0, m, stride, r + 3 * m,
+					 r + 2 * m, out, n, wide);
+	}
+
+	ch->bad = bad;
+	return n;
+}
+
+static inline int apply_word(struct rs_channel *ch, void *data, int len,
+			     int stride, int *eras, int wide)
+{
+	/* Without eras, the random channels write the positions to perm */
+	int *out = eras ? eras : ch->perm;
+
+	switch (ch->p.model) {
+	case RS_CHANNEL_FIXED:
+		return apply_fixed(ch, data, len, stride, eras, wide);
+	case RS_CHANNEL_SYMMETRIC:
+		ch->perm_len = 0;
+		return apply_symmetric(ch, data, len, stride, out, wide);
+	default:
+		ch->perm_len = 0;
+		return apply_ge(ch, data, len, stride, out, wide);
+	}
+}
+
+int rs_channel_apply_internal(struct rs_channel *ch, void **data, int n,
+			      int len, int stride, int *eras, int *no_eras,
+			      int wide)
+{
+	if (len < 1 || len > ch->rs->nn
+	    || (ch->p.model == RS_CHANNEL_FIXED
+		&& ch->p.errors + ch->p.erasures > len))
+		return -1;
+
+	for (int c = 0; c < n; c++) {
+		int *e = eras ? eras + (size_t) c * len : NULL;
+		int k;
+
+		if (wide)
+			k = apply_word(ch, data[c], len, stride, e, 1);
+		else
+			k = apply_word(ch, data[c], len, stride, e, 0);
+
+		if (no_eras)
+			no_eras[c] = k;
+	}
+
+	return 0;
+}
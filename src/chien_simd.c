@@ -0,0 +1,294 @@
+/*
+ * chien_simd.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internal.h"
+#include <string.h>
+
+/*
+ * Vectorized Chien search.
+ *
+ * Position k of the codeword is a root if lambda(alpha^i) = 0, where
+ * i = (k + 1) * prim. A vector of L lanes covers L consecutive positions, and
+ * for every non-zero term j of lambda the vector T_j holds lambda_j * alpha^(i*j)
+ * for the positions of the lanes. Moving on to the next L positions multiplies
+ * lane l of T_j by alpha^(j * prim * L), which is the same for all lanes, so
+ * the update is a PSHUFB table lookup on the nibbles of T_j. The tables are
+ * built per call from the products of the constant with the powers of x, in
+ * the decoder's scratch memory or on the stack, so they are read with
+ * unaligned loads.
+ *
+ * As in the syndrome kernel, fields with symsize > 8 keep the terms as a low
+ * and a high byte plane.
+ */
+
+#ifdef RS_HAVE_X86_SIMD
+
+#include <immintrin.h>
+
+/* Largest tables put on the stack without scratch */
+#define CHIEN_STACK_LEN 4096
+
+struct chien {
+	struct rs_code *rs;
+	int nterms;             /* Number of non-zero terms of lambda */
+	int pad;
+	int deg;
+	uint16_t *root;
+	uint16_t *loc;
+	int count;
+};
+
+/*
+ * Stores the positions of the roots in the lanes of mask, in order. Returns
+ * non-zero when all roots have been found.
+ */
+static int add_roots(struct chien *c, unsigned mask, int base)
+{
+	struct rs_code *rs = c->rs;
+
+	/* The lanes past the end of the codeword */
+	if (base + 32 > rs->nn)
+		mask &= (1u << (rs->nn - base)) - 1;
+
+	while (mask) {
+		int k = base + __builtin_ctz(mask);
+		mask &= mask - 1;
+
+		c->root[c->count] = ((long) (k + 1) * rs->prim) % rs->nn;
+		c->loc[c->count] = k;
+		if (++c->count == c->deg)
+			return 1;
+	}
+
+	return 0;
+}
+
+__attribute__((target("ssse3")))
+static void chien_ssse3(struct chien *c, uint8_t *terms, const uint8_t *tab)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (int base = c->pad; base < c->rs->nn; base += 16) {
+		__m128i q = one;
+
+		for (int j = 0; j < c->nterms; j++) {
+			__m128i *a = (__m128i *) (terms + 16 * j);
+			const __m128i *t = (const __m128i *) (tab + 64 * j);
+			__m128i x = _mm_loadu_si128(a);
+			__m128i lo = _mm_and_si128(x, mask);
+			__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+
+			q = _mm_xor_si128(q, x);
+			x = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128(t), lo),
+					  _mm_shuffle_epi8(_mm_loadu_si128(t + 2), hi));
+			_mm_storeu_si128(a, x);
+		}
+
+		unsigned hits = _mm_movemask_epi8(_mm_cmpeq_epi8(q, zero));
+		if (hits && add_roots(c, hits, base))
+			return;
+	}
+}
+
+__attribute__((target("avx2")))
+static void chien_avx2(struct chien *c, uint8_t *terms, const uint8_t *tab)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (int base = c->pad; base < c->rs->nn; base += 32) {
+		__m256i q = one;
+
+		for (int j = 0; j < c->nterms; j++) {
+			__m256i *a = (__m256i *) (terms + 32 * j);
+			const __m256i *t = (const __m256i *) (tab + 64 * j);
+			__m256i x = _mm256_loadu_si256(a);
+			__m256i lo = _mm256_and_si256(x, mask);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+
+			q = _mm256_xor_si256(q, x);
+			x = _mm256_xor_si256(
+				_mm256_shuffle_epi8(_mm256_loadu_si256(t), lo),
+				_mm256_shuffle_epi8(_mm256_loadu_si256(t + 1), hi));
+			_mm256_storeu_si256(a, x);
+		}
+
+		unsigned hits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(q, zero));
+		if (hits && add_roots(c, hits, base))
+			return;
+	}
+}
+
+__attribute__((target("avx2")))
+static void chien16_avx2(struct chien *c, uint8_t *terms, const uint8_t *tab)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (int base = c->pad; base < c->rs->nn; base += 32) {
+		__m256i qlo = one;
+		__m256i qhi = zero;
+
+		for (int j = 0; j < c->nterms; j++) {
+			__m256i *a = (__m256i *) (terms + 64 * j);
+			const __m256i *t = (const __m256i *) (tab + 256 * j);
+			__m256i xlo = _mm256_loadu_si256(a);
+			__m256i xhi = _mm256_loadu_si256(a + 1);
+			__m256i n[4] = {
+				_mm256_and_si256(xlo, mask),
+				_mm256_and_si256(_mm256_srli_epi16(xlo, 4), mask),
+				_mm256_and_si256(xhi, mask),
+				_mm256_and_si256(_mm256_srli_epi16(xhi, 4), mask),
+			};
+
+			qlo = _mm256_xor_si256(qlo, xlo);
+			qhi = _mm256_xor_si256(qhi, xhi);
+
+			xlo = zero;
+			xhi = zero;
+			for (int k = 0; k < 4; k++) {
+				__m256i tlo = _mm256_loadu_si256(t + 2 * k);
+				__m256i thi = _mm256_loadu_si256(t + 2 * k + 1);
+				xlo = _mm256_xor_si256(xlo, _mm256_shuffle_epi8(tlo, n[k]));
+				xhi = _mm256_xor_si256(xhi, _mm256_shuffle_epi8(thi, n[k]));
+			}
+
+			_mm256_storeu_si256(a, xlo);
+			_mm256_storeu_si256(a + 1, xhi);
+		}
+
+		__m256i q = _mm256_or_si256(qlo, qhi);
+		unsigned hits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(q, zero));
+		if (hits && add_roots(c, hits, base))
+			return;
+	}
+}
+
+/*
+ * Builds the nibble tables for multiplication by alpha^e: the products for
+ * nibble k (bits 4k..4k+3) of the multiplicand, as the low byte and, with two
+ * planes, the high byte. Each 16 byte table is repeated in both 128-bit lanes.
+ */
+static void build_tables(struct rs_code *rs, uint8_t *t, int e, int planes)
+{
+	uint16_t p[16] = { 0 };
+	uint16_t prod[16];
+
+	/* The products of alpha^e and x^b */
+	for (int b = 0; b < rs->mm; b++)
+		p[b] = rs->alpha_to[e + b];
+
+	for (int k = 0; k < 2 * planes; k++) {
+		prod[0] = 0;
+		for (int n = 1; n < 16; n++) {
+			int low = __builtin_ctz(n);
+			prod[n] = prod[n & (n - 1)] ^ p[4 * k + low];
+		}
+
+		for (int n = 0; n < 32; n++) {
+			if (planes == 1) {
+				t[32 * k + n] = prod[n & 15];
+			} else {
+				t[64 * k + n] = prod[n & 15] & 0xff;
+				t[64 * k + 32 + n] = prod[n & 15] >> 8;
+			}
+		}
+	}
+}
+
+int rs_chien_simd(struct rs_code *rs, const uint16_t *lambda, int deg,
+		  int pad, uint16_t *root, uint16_t *loc, uint8_t *scratch)
+{
+	int level = rs_simd_level();
+	int nn = rs->nn;
+	int prim = rs->prim;
+	int planes = rs->mm > 8 ? 2 : 1;
+	int lanes = level == RS_SIMD_AVX2 ? 32 : 16;
+
+	if (level == RS_SIMD_NONE || (planes == 2 && level != RS_SIMD_AVX2))
+		return -1;
+	/* Short searches are faster without the table setup */
+	if (deg > CHIEN_MAX_TERMS || nn - pad < 4 * lanes)
+		return -1;
+
+	struct chien c = {
+		.rs = rs,
+		.pad = pad,
+		.deg = deg,
+		.root = root,
+		.loc = loc,
+	};
+
+	/* Without scratch, larger locators are left to the scalar search */
+	int size = planes == 1 ? 64 : 256;
+	int len = deg * (size + lanes * planes);
+	if (!scratch && len > CHIEN_STACK_LEN)
+		return -1;
+
+	uint8_t stack[scratch ? 1 : len];
+	uint8_t *tab = scratch ? scratch : stack;
+	uint8_t *terms = tab + deg * size;
+	int i0 = ((long) (pad + 1) * prim) % nn;
+
+	for (int j = 1; j <= deg; j++) {
+		if (lambda[j] == nn)
+			continue;
+
+		int n = c.nterms++;
+		uint8_t *x = terms + n * lanes * planes;
+		int step = ((long) j * prim) % nn;
+		int e = (lambda[j] + (long) j * i0) % nn;
+
+		/* lambda_j * alpha^(i*j) for the first positions */
+		for (int l = 0; l < lanes; l++, e = subnn(rs, e + step)) {
+			uint16_t v = rs->alpha_to[e];
+			x[l] = v & 0xff;
+			if (planes == 2)
+				x[lanes + l] = v >> 8;
+		}
+
+		build_tables(rs, tab + n * size,
+			     ((long) step * lanes) % nn, planes);
+	}
+
+	if (planes == 2)
+		chien16_avx2(&c, terms, tab);
+	else if (lanes == 32)
+		chien_avx2(&c, terms, tab);
+	else
+		chien_ssse3(&c, terms, tab);
+
+	return c.count;
+}
+
+#else
+
+int rs_chien_simd(struct rs_code *rs, const uint16_t *lambda, int deg,
+		  int pad, uint16_t *root, uint16_t *loc, uint8_t *scratch)
+{
+	(void) rs; (void) lambda; (void) deg;
+	(void) pad; (void) root; (void) loc; (void) scratch;
+	return -1;
+}
+
+#endif /* RS_HAVE_X86_SIMD */
@@ -0,0 +1,564 @@
+/*
+ * encode_simd.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internal.h"
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * Vectorized encoder for codes with symsize <= 8.
+ *
+ * The parity register is kept as a byte vector with par[0] in the lowest
+ * byte. For every data symbol the feedback fb = data ^ par[0] is split into
+ * two nibbles, and the register is updated as
+ *
+ *   par = (par >> 8) ^ lo[fb & 15] ^ hi[fb >> 4]
+ *
+ * where lo[n] and hi[n] hold the products n * g_k and (n << 4) * g_k for
+ * every generator coefficient g_k. The tables are stored nibble-major, so
+ * that the products for all coefficients form one row that is xored into the
+ * register with full width vector instructions. The rows are padded with
+ * zeros to a multiple of 32 bytes, which keeps the unused lanes of the
+ * register at zero.
+ */
+
+#ifdef RS_HAVE_X86_SIMD
+
+#include <immintrin.h>
+
+static uint8_t gf_mul(struct rs_code *rs, int a, uint16_t b_log)
+{
+	/*
+	 * A nibble above nn is no symbol of a field with symsize < 8, and
+	 * index_of has no entry for it. Its table entries are never used.
+	 */
+	if (a == 0 || a > rs->nn || b_log == rs->nn)
+		return 0;
+
+	return rs->alpha_to[modnn(rs, rs->index_of[a] + b_log)];
+}
+
+/*
+ * The kernels are written once for both symbol widths. The wide argument is
+ * a compile time constant in every caller, so the width checks are folded
+ * away when the body is inlined.
+ */
+#define ELEM(p, i) (wide ? (void *) ((uint16_t *) (p) + (i)) \
+		  : (void *) ((uint8_t *) (p) + (i)))
+#define LOAD(p, i) (wide ? ((const uint16_t *) (p))[i] \
+		  : ((const uint8_t *) (p))[i])
+
+/* Number of codewords the batch kernels run side by side */
+#define MULTI 4
+
+/*
+ * Single codeword kernels, run on nb <= MULTI independent codewords in
+ * lockstep so that the latency of one parity register update is hidden
+ * behind the others. The registers are loaded from par[] and stored back
+ * with stride pstride.
+ */
+__attribute__((target("ssse3"), always_inline))
+static inline void encode_ssse3_body(struct rs_code *rs,
+				     const void *const *data, void *const *par,
+				     int nb, int dlen, int stride, int pstride,
+				     int wide)
+{
+	const uint8_t *tab = rs->enc_tab;
+	int nroots = rs->nroots;
+	int w = rs->enc_tab_w;
+	int nv = (nroots + 15) / 16;
+	__m128i reg[nb][nv];
+	uint8_t buf[16 * nv];
+
+	for (int c = 0; c < nb; c++) {
+		memset(buf, 0, sizeof(buf));
+		for (int i = 0; i < nroots; i++)
+			buf[i] = LOAD(par[c], i * pstride);
+		for (int v = 0; v < nv; v++)
+			reg[c][v] = _mm_loadu_si128((const __m128i *) buf + v);
+	}
+
+	int cutoff = dlen * stride;
+	for (int i = 0; i < cutoff; i += stride) {
+		for (int c = 0; c < nb; c++) {
+			__m128i *r = reg[c];
+			uint8_t fb = LOAD(data[c], i) ^ _mm_cvtsi128_si32(r[0]);
+			const __m128i *lo = (const __m128i *) (tab + (fb & 15) * w);
+			const __m128i *hi = (const __m128i *) (tab + (16 + (fb >> 4)) * w);
+
+			for (int v = 0; v < nv - 1; v++) {
+				__m128i t = _mm_alignr_epi8(r[v + 1], r[v], 1);
+				r[v] = _mm_xor_si128(t, _mm_xor_si128(lo[v], hi[v]));
+			}
+
+			__m128i t = _mm_srli_si128(r[nv - 1], 1);
+			r[nv - 1] = _mm_xor_si128(t, _mm_xor_si128(lo[nv - 1],
+								   hi[nv - 1]));
+		}
+	}
+
+	for (int c = 0; c < nb; c++) {
+		for (int v = 0; v < nv; v++)
+			_mm_storeu_si128((__m128i *) buf + v, reg[c][v]);
+		for (int i = 0; i < nroots; i++) {
+			if (wide)
+				((uint16_t *) par[c])[i * pstride] = buf[i];
+			else
+				((uint8_t *) par[c])[i * pstride] = buf[i];
+		}
+	}
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void encode_avx2_body(struct rs_code *rs,
+				    const void *const *data, void *const *par,
+				    int nb, int dlen, int stride, int pstride,
+				    int wide)
+{
+	const uint8_t *tab = rs->enc_tab;
+	int nroots = rs->nroots;
+	int w = rs->enc_tab_w;
+	int nv = w / 32;
+	__m256i reg[nb][nv + 1];
+	uint8_t buf[w];
+
+	for (int c = 0; c < nb; c++) {
+		memset(buf, 0, sizeof(buf));
+		for (int i = 0; i < nroots; i++)
+			buf[i] = LOAD(par[c], i * pstride);
+		for (int v = 0; v < nv; v++)
+			reg[c][v] = _mm256_loadu_si256((const __m256i *) buf + v);
+
+		/* Shifting in zeros from the end of the register */
+		reg[c][nv] = _mm256_setzero_si256();
+	}
+
+	int cutoff = dlen * stride;
+	for (int i = 0; i < cutoff; i += stride) {
+		for (int c = 0; c < nb; c++) {
+			__m256i *r = reg[c];
+			uint8_t fb = LOAD(data[c], i) ^ _mm256_cvtsi256_si32(r[0]);
+			const __m256i *lo = (const __m256i *) (tab + (fb & 15) * w);
+			const __m256i *hi = (const __m256i *) (tab + (16 + (fb >> 4)) * w);
+
+			for (int v = 0; v < nv; v++) {
+				/* Shift the register down by one byte across lanes */
+				__m256i t = _mm256_permute2x128_si256(r[v], r[v + 1],
+								      0x21);
+				t = _mm256_alignr_epi8(t, r[v], 1);
+				r[v] = _mm256_xor_si256(t, _mm256_xor_si256(lo[v],
+									    hi[v]));
+			}
+		}
+	}
+
+	for (int c = 0; c < nb; c++) {
+		for (int v = 0; v < nv; v++)
+			_mm256_storeu_si256((__m256i *) buf + v, reg[c][v]);
+		for (int i = 0; i < nroots; i++) {
+			if (wide)
+				((uint16_t *) par[c])[i * pstride] = buf[i];
+			else
+				((uint8_t *) par[c])[i * pstride] = buf[i];
+		}
+	}
+}
+
+/*
+ * Structure of arrays kernels. Symbol i of codeword c is stored at
+ * data[i * n + c], so a vector load gives the same symbol of 16 or 32
+ * codewords, one per lane. The parity registers of the codewords are
+ * updated lane by lane, and the products fb * g_k are formed with PSHUFB
+ * from the 16 entry nibble tables of each generator coefficient. The
+ * registers are kept as a ring buffer of vectors.
+ */
+__attribute__((target("ssse3"), always_inline))
+static inline __m128i load16_ssse3(const void *p, int wide)
+{
+	if (!wide)
+		return _mm_loadu_si128((const __m128i *) p);
+
+	__m128i a = _mm_loadu_si128((const __m128i *) p);
+	__m128i b = _mm_loadu_si128((const __m128i *) p + 1);
+	return _mm_packus_epi16(a, b);
+}
+
+__attribute__((target("ssse3"), always_inline))
+static inline void store16_ssse3(void *p, __m128i x, int wide)
+{
+	if (!wide) {
+		_mm_storeu_si128((__m128i *) p, x);
+		return;
+	}
+
+	__m128i zero = _mm_setzero_si128();
+	_mm_storeu_si128((__m128i *) p, _mm_unpacklo_epi8(x, zero));
+	_mm_storeu_si128((__m128i *) p + 1, _mm_unpackhi_epi8(x, zero));
+}
+
+__attribute__((target("ssse3"), always_inline))
+static inline void encode_soa_ssse3_body(struct rs_code *rs, void *data,
+					 void *par_out, int n, int dlen,
+					 int wide)
+{
+	const uint8_t *coef = rs->enc_tab + 32 * rs->enc_tab_w;
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	int nroots = rs->nroots;
+	__m128i par[nroots];
+	int h = 0;
+
+	for (int k = 0; k < nroots; k++)
+		par[k] = _mm_setzero_si128();
+
+	for (int i = 0; i < dlen; i++) {
+		__m128i fb = _mm_xor_si128(load16_ssse3(ELEM(data, i * n), wide),
+					   par[h]);
+		__m128i lo = _mm_and_si128(fb, mask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(fb, 4), mask);
+
+		par[h] = _mm_setzero_si128();
+		if (++h == nroots)
+			h = 0;
+
+		for (int k = 0; k < nroots; k++) {
+			const __m128i *t = (const __m128i *) (coef + 64 * k);
+			__m128i p = _mm_xor_si128(_mm_shuffle_epi8(t[0], lo),
+						  _mm_shuffle_epi8(t[2], hi));
+			int j = h + k < nroots ? h + k : h + k - nroots;
+			par[j] = _mm_xor_si128(par[j], p);
+		}
+	}
+
+	for (int k = 0; k < nroots; k++) {
+		store16_ssse3(ELEM(par_out, k * n), par[h], wide);
+		if (++h == nroots)
+			h = 0;
+	}
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i load32_avx2(const void *p, int wide)
+{
+	if (!wide)
+		return _mm256_loadu_si256((const __m256i *) p);
+
+	__m256i a = _mm256_loadu_si256((const __m256i *) p);
+	__m256i b = _mm256_loadu_si256((const __m256i *) p + 1);
+	return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void store32_avx2(void *p, __m256i x, int wide)
+{
+	if (!wide) {
+		_mm256_storeu_si256((__m256i *) p, x);
+		return;
+	}
+
+	__m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x));
+	__m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1));
+	_mm256_storeu_si256((__m256i *) p, lo);
+	_mm256_storeu_si256((__m256i *) p + 1, hi);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void encode_soa_avx2_body(struct rs_code *rs, void *data,
+					void *par_out, int n, int dlen,
+					int wide)
+{
+	const uint8_t *coef = rs->enc_tab + 32 * rs->enc_tab_w;
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	int nroots = rs->nroots;
+	__m256i par[nroots];
+	int h = 0;
+
+	for (int k = 0; k < nroots; k++)
+		par[k] = _mm256_setzero_si256();
+
+	for (int i = 0; i < dlen; i++) {
+		__m256i fb = _mm256_xor_si256(load32_avx2(ELEM(data, i * n), wide),
+					      par[h]);
+		__m256i lo = _mm256_and_si256(fb, mask);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(fb, 4), mask);
+
+		par[h] = _mm256_setzero_si256();
+		if (++h == nroots)
+			h = 0;
+
+		for (int k = 0; k < nroots; k++) {
+			const __m256i *t = (const __m256i *) (coef + 64 * k);
+			__m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(t[0], lo),
+						     _mm256_shuffle_epi8(t[1], hi));
+			int j = h + k < nroots ? h + k : h + k - nroots;
+			par[j] = _mm256_xor_si256(par[j], p);
+		}
+	}
+
+	for (int k = 0; k < nroots; k++) {
+		store32_avx2(ELEM(par_out, k * n), par[h], wide);
+		if (++h == nroots)
+			h = 0;
+	}
+}
+
+#undef LOAD
+
+__attribute__((target("ssse3")))
+static void encode_ssse3(struct rs_code *rs, const uint16_t *data,
+			 uint16_t *par, int dlen, int stride)
+{
+	const void *d = data;
+	void *p = par;
+	encode_ssse3_body(rs, &d, &p, 1, dlen, stride, 1, 1);
+}
+
+__attribute__((target("ssse3")))
+static void encode8_ssse3(struct rs_code *rs, const uint8_t *data,
+			  uint8_t *par, int dlen, int stride)
+{
+	const void *d = data;
+	void *p = par;
+	encode_ssse3_body(rs, &d, &p, 1, dlen, stride, 1, 0);
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(struct rs_code *rs, const uint16_t *data,
+			uint16_t *par, int dlen, int stride)
+{
+	const void *d = data;
+	void *p = par;
+	encode_avx2_body(rs, &d, &p, 1, dlen, stride, 1, 1);
+}
+
+__attribute__((target("avx2")))
+static void encode8_avx2(struct rs_code *rs, const uint8_t *data,
+			 uint8_t *par, int dlen, int stride)
+{
+	const void *d = data;
+	void *p = par;
+	encode_avx2_body(rs, &d, &p, 1, dlen, stride, 1, 0);
+}
+
+/* Zeroes the parity of the codewords before they are encoded */
+static void zero_par(void *const *par, int n, int nroots, int pstride,
+		     int wide)
+{
+	for (int c = 0; c < n; c++) {
+		for (int i = 0; i < nroots; i++)
+			memset(ELEM(par[c], i * pstride), 0, wide ? 2 : 1);
+	}
+}
+
+__attribute__((target("ssse3")))
+static void encode_multi_ssse3(struct rs_code *rs, const void *const *data,
+			       void *const *par, int dlen, int stride,
+			       int pstride, int wide)
+{
+	zero_par(par, MULTI, rs->nroots, pstride, wide);
+
+	if (wide)
+		encode_ssse3_body(rs, data, par, MULTI, dlen, stride, pstride, 1);
+	else
+		encode_ssse3_body(rs, data, par, MULTI, dlen, stride, pstride, 0);
+}
+
+__attribute__((target("avx2")))
+static void encode_multi_avx2(struct rs_code *rs, const void *const *data,
+			      void *const *par, int dlen, int stride,
+			      int pstride, int wide)
+{
+	zero_par(par, MULTI, rs->nroots, pstride, wide);
+
+	if (wide)
+		encode_avx2_body(rs, data, par, MULTI, dlen, stride, pstride, 1);
+	else
+		encode_avx2_body(rs, data, par, MULTI, dlen, stride, pstride, 0);
+}
+
+__attribute__((target("ssse3")))
+static void encode_soa_ssse3(struct rs_code *rs, void *data, void *par,
+			     int n, int dlen, int wide)
+{
+	if (wide)
+		encode_soa_ssse3_body(rs, data, par, n, dlen, 1);
+	else
+		encode_soa_ssse3_body(rs, data, par, n, dlen, 0);
+}
+
+__attribute__((target("avx2")))
+static void encode_soa_avx2(struct rs_code *rs, void *data, void *par,
+			    int n, int dlen, int wide)
+{
+	if (wide)
+		encode_soa_avx2_body(rs, data, par, n, dlen, 1);
+	else
+		encode_soa_avx2_body(rs, data, par, n, dlen, 0);
+}
+
+/* Detected once at load time, the decoders check it on every call */
+static int simd_level;
+
+__attribute__((constructor))
+static void detect_simd_level(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		simd_level = RS_SIMD_AVX2;
+	else if (__builtin_cpu_supports("ssse3"))
+		simd_level = RS_SIMD_SSSE3;
+	else
+		simd_level = RS_SIMD_NONE;
+}
+
+int rs_simd_level(void)
+{
+	return simd_level;
+}
+
+int rs_encode_simd_multi(struct rs_code *rs, const void *const *data,
+			 void *const *par, int n, int dlen, int stride,
+			 int pstride, int wide)
+{
+	if (!rs->enc_tab)
+		return 0;
+
+	int level = rs_simd_level();
+	int done;
+	for (done = 0; done + MULTI <= n; done += MULTI) {
+		if (level == RS_SIMD_AVX2)
+			encode_multi_avx2(rs, data + done, par + done, dlen,
+					  stride, pstride, wide);
+		else
+			encode_multi_ssse3(rs, data + done, par + done, dlen,
+					   stride, pstride, wide);
+	}
+
+	return done;
+}
+
+int rs_encode_simd_soa(struct rs_code *rs, void *data, void *par, int n,
+		       int dlen, int wide)
+{
+	if (!rs->enc_tab)
+		return 0;
+
+	int level = rs_simd_level();
+	int lanes = level == RS_SIMD_AVX2 ? 32 : 16;
+	int done;
+	for (done = 0; done + lanes <= n; done += lanes) {
+		if (level == RS_SIMD_AVX2)
+			encode_soa_avx2(rs, ELEM(data, done), ELEM(par, done),
+					n, dlen, wide);
+		else
+			encode_soa_ssse3(rs, ELEM(data, done), ELEM(par, done),
+					 n, dlen, wide);
+	}
+
+	return done;
+}
+
+#undef ELEM
+
+int rs_encode_simd_init(struct rs_code *rs)
+{
+	int nroots = rs->nroots;
+	uint16_t *gp = rs->genpoly;
+
+	if (rs->mm > 8 || nroots == 0)
+		return 0;
+
+	switch (rs_simd_level()) {
+	case RS_SIMD_AVX2:
+		rs->enc_simd = encode_avx2;
+		rs->enc_simd8 = encode8_avx2;
+		break;
+	case RS_SIMD_SSSE3:
+		rs->enc_simd = encode_ssse3;
+		rs->enc_simd8 = encode8_ssse3;
+		break;
+	default:
+		return 0;
+	}
+
+	/*
+	 * The nibble-major rows are followed by the same products stored
+	 * per coefficient for PSHUFB, 16 entries for the low nibble and 16
+	 * for the high nibble, each repeated to fill 32 bytes.
+	 */
+	int w = (nroots + 31) & ~31;
+	size_t size = 32 * w + 64 * nroots;
+	rs->enc_tab = aligned_alloc(32, size);
+	if (!rs->enc_tab) {
+		rs->enc_simd = NULL;
+		rs->enc_simd8 = NULL;
+		return -1;
+	}
+
+	rs->enc_tab_w = w;
+	memset(rs->enc_tab, 0, size);
+	for (int n = 0; n < 16; n++) {
+		uint8_t *lo = rs->enc_tab + n * w;
+		uint8_t *hi = rs->enc_tab + (16 + n) * w;
+		for (int k = 0; k < nroots; k++) {
+			lo[k] = gf_mul(rs, n, gp[nroots - 1 - k]);
+			hi[k] = gf_mul(rs, n << 4, gp[nroots - 1 - k]);
+		}
+	}
+
+	uint8_t *coef = rs->enc_tab + 32 * w;
+	for (int k = 0; k < nroots; k++) {
+		for (int n = 0; n < 32; n++) {
+			coef[64 * k + n] = rs->enc_tab[(n & 15) * w + k];
+			coef[64 * k + 32 + n] = rs->enc_tab[(16 + (n & 15)) * w + k];
+		}
+	}
+
+	return 0;
+}
+
+#else
+
+int rs_simd_level(void)
+{
+	return RS_SIMD_NONE;
+}
+
+int rs_encode_simd_init(struct rs_code *rs)
+{
+	(void) rs;
+	return 0;
+}
+
+int rs_encode_simd_multi(struct rs_code *rs, const void *const *data,
+			 void *const *par, int n, int dlen, int stride,
+			 int pstride, int wide)
+{
+	(void) rs; (void) data; (void) par; (void) n;
+	(void) dlen; (void) stride; (void) pstride; (void) wide;
+	return 0;
+}
+
+int rs_encode_simd_soa(struct rs_code *rs, void *data, void *par, int n,
+		       int dlen, int wide)
+{
+	(void) rs; (void) data; (void) par; (void) n; (void) dlen; (void) wide;
+	return 0;
+}
+
+#endif /* RS_HAVE_X86_SIMD */
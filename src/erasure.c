@@ -0,0 +1,428 @@
+/*
+ * erasure.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Erasure patterns shared by many words. With the erasures fixed, so is the
+ * erasure locator lambda(x), and the error values the Forney algorithm finds
+ * in decode_erasures are linear in the syndrome S. At the root r_j of lambda,
+ *
+ *   Y_j = r_j^(fcr - 1) * omega(r_j) / lambda'(r_j),
+ *   omega_m = sum_(k <= m) lambda_k * S_(m - k), m < no_eras,
+ *
+ * so Y_j = sum_i m_ji * S_i with
+ *
+ *   m_ji = r_j^(fcr - 1) / lambda'(r_j)
+ *          * sum_(k < no_eras - i) lambda_k * r_j^(i + k).
+ *
+ * The check of decode_erasures, that the coefficients no_eras ... nroots - 1
+ * of lambda(x) * S(x) are zero, is linear too. A pattern keeps lambda and the
+ * matrix, and a word then costs no_eras^2 + (nroots - no_eras) * (no_eras + 1)
+ * products with constants. The vectorized kernel does them for RS_ERAS_BLOCK
+ * words at once, with PSHUFB tables of the constants built with the pattern.
+ *
+ * Each decoder context keeps the last ERAS_CACHE patterns it has seen, most
+ * recently used first.
+ */
+
+#include "internal.h"
+#include "list.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of patterns a decoder context keeps */
+#define ERAS_CACHE 8
+
+struct rs_eras_cache {
+	LIST *lru;              /* Patterns, most recently used first */
+	int n;                  /* Number of patterns */
+};
+
+/* Bytes of the PSHUFB tables of a constant, products with both nibbles */
+#define TAB_LEN 32
+
+/*
+ * Fills the tables of the product with alpha^lc (zero if lc = nn). Symbols
+ * have no bits above nn, so those entries are never used.
+ */
+static void build_tab(struct rs_code *rs, int lc, uint8_t *tab)
+{
+	for (int n = 0; n < 16; n++) {
+		int hi = n << 4;
+
+		tab[n] = (n && n <= rs->nn && lc != rs->nn)
+			 ? rs->alpha_to[rs->index_of[n] + lc] : 0;
+		tab[16 + n] = (hi && hi <= rs->nn && lc != rs->nn)
+			      ? rs->alpha_to[rs->index_of[hi] + lc] : 0;
+	}
+}
+
+static void free_pattern(struct rs_eras *p)
+{
+	if (!p)
+		return;
+
+	free(p->eras);
+	free(p->lambda);
+	free(p->m);
+	free(p->tab);
+	free(p);
+}
+
+/* Builds the pattern of the sorted, distinct erasures eras */
+static struct rs_eras *new_pattern(struct rs_code *rs, int len,
+				   const int *eras, int no_eras)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int pad = nn - len;
+
+	struct rs_eras *p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+
+	p->len = len;
+	p->no_eras = no_eras;
+	p->eras = malloc(sizeof(*p->eras) * (no_eras + 1));
+	p->lambda = malloc(sizeof(*p->lambda) * (nroots + 1));
+	p->m = malloc(sizeof(*p->m) * (no_eras * no_eras + 1));
+	if (!p->eras || !p->lambda || !p->m)
+		goto err;
+
+	memcpy(p->eras, eras, sizeof(*eras) * no_eras);
+
+	/* The erasure locator, as in decode */
+	uint16_t *lambda = p->lambda;
+	memset(lambda, 0, sizeof(*lambda) * (nroots + 1));
+	lambda[0] = 1;
+	for (int i = 0; i < no_eras; i++) {
+		uint16_t u = modnn(rs, rs->prim * (nn - 1 - (eras[i] + pad)));
+		for (int j = i + 1; j > 0; j--) {
+			uint16_t tmp = index_of[lambda[j - 1]];
+			if (tmp != nn)
+				lambda[j] ^= alpha_to[u + tmp];
+		}
+	}
+	for (int i = 0; i <= nroots; i++)
+		lambda[i] = index_of[lambda[i]];
+
+	for (int j = 0; j < no_eras; j++) {
+		/* Position k is the root alpha^((k + 1) * prim), as in chien */
+		long long rj = ((long long) (eras[j] + pad + 1) * rs->prim) % nn;
+		int num2 = (rj * (rs->fcr - 1 + nn)) % nn;
+
+		uint16_t den = 0;
+		int cutoff = no_eras < nroots ? no_eras : nroots - 1;
+		for (int i = 0; i <= cutoff; i += 2) {
+			if (lambda[i + 1] != nn)
+				den ^= alpha_to[(lambda[i + 1] + rj * i) % nn];
+		}
+
+		/* The roots are distinct, so den is not zero */
+		int scale = num2 + nn - index_of[den];
+
+		for (int i = 0; i < no_eras; i++) {
+			uint16_t x = 0;
+			for (int k = 0; k < no_eras - i; k++) {
+				if (lambda[k] != nn)
+					x ^= alpha_to[(lambda[k] + rj * (i + k))
+						      % nn];
+			}
+			p->m[j * no_eras + i] = x ? (index_of[x] + scale) % nn
+						  : nn;
+		}
+	}
+
+	/* Tables of the matrix, then of lambda */
+	if (rs->mm <= 8 && rs_simd_level() == RS_SIMD_AVX2) {
+		int consts = no_eras * no_eras + no_eras + 1;
+
+		p->tab = aligned_alloc(32, TAB_LEN * consts);
+		if (!p->tab)
+			goto err;
+
+		for (int i = 0; i < no_eras * no_eras; i++)
+			build_tab(rs, p->m[i], p->tab + TAB_LEN * i);
+		for (int k = 0; k <= no_eras; k++)
+			build_tab(rs, lambda[k], p->tab + TAB_LEN
+				  * (no_eras * no_eras + k));
+	}
+
+	return p;
+
+err:
+	free_pattern(p);
+	return NULL;
+}
+
+/*
+ * The blocks of rs_eras_solve_internal in one allocation: the kernel's
+ * nroots syndromes and up to nroots + 1 values of RS_ERAS_BLOCK bytes each,
+ * then syn, val and bad.
+ */
+static struct rs_eras_work *alloc_work(struct rs_code *rs)
+{
+	int nroots = rs->nroots;
+	size_t simd = 0;
+
+	if (rs->mm <= 8 && rs_simd_level() == RS_SIMD_AVX2)
+		simd = (2 * nroots + 1) * RS_ERAS_BLOCK;
+
+	size_t blk = sizeof(uint16_t) * RS_ERAS_BLOCK * nroots;
+	size_t len = ALIGN(sizeof(struct rs_eras_work)) + simd + 2 * blk
+		     + RS_ERAS_BLOCK;
+	struct rs_eras_work *ew = aligned_alloc(32, ALIGN(len));
+	if (!ew)
+		return NULL;
+
+	uint8_t *mem = (uint8_t *) ew + ALIGN(sizeof(*ew));
+	ew->simd = simd ? mem : NULL;
+	mem += simd;
+	ew->syn = (uint16_t *) mem;
+	ew->val = (uint16_t *) (mem + blk);
+	ew->bad = mem + 2 * blk;
+
+	return ew;
+}
+
+struct rs_eras *rs_eras_get_internal(struct rs_decoder *dec, int len,
+				     const int *eras, int no_eras)
+{
+	struct rs_code *rs = dec->rs;
+	int sorted[no_eras + 1];
+
+	if (len <= rs->nroots || len > rs->nn || no_eras > rs->nroots)
+		return NULL;
+
+	/* The order of the erasures does not matter */
+	for (int i = 0; i < no_eras; i++) {
+		int x = eras[i], k = i;
+		if (x < 0 || x >= len)
+			return NULL;
+		for (; k > 0 && sorted[k - 1] > x; k--)
+			sorted[k] = sorted[k - 1];
+		if (k > 0 && sorted[k - 1] == x)
+			return NULL;
+		sorted[k] = x;
+	}
+
+	struct rs_eras_cache *cache = dec->eras;
+	if (!cache) {
+		cache = calloc(1, sizeof(*cache));
+		if (!cache)
+			return NULL;
+		cache->lru = LIST_alloc();
+		dec->eras_work = alloc_work(rs);
+		if (!cache->lru || !dec->eras_work) {
+			if (cache->lru)
+				LIST_free(cache->lru);
+			free(dec->eras_work);
+			dec->eras_work = NULL;
+			free(cache);
+			return NULL;
+		}
+		dec->eras = cache;
+	}
+
+	for (LIST_NODE *node = LIST_first(cache->lru); node;
+	     node = LIST_next(node)) {
+		struct rs_eras *p = node->data;
+
+		if (p->len == len && p->no_eras == no_eras
+		    && !memcmp(p->eras, sorted, sizeof(*sorted) * no_eras)) {
+			LIST_move_front(cache->lru, node);
+			return p;
+		}
+	}
+
+	struct rs_eras *p = new_pattern(rs, len, sorted, no_eras);
+	if (!p)
+		return NULL;
+
+	if (!LIST_push_front(cache->lru, p)) {
+		free_pattern(p);
+		return NULL;
+	}
+
+	if (++cache->n > ERAS_CACHE) {
+		free_pattern(LIST_pop_back(cache->lru));
+		cache->n--;
+	}
+
+	return p;
+}
+
+void rs_eras_cache_free_internal(struct rs_decoder *dec)
+{
+	struct rs_eras_cache *cache = dec->eras;
+
+	if (!cache)
+		return;
+
+	while (!LIST_empty(cache->lru))
+		free_pattern(LIST_pop_front(cache->lru));
+
+	LIST_free(cache->lru);
+	free(cache);
+	free(dec->eras_work);
+	dec->eras_work = NULL;
+	dec->eras = NULL;
+}
+
+#ifdef RS_HAVE_X86_SIMD
+
+#include <immintrin.h>
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i mulc(__m256i x, const uint8_t *tab)
+{
+	__m256i lo = _mm256_broadcastsi128_si256(
+		_mm_load_si128((const __m128i *) tab));
+	__m256i hi = _mm256_broadcastsi128_si256(
+		_mm_load_si128((const __m128i *) (tab + 16)));
+	__m256i m = _mm256_set1_epi8(0x0f);
+
+	return _mm256_xor_si256(
+		_mm256_shuffle_epi8(lo, _mm256_and_si256(x, m)),
+		_mm256_shuffle_epi8(hi, _mm256_and_si256(
+			_mm256_srli_epi16(x, 4), m)));
+}
+
+/*
+ * The values and checks of RS_ERAS_BLOCK words, one per byte, from the
+ * syndromes s[i] of the words.
+ */
+__attribute__((target("avx2")))
+static void solve_avx2(struct rs_code *rs, const struct rs_eras *p,
+		       const __m256i *s, __m256i *val, __m256i *bad)
+{
+	int no_eras = p->no_eras;
+	const uint8_t *ltab = p->tab + TAB_LEN * no_eras * no_eras;
+	__m256i chk = _mm256_setzero_si256();
+
+	for (int j = 0; j < no_eras; j++) {
+		const uint8_t *tab = p->tab + TAB_LEN * j * no_eras;
+		__m256i y = _mm256_setzero_si256();
+
+		for (int i = 0; i < no_eras; i++)
+			y = _mm256_xor_si256(y, mulc(s[i], tab + TAB_LEN * i));
+		val[j] = y;
+	}
+
+	for (int i = no_eras; i < rs->nroots; i++) {
+		__m256i x = _mm256_setzero_si256();
+
+		for (int k = 0; k <= no_eras; k++)
+			x = _mm256_xor_si256(x, mulc(s[i - k], ltab + TAB_LEN * k));
+		chk = _mm256_or_si256(chk, x);
+	}
+
+	*bad = chk;
+}
+
+static int solve_simd(struct rs_code *rs, const struct rs_eras *p,
+		      struct rs_eras_work *ew, int n)
+{
+	int nroots = rs->nroots;
+	int no_eras = p->no_eras;
+	const uint16_t *syn = ew->syn;
+	uint16_t *val = ew->val;
+
+	if (!p->tab || !ew->simd)
+		return 0;
+
+	__m256i *s = (__m256i *) ew->simd, *v = s + nroots, chk;
+	uint8_t *s8 = (uint8_t *) s, *v8 = (uint8_t *) v, *c8 = (uint8_t *) &chk;
+
+	memset(s, 0, sizeof(*s) * nroots);
+	for (int c = 0; c < n; c++) {
+		for (int i = 0; i < nroots; i++)
+			s8[32 * i + c] = syn[c * nroots + i];
+	}
+
+	solve_avx2(rs, p, s, v, &chk);
+
+	for (int c = 0; c < n; c++) {
+		for (int j = 0; j < no_eras; j++)
+			val[c * nroots + j] = v8[32 * j + c];
+		ew->bad[c] = c8[c] != 0;
+	}
+
+	return 1;
+}
+
+#else
+
+static int solve_simd(struct rs_code *rs, const struct rs_eras *p,
+		      struct rs_eras_work *ew, int n)
+{
+	(void) rs; (void) p; (void) ew; (void) n;
+	return 0;
+}
+
+#endif /* RS_HAVE_X86_SIMD */
+
+void rs_eras_solve_internal(struct rs_decoder *dec, const struct rs_eras *p,
+			    int n)
+{
+	struct rs_code *rs = dec->rs;
+	struct rs_eras_work *ew = dec->eras_work;
+	const uint16_t *syn = ew->syn;
+	uint16_t *val = ew->val, *si = dec->work.si;
+	uint8_t *bad = ew->bad;
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int no_eras = p->no_eras;
+	const uint16_t *lambda = p->lambda;
+
+	if (solve_simd(rs, p, ew, n))
+		return;
+
+	for (int c = 0; c < n; c++) {
+		const uint16_t *s = syn + c * nroots;
+		uint16_t chk = 0;
+
+		for (int i = 0; i < nroots; i++)
+			si[i] = index_of[s[i]];
+
+		for (int j = 0; j < no_eras; j++) {
+			const uint16_t *m = p->m + j * no_eras;
+			uint16_t y = 0;
+
+			for (int i = 0; i < no_eras; i++) {
+				if (si[i] != nn && m[i] != nn)
+					y ^= alpha_to[si[i] + m[i]];
+			}
+			val[c * nroots + j] = y;
+		}
+
+		for (int i = no_eras; i < nroots; i++) {
+			uint16_t x = 0;
+			for (int k = 0; k <= no_eras; k++) {
+				if (si[i - k] != nn && lambda[k] != nn)
+					x ^= alpha_to[si[i - k] + lambda[k]];
+			}
+			chk |= x;
+		}
+		bad[c] = chk != 0;
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * field.c
+ * Copyright (C) 2002 Phil Karn, KA9Q
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Galois field tables. This file is also part of gen_tables, which builds the
+ * precomputed tables at build time.
+ */
+
+#include "internal.h"
+#include <string.h>
+
+int rs_field_init(int mm, int gfpoly, uint16_t *alpha_to)
+{
+	int nn = (1 << mm) - 1;
+	int alen = ALPHA_TO_LEN(nn);
+	uint16_t *index_of = alpha_to + alen;
+	uint16_t *quad = index_of + nn + 1;
+
+	/* Generate Galois field lookup tables */
+	index_of[0] = nn;       /* log(zero) = -inf */
+	int sr = 1;
+
+	for (int i = 0; i < nn; i++) {
+		index_of[sr] = i;
+		alpha_to[i] = sr;
+		sr <<= 1;
+		if (sr & (1 << mm))
+			sr ^= gfpoly;
+		sr &= nn;
+	}
+	if (sr != 1) {
+		/* field generator polynomial is not primitive! */
+		return -1;
+	}
+
+	/* Extend alpha_to so that sums of logs need not be reduced */
+	for (int i = nn; i < alen; i++)
+		alpha_to[i] = alpha_to[i - nn];
+
+	/*
+	 * Roots of y^2 + y = c for the two error decoder. y and y + 1 are both
+	 * roots, and the even one is stored. Zero marks the values of c != 0
+	 * without roots.
+	 */
+	memset(quad, 0, sizeof(*quad) * (nn + 1));
+	for (int y = 2; y <= nn; y += 2) {
+		uint16_t y2 = alpha_to[2 * index_of[y]];
+		quad[y2 ^ y] = y;
+	}
+
+	return 0;
+}
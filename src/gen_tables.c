@@ -0,0 +1,105 @@
+/*
+ * gen_tables.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Writes the precomputed field tables of the library to stdout, as C source.
+ * Run at build time; rs_init uses the tables instead of building its own for
+ * these fields.
+ */
+
+#include "internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The primitive polynomials of the codes in tests/test_codes.h */
+static const struct {
+	int mm;
+	int gfpoly;
+} Fields[] = {
+	{ 2,  0x7     },
+	{ 3,  0xb     },
+	{ 4,  0x13    },
+	{ 5,  0x25    },
+	{ 6,  0x43    },
+	{ 7,  0x89    },
+	{ 8,  0x11d   },
+	{ 8,  0x187   },
+	{ 9,  0x211   },
+	{ 10, 0x409   },
+	{ 11, 0x805   },
+	{ 16, 0x1100b },
+};
+
+#define NFIELDS (int) (sizeof(Fields) / sizeof(Fields[0]))
+
+static void print_array(const char *type, const char *name, int mm,
+			int gfpoly, const uint16_t *v, int n)
+{
+	printf("static const %s %s_%d_%x[] = {", type, name, mm, gfpoly);
+	for (int i = 0; i < n; i++)
+		printf("%s%u,", i % 12 ? " " : "\n\t", v[i]);
+	printf("\n};\n\n");
+}
+
+int main(void)
+{
+	printf("/* Generated by gen_tables, do not edit */\n\n");
+	printf("#include \"internal.h\"\n\n");
+
+	for (int f = 0; f < NFIELDS; f++) {
+		int mm = Fields[f].mm;
+		int gfpoly = Fields[f].gfpoly;
+		int nn = (1 << mm) - 1;
+		uint16_t *tab = malloc(sizeof(*tab) * FIELD_TAB_LEN(nn));
+
+		if (!tab || rs_field_init(mm, gfpoly, tab)) {
+			fprintf(stderr, "gen_tables: cannot build the tables "
+				"of (%d, 0x%x)\n", mm, gfpoly);
+			free(tab);
+			return 1;
+		}
+
+		print_array("uint16_t", "field", mm, gfpoly, tab,
+			    FIELD_TAB_LEN(nn));
+
+		/* alpha_to and index_of, without the roots of y^2 + y */
+		if (mm <= 8) {
+			print_array("uint8_t", "field8", mm, gfpoly, tab,
+				    ALPHA_TO_LEN(nn) + nn + 1);
+		}
+
+		free(tab);
+	}
+
+	printf("const struct rs_field rs_fields[] = {\n");
+	for (int f = 0; f < NFIELDS; f++) {
+		int mm = Fields[f].mm;
+		int gfpoly = Fields[f].gfpoly;
+
+		printf("\t{ %d, 0x%x, field_%d_%x, ", mm, gfpoly, mm, gfpoly);
+		if (mm <= 8)
+			printf("field8_%d_%x },\n", mm, gfpoly);
+		else
+			printf("NULL },\n");
+	}
+	printf("};\n\n");
+	printf("const int rs_nfields = %d;\n", NFIELDS);
+
+	return 0;
+}
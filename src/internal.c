@@ -24,6 +24,8 @@
 #include "internal.h"
 #include "list.h"
 #include <pthread.h>
+#include <string.h>
+#include <stdatomic.h>
 
 struct lookup_table {
 	int users;
@@ -31,12 +33,15 @@ struct lookup_table {
 	int gfpoly;
 	uint16_t *alpha_to;
 	uint16_t *index_of;
+	uint16_t *quad;
+	uint8_t *alpha_to8;
+	uint8_t *index_of8;
 };
 
 pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
 
 static LIST _lookup_tables = { NULL, NULL };
-static LIST _codes = { NULL, NULL };
+static _Atomic size_t _table_limit = RS_DEFAULT_TABLE_LIMIT;
 
 static struct lookup_table *init_lookup(int mm, int gfpoly)
 {
@@ -46,31 +51,31 @@ static struct lookup_table *init_lookup(int mm, int gfpoly)
 	if (!tab)
 		return NULL;
 
-	tab->alpha_to = malloc(sizeof(*tab->alpha_to) * 2 * (nn + 1));
+	int alen = ALPHA_TO_LEN(nn);
+	tab->alpha_to = malloc(sizeof(*tab->alpha_to) * FIELD_TAB_LEN(nn));
 	if (!tab->alpha_to)
 		goto err;
 
 	tab->users = 1;
 	tab->mm = mm;
 	tab->gfpoly = gfpoly;
-	tab->index_of = tab->alpha_to + (nn + 1);
-
-	/* Generate Galois field lookup tables */
-	tab->index_of[0] = nn;  /* log(zero) = -inf */
-	tab->alpha_to[nn] = 0;  /* alpha**-inf = 0 */
-	int sr = 1;
-
-	for (int i = 0; i < nn; i++) {
-		tab->index_of[sr] = i;
-		tab->alpha_to[i] = sr;
-		sr <<= 1;
-		if (sr & (1 << mm))
-			sr ^= gfpoly;
-		sr &= nn;
-	}
-	if (sr != 1) {
-		/* field generator polynomial is not primitive! */
+	tab->index_of = tab->alpha_to + alen;
+	tab->quad = tab->index_of + nn + 1;
+
+	if (rs_field_init(mm, gfpoly, tab->alpha_to))
 		goto err;
+
+	if (mm <= 8) {
+		/* Byte sized copies of the tables for the 8-bit interface */
+		tab->alpha_to8 = malloc(sizeof(*tab->alpha_to8) * (alen + nn + 1));
+		if (!tab->alpha_to8)
+			goto err;
+
+		tab->index_of8 = tab->alpha_to8 + alen;
+		for (int i = 0; i < alen; i++)
+			tab->alpha_to8[i] = tab->alpha_to[i];
+		for (int i = 0; i <= nn; i++)
+			tab->index_of8[i] = tab->index_of[i];
 	}
 
 	return tab;
@@ -83,6 +88,7 @@ err:
 
 static void free_lookup_table(struct lookup_table *tab)
 {
+	free(tab->alpha_to8);
 	free(tab->alpha_to);
 	free(tab);
 }
@@ -135,73 +141,206 @@ static void free_lookup(uint16_t *alpha_to)
 	}
 }
 
+/*
+ * Points rs to the precomputed tables of its field, if there are any. They are
+ * read-only and never freed; free_lookup does not find them in the list.
+ */
+static int find_field(struct rs_code *rs, int mm, int gfpoly)
+{
+#ifndef RS_NO_FIELD_TABLES
+	int nn = (1 << mm) - 1;
+
+	for (int i = 0; i < rs_nfields; i++) {
+		const struct rs_field *f = rs_fields + i;
+		if (f->mm != mm || f->gfpoly != gfpoly)
+			continue;
+
+		rs->alpha_to = (uint16_t *) f->tab;
+		rs->index_of = rs->alpha_to + ALPHA_TO_LEN(nn);
+		rs->quad = rs->index_of + nn + 1;
+		if (f->tab8) {
+			rs->alpha_to8 = (uint8_t *) f->tab8;
+			rs->index_of8 = rs->alpha_to8 + ALPHA_TO_LEN(nn);
+		}
+		return 1;
+	}
+#else
+	(void) rs; (void) mm; (void) gfpoly;
+#endif
+
+	return 0;
+}
+
+static uint16_t gf_mul(struct rs_code *rs, int a, uint16_t b_log)
+{
+	if (a == 0 || b_log == rs->nn)
+		return 0;
+
+	return rs->alpha_to[rs->index_of[a] + b_log];
+}
+
+/*
+ * Builds the generator product rows for the scalar encoder. Row v holds
+ * v * g_k for the low byte of the feedback, and row 256 + v holds
+ * (v << 8) * g_k for the high bits, for every generator coefficient g_k in
+ * the order they are added to the parity register. The rows are only built if
+ * they fit in limit bytes.
+ */
+static int init_enc_rows(struct rs_code *rs, size_t limit)
+{
+	int nroots = rs->nroots;
+	int nn = rs->nn;
+	uint16_t *gp = rs->genpoly;
+
+	if (rs->enc_simd || nroots == 0)
+		return 0;
+
+	int nhi = 1 << (rs->mm > 8 ? rs->mm - 8 : 0);
+	size_t size = sizeof(*rs->enc_rows) * (256 + nhi) * nroots;
+	if (size > limit)
+		return 0;
+
+	rs->enc_rows = malloc(size);
+	if (!rs->enc_rows)
+		return -1;
+
+	/*
+	 * Only the rows of single bits are multiplied out, the others are sums
+	 * of two earlier rows
+	 */
+	for (int v = 0; v < 256 + nhi; v++) {
+		uint16_t *row = rs->enc_rows + v * nroots;
+		int base = v < 256 ? 0 : 256;
+		int x = v - base;
+		int low = x & -x;
+		int shift = base ? 8 : 0;
+
+		if (x == 0 || (x << shift) > nn) {
+			memset(row, 0, nroots * sizeof(*row));
+		} else if (x == low) {
+			for (int k = 0; k < nroots; k++)
+				row[k] = gf_mul(rs, x << shift,
+						gp[nroots - 1 - k]);
+		} else {
+			const uint16_t *a = rs->enc_rows + (base + low) * nroots;
+			const uint16_t *b = rs->enc_rows + (v - low) * nroots;
+			for (int k = 0; k < nroots; k++)
+				row[k] = a[k] ^ b[k];
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Forms the generator polynomial g(x) = prod_i (x + r * q^i), i < nroots, with
+ * r = alpha^(fcr * prim) and q = alpha^prim, in index form. By the q-binomial
+ * theorem the coefficient of x^(nroots - k) is r^k * q^(k(k-1)/2) times the
+ * Gaussian binomial coefficient [nroots, k]_q, and
+ * [n, k + 1]_q = [n, k]_q * (1 + q^(n - k)) / (1 + q^(k + 1)),
+ * so the coefficients take O(nroots) field operations. The denominators are
+ * non-zero as q has order nn > nroots.
+ */
+static void init_genpoly(struct rs_code *rs)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int lq = rs->prim % nn;
+	int lr = ((long long) rs->fcr * rs->prim) % nn;
+
+	for (int i = 0, root = lr; i < nroots; i++, root = subnn(rs, root + lq))
+		rs->rootlog[i] = root;
+
+	/* e1 and e2 are the logs of q^(n - k) and q^(k + 1) */
+	int e1 = ((long long) nroots * lq) % nn;
+	int e2 = lq;
+	int rk = 0;     /* log r^k */
+	int qk = 0;     /* log q^k */
+	int tri = 0;    /* log q^(k(k-1)/2) */
+	int binom = 0;  /* log [n, k]_q */
+
+	for (int k = 0; k <= nroots; k++) {
+		rs->genpoly[nroots - k] = subnn(rs, subnn(rs, rk + tri) + binom);
+		if (k == nroots)
+			break;
+
+		int num = index_of[alpha_to[e1] ^ 1];
+		int den = index_of[alpha_to[e2] ^ 1];
+		binom = subnn(rs, binom + num);
+		binom = subnn(rs, binom + nn - den);
+
+		rk = subnn(rs, rk + lr);
+		tri = subnn(rs, tri + qk);
+		qk = subnn(rs, qk + lq);
+		e1 = subnn(rs, e1 + nn - lq);
+		e2 = subnn(rs, e2 + lq);
+	}
+}
+
 /* Initialize a Reed-Solomon codec
  * symsize = symbol size, bits
  * gfpoly = Field generator polynomial coefficients
  * fcr = first root of RS code generator polynomial, index form
  * prim = primitive element to generate polynomial roots
  * nroots = RS code generator polynomial degree (number of roots)
+ * limit = maximum size of the encoder and syndrome tables
  */
-static struct rs_code *init_code(int symsize, int gfpoly,
-				 int fcr, int prim, int nroots)
+static struct rs_code *init_code(int symsize, int gfpoly, int fcr, int prim,
+				 int nroots, size_t limit)
 {
-	struct rs_code *rs = calloc(1, sizeof(*rs));
-	if (!rs)
+	struct rs_code_priv *priv = calloc(1, sizeof(*priv));
+	if (!priv)
 		return NULL;
 
-	rs->genpoly = malloc(sizeof(*rs->genpoly) * (nroots + 1));
+	struct rs_code *rs = &priv->rs;
+
+	/* The roots of the generator polynomial are stored after it */
+	rs->genpoly = malloc(sizeof(*rs->genpoly) * (2 * nroots + 1));
 	if (!rs->genpoly)
 		goto err;
 
-	struct lookup_table *tab = get_lookup(symsize, gfpoly);
-	if (!tab)
-		goto err;
+	rs->rootlog = rs->genpoly + nroots + 1;
+
+	if (!find_field(rs, symsize, gfpoly)) {
+		struct lookup_table *tab = get_lookup(symsize, gfpoly);
+		if (!tab)
+			goto err;
+
+		rs->alpha_to = tab->alpha_to;
+		rs->index_of = tab->index_of;
+		rs->quad = tab->quad;
+		rs->alpha_to8 = tab->alpha_to8;
+		rs->index_of8 = tab->index_of8;
+	}
 
-	rs->alpha_to = tab->alpha_to;
-	rs->index_of = tab->index_of;
 	rs->mm = symsize;
 	rs->nn = (1 << symsize) - 1;
 	rs->nroots = nroots;
 	rs->fcr = fcr;
 	rs->prim = prim;
 	rs->gfpoly = gfpoly;
-	rs->users = 1;
 
-	/*
-	 * Form RS code generator polynomial from its roots
-	 * Find prim-th root of 1, used in decoding
-	 */
-	uint16_t tmp;
+	/* Find prim-th root of 1, used in decoding */
 	int iprim;
 	for (iprim = 1; (iprim % prim) != 0; iprim += rs->nn)
 		;
 	rs->iprim = iprim / prim;
 
-	rs->genpoly[0] = 1;
-	for (int i = 0, root = fcr * prim; i < nroots; i++, root += prim) {
-		rs->genpoly[i + 1] = 1;
-
-		/* Multiply rs->genpoly[] by  @**(root + x) */
-		for (int j = i; j > 0; j--) {
-			if (rs->genpoly[j] != 0) {
-				tmp = rs->index_of[rs->genpoly[j]] + root;
-				tmp = rs->alpha_to[modnn(rs, tmp)];
-				rs->genpoly[j] = rs->genpoly[j - 1] ^ tmp;
-			} else {
-				rs->genpoly[j] = rs->genpoly[j - 1];
-			}
-		}
+	init_genpoly(rs);
 
-		/* rs->genpoly[0] can never be zero */
-		tmp = rs->index_of[rs->genpoly[0]] + root;
-		rs->genpoly[0] = rs->alpha_to[modnn(rs, tmp)];
-	}
-	/* convert rs->genpoly[] to index form for quicker encoding */
-	for (int i = 0; i <= nroots; i++)
-		rs->genpoly[i] = rs->index_of[rs->genpoly[i]];
+	if (rs_encode_simd_init(rs) || init_enc_rows(rs, limit)
+	    || rs_syndrome_simd_init(rs, limit))
+		goto err_lookup;
 
 	return rs;
 
+err_lookup:
+	free(rs->syn_tab);
+	free(rs->enc_rows);
+	free(rs->enc_tab);
+	free_lookup(rs->alpha_to);
 err:
 	free(rs->genpoly);
 	free(rs);
@@ -211,46 +350,211 @@ err:
 static void free_code(struct rs_code *rs)
 {
 	free_lookup(rs->alpha_to);
+	free(rs->enc_tab);
+	free(rs->enc_rows);
+	free(rs->syn_tab);
+	free(code_priv(rs)->counters);
+	free(atomic_load_explicit(&code_priv(rs)->pos_tab,
+				  memory_order_relaxed));
 	free(rs->genpoly);
 	free(rs);
 }
 
+/*
+ * Code cache. Codes are kept in a hash table keyed by their parameters, and
+ * looking up a code that is already in it takes no lock: the readers walk the
+ * bucket lists with atomic loads and take a reference with a compare and swap
+ * that fails once the count has dropped to zero. Inserting and removing codes
+ * is serialized by _lock.
+ *
+ * The table limit a code was created with is part of the key, so a lower limit
+ * gives a code with smaller tables even if the same code is in use with a
+ * higher one. The hash leaves it out, so rs_free finds the bucket without it.
+ *
+ * An entry that is removed can still be in use by readers walking its bucket,
+ * so it is retired instead of freed. Readers announce themselves in the
+ * counter of the current epoch. An entry retired in epoch e is freed once the
+ * epoch has moved on and the readers of epoch e are gone. The epoch moves on
+ * whenever the readers of the previous epoch are gone, so a steady stream of
+ * readers does not hold back the reclamation.
+ */
+#define CACHE_BUCKETS 64
+
+struct code_entry {
+	struct code_entry *_Atomic next;
+	struct code_entry *retired_next;
+	struct rs_code *rs;
+	atomic_int users;
+	/* The key, read by the lookups without a reference */
+	int symsize;
+	int gfpoly;
+	int fcr;
+	int prim;
+	int nroots;
+	size_t limit;
+};
+
+static struct code_entry *_Atomic _buckets[CACHE_BUCKETS];
+static atomic_uint _epoch;
+static struct {
+	_Alignas(64) atomic_int n;
+} _readers[2];
+
+/* Entries retired in the previous and the current epoch, under _lock */
+static struct code_entry *_retired[2];
+
+static unsigned code_hash(int symsize, int gfpoly, int fcr, int prim,
+			  int nroots)
+{
+	unsigned h = symsize;
+	h = h * 31 + gfpoly;
+	h = h * 31 + fcr;
+	h = h * 31 + prim;
+	h = h * 31 + nroots;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h % CACHE_BUCKETS;
+}
+
+/* Returns the epoch slot to pass to read_unlock */
+static int read_lock(void)
+{
+	for (;;) {
+		unsigned e = atomic_load(&_epoch);
+		atomic_fetch_add(&_readers[e & 1].n, 1);
+		if (atomic_load(&_epoch) == e)
+			return e & 1;
+		atomic_fetch_sub(&_readers[e & 1].n, 1);
+	}
+}
+
+static void read_unlock(int slot)
+{
+	atomic_fetch_sub_explicit(&_readers[slot].n, 1, memory_order_release);
+}
+
+/* Takes a reference, unless the code is already on its way out */
+static int get_entry(struct code_entry *entry)
+{
+	int users = atomic_load_explicit(&entry->users, memory_order_relaxed);
+	while (users > 0) {
+		if (atomic_compare_exchange_weak(&entry->users, &users,
+						 users + 1))
+			return 1;
+	}
+
+	return 0;
+}
+
+static struct rs_code *find_code(unsigned h, int symsize, int gfpoly, int fcr,
+				 int prim, int nroots, size_t limit)
+{
+	struct code_entry *entry = atomic_load_explicit(_buckets + h,
+							memory_order_acquire);
+	while (entry) {
+		if (entry->symsize == symsize && entry->gfpoly == gfpoly
+		    && entry->fcr == fcr && entry->prim == prim
+		    && entry->nroots == nroots && entry->limit == limit
+		    && get_entry(entry))
+			return entry->rs;
+
+		entry = atomic_load_explicit(&entry->next,
+					     memory_order_acquire);
+	}
+
+	return NULL;
+}
+
+static void free_retired(int slot)
+{
+	struct code_entry *old = _retired[slot];
+
+	while (old) {
+		struct code_entry *next = old->retired_next;
+		free(old);
+		old = next;
+	}
+
+	_retired[slot] = NULL;
+}
+
+/* Retires an entry that has been unlinked, under _lock */
+static void retire_entry(struct code_entry *entry)
+{
+	unsigned e = atomic_load(&_epoch);
+
+	entry->retired_next = _retired[e & 1];
+	_retired[e & 1] = entry;
+
+	/* Free the previous epoch's entries and move on if its readers are gone */
+	if (atomic_load(&_readers[(e - 1) & 1].n) == 0) {
+		free_retired((e - 1) & 1);
+		atomic_store(&_epoch, e + 1);
+	}
+}
+
+/* The last retired entries wait for a later rs_free, so free them at exit */
+__attribute__((destructor))
+static void cache_exit(void)
+{
+	pthread_mutex_lock(&_lock);
+	free_retired(0);
+	free_retired(1);
+	pthread_mutex_unlock(&_lock);
+}
+
 struct rs_code *rs_init_internal(int symsize, int gfpoly,
 				 int fcr, int prim, int nroots)
 {
-	struct rs_code *rs;
-	pthread_mutex_lock(&_lock);
+	unsigned h = code_hash(symsize, gfpoly, fcr, prim, nroots);
+	size_t limit = atomic_load_explicit(&_table_limit, memory_order_relaxed);
 
-	/* Check if we already have a code with the right parameters */
-	LIST_NODE *node = LIST_first(&_codes);
-	while (node) {
-		rs = (struct rs_code *) node->data;
-		if (rs->mm == symsize && rs->gfpoly == gfpoly
-		    && rs->fcr == fcr && rs->prim == prim
-		    && rs->nroots == nroots) {
-			rs->users++;
-			goto exit;
-		}
+	int slot = read_lock();
+	struct rs_code *rs = find_code(h, symsize, gfpoly, fcr, prim, nroots,
+				       limit);
+	read_unlock(slot);
+	if (rs)
+		return rs;
 
-		node = LIST_next(node);
-	}
+	pthread_mutex_lock(&_lock);
+
+	/*
+	 * Check again, another thread may have created the code meanwhile.
+	 * Entries are only freed under the lock.
+	 */
+	rs = find_code(h, symsize, gfpoly, fcr, prim, nroots, limit);
+	if (rs)
+		goto exit;
 
 	/* Create a new code */
-	rs = init_code(symsize, gfpoly, fcr, prim, nroots);
-	if (!rs)
-		goto err;
+	struct code_entry *entry = malloc(sizeof(*entry));
+	if (!entry)
+		goto exit;
+
+	rs = init_code(symsize, gfpoly, fcr, prim, nroots, limit);
+	if (!rs) {
+		free(entry);
+		goto exit;
+	}
 
-	if (!LIST_push_front(&_codes, rs))
-		goto err;
+	*entry = (struct code_entry) {
+		.rs = rs,
+		.symsize = symsize,
+		.gfpoly = gfpoly,
+		.fcr = fcr,
+		.prim = prim,
+		.nroots = nroots,
+		.limit = limit,
+	};
+	atomic_init(&entry->users, 1);
+	atomic_init(&entry->next, atomic_load_explicit(_buckets + h,
+						       memory_order_relaxed));
+	atomic_store_explicit(_buckets + h, entry, memory_order_release);
 
 exit:
 	pthread_mutex_unlock(&_lock);
 	return rs;
-
-err:
-	pthread_mutex_unlock(&_lock);
-	free_code(rs);
-	return NULL;
 }
 
 void rs_free_internal(struct rs_code *rs)
@@ -258,22 +562,122 @@ void rs_free_internal(struct rs_code *rs)
 	if (!rs)
 		return;
 
-	pthread_mutex_lock(&_lock);
+	unsigned h = code_hash(rs->mm, rs->gfpoly, rs->fcr, rs->prim,
+			       rs->nroots);
 
-	/* Find the correct code from the list */
-	LIST_NODE *node = LIST_first(&_codes);
-	while (node) {
-		struct rs_code *code = (struct rs_code *) node->data;
-		if (code == rs) {
-			if (--code->users == 0) {
-				free_code(code);
-				LIST_remove(&_codes, node, 1);
-			}
-			break;
-		}
+	int slot = read_lock();
+	struct code_entry *entry = atomic_load_explicit(_buckets + h,
+							memory_order_acquire);
+	while (entry && entry->rs != rs)
+		entry = atomic_load_explicit(&entry->next,
+					     memory_order_acquire);
 
-		node = LIST_next(node);
+	if (!entry || atomic_fetch_sub(&entry->users, 1) != 1) {
+		read_unlock(slot);
+		return;
 	}
+	read_unlock(slot);
+
+	/* Last user, nobody can take a new reference; unlink the entry */
+	pthread_mutex_lock(&_lock);
+
+	struct code_entry *_Atomic *link = _buckets + h;
+	while (atomic_load_explicit(link, memory_order_relaxed) != entry)
+		link = &atomic_load_explicit(link, memory_order_relaxed)->next;
+
+	atomic_store_explicit(link, atomic_load_explicit(&entry->next,
+							 memory_order_relaxed),
+			      memory_order_release);
+	retire_entry(entry);
+	free_code(rs);
 
 	pthread_mutex_unlock(&_lock);
 }
+
+void rs_set_table_limit_internal(size_t bytes)
+{
+	atomic_store_explicit(&_table_limit, bytes, memory_order_relaxed);
+}
+
+/*
+ * The counters are allocated the first time they are turned on, and kept
+ * until the code is freed, as decoders running concurrently may still be
+ * adding to them after they are turned off.
+ */
+int rs_set_stats_internal(struct rs_code *rs, int enable)
+{
+	struct rs_code_priv *priv = code_priv(rs);
+	int ret = 0;
+
+	pthread_mutex_lock(&_pos_lock);
+	if (enable && !priv->counters)
+		priv->counters = calloc(1, sizeof(*priv->counters)
+					+ sizeof(*priv->counters->hist)
+					  * (rs->nroots + 1));
+
+	if (enable && !priv->counters)
+		ret = -1;
+	else
+		atomic_store_explicit(&priv->stats,
+				      enable ? priv->counters : NULL,
+				      memory_order_release);
+	pthread_mutex_unlock(&_pos_lock);
+
+	return ret;
+}
+
+int rs_get_stats_internal(struct rs_code *rs, struct rs_stats *stats,
+			  uint64_t *hist)
+{
+	struct rs_counters *c;
+
+	pthread_mutex_lock(&_pos_lock);
+	c = code_priv(rs)->counters;
+	pthread_mutex_unlock(&_pos_lock);
+
+	if (!c)
+		return -1;
+
+	memset(stats, 0, sizeof(*stats));
+	for (int i = 0; i < RS_NUM_ERRORS; i++) {
+		stats->failures[i] = atomic_load_explicit(c->failures + i,
+							  memory_order_relaxed);
+		stats->failed += stats->failures[i];
+	}
+
+	for (int i = 0; i < RS_NUM_STAGES; i++)
+		stats->cycles[i] = atomic_load_explicit(c->cycles + i,
+							memory_order_relaxed);
+
+	for (int k = 0; k <= rs->nroots; k++) {
+		uint64_t n = atomic_load_explicit(c->hist + k,
+						  memory_order_relaxed);
+		stats->decoded += n;
+		stats->corrected += k * n;
+		if (hist)
+			hist[k] = n;
+	}
+
+	stats->clean = atomic_load_explicit(c->hist, memory_order_relaxed);
+	stats->decoded += stats->failed;
+	return 0;
+}
+
+void rs_reset_stats_internal(struct rs_code *rs)
+{
+	struct rs_counters *c;
+
+	pthread_mutex_lock(&_pos_lock);
+	c = code_priv(rs)->counters;
+	pthread_mutex_unlock(&_pos_lock);
+
+	if (!c)
+		return;
+
+	for (int i = 0; i < RS_NUM_ERRORS; i++)
+		atomic_store_explicit(c->failures + i, 0, memory_order_relaxed);
+	for (int i = 0; i < RS_NUM_STAGES; i++)
+		atomic_store_explicit(c->cycles + i, 0, memory_order_relaxed);
+	for (int k = 0; k <= rs->nroots; k++)
+		atomic_store_explicit(c->hist + k, 0, memory_order_relaxed);
+}
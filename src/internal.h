@@ -24,14 +24,389 @@
 #ifndef FB_LIBRS_INTERNAL_H
 #define FB_LIBRS_INTERNAL_H
 
+#include <pthread.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include "librs.h"
 
+#if !defined(RS_NO_SIMD) && defined(__GNUC__) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define RS_HAVE_X86_SIMD 1
+#endif
+
+/*
+ * The memory of a code. Tables that are built after rs_init are published
+ * through atomic pointers, as the code is shared between threads.
+ */
+struct rs_code_priv {
+	struct rs_code rs;
+	uint16_t *_Atomic pos_tab;      /* See rs_update_parity_cache */
+	_Atomic int bm;                 /* See rs_set_bm */
+	struct rs_counters *_Atomic stats; /* See rs_set_stats, NULL if off */
+	struct rs_counters *counters;   /* Kept when stats is turned off */
+};
+
+/* Serializes the building of the tables and counters published above */
+extern pthread_mutex_t _pos_lock;
+
+static inline struct rs_code_priv *code_priv(struct rs_code *rs)
+{
+	return (struct rs_code_priv *) rs;
+}
+
 struct rs_code *rs_init_internal(int symsize, int gfpoly,
 				 int fcr, int prim, int nroots);
 
 void rs_free_internal(struct rs_code *rs);
 
+void rs_set_table_limit_internal(size_t bytes);
+
+int rs_set_stats_internal(struct rs_code *rs, int enable);
+int rs_get_stats_internal(struct rs_code *rs, struct rs_stats *stats,
+			  uint64_t *hist);
+void rs_reset_stats_internal(struct rs_code *rs);
+
+/*
+ * Decode counters of a code. hist[k] counts the words decoded with k
+ * corrected symbols, and failures[-1 - ret] the words where the decoder
+ * returned ret < 0. The totals of struct rs_stats are derived from these, so
+ * a decode takes a single atomic add.
+ */
+struct rs_counters {
+	_Atomic uint64_t failures[RS_NUM_ERRORS];
+	_Atomic uint64_t cycles[RS_NUM_STAGES];
+	_Atomic uint64_t hist[];
+};
+
+static inline struct rs_counters *rs_counters(struct rs_code *rs)
+{
+	return atomic_load_explicit(&code_priv(rs)->stats,
+				    memory_order_acquire);
+}
+
+/* Counts n decodes that returned ret, and returns ret */
+static inline int rs_count(struct rs_code *rs, int ret, int n)
+{
+	struct rs_counters *c = rs_counters(rs);
+
+	if (c) {
+		_Atomic uint64_t *p = ret >= 0 ? c->hist + ret
+					       : c->failures + (-1 - ret);
+		atomic_fetch_add_explicit(p, n, memory_order_relaxed);
+	}
+
+	return ret;
+}
+
+/*
+ * Tracepoints and stage timing of the decoder, both compiled out by default.
+ * RS_PROBE(name, args...) is the USDT probe librs:name if built with
+ * --enable-probes. If built with --enable-stage-timing, RS_TIMER(t) starts a
+ * timer, and RS_STAGE(rs, t, stage) adds the cycles since t was started or
+ * last stopped to the counters of rs, if it has any, and restarts t.
+ */
+#ifdef RS_PROBES
+#include <sys/sdt.h>
+#define RS_PROBE(...) STAP_PROBEV(librs, __VA_ARGS__)
+#else
+#define RS_PROBE(...) do { } while (0)
+#endif
+
+#ifdef RS_STAGE_TIMING
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline uint64_t rs_cycles(void)
+{
+	return __rdtsc();
+}
+#else
+#include <time.h>
+
+/* Nanoseconds where there is no cycle counter */
+static inline uint64_t rs_cycles(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (uint64_t) 1000000000 + ts.tv_nsec;
+}
+#endif
+
+static inline void rs_stage_end(struct rs_code *rs, uint64_t *t,
+				enum rs_stage stage)
+{
+	struct rs_counters *c = rs_counters(rs);
+	uint64_t now = rs_cycles();
+
+	if (c)
+		atomic_fetch_add_explicit(c->cycles + stage, now - *t,
+					  memory_order_relaxed);
+	*t = now;
+}
+
+#define RS_TIMER(t) uint64_t t = rs_cycles()
+#define RS_STAGE(rs, t, stage) rs_stage_end(rs, &(t), stage)
+#else
+#define RS_TIMER(t) do { } while (0)
+#define RS_STAGE(rs, t, stage) do { } while (0)
+#endif
+
+struct rs_pool *rs_pool_create_internal(int nthreads);
+void rs_pool_destroy_internal(struct rs_pool *pool);
+
+/*
+ * Runs fn(arg, thread, begin, end) over chunks of at most grain items that
+ * cover [0, n), on all threads of the pool. The calling thread takes part, and
+ * the call returns when every chunk is done. A NULL pool runs fn on the
+ * caller. thread is the index of the thread that runs the chunk, in
+ * [0, rs_pool_threads(pool)), so fn can keep scratch per thread.
+ */
+int rs_pool_threads(struct rs_pool *pool);
+void rs_pool_run(struct rs_pool *pool,
+		 void (*fn)(void *arg, int thread, int begin, int end),
+		 void *arg, int n, int grain);
+
+/* The symbols are uint16_t if wide is non-zero and uint8_t otherwise */
+void rs_pool_encode_batch_internal(struct rs_pool *pool, struct rs_code *rs,
+				   void **data, int n, int len, int stride,
+				   int wide);
+int rs_pool_decode_batch_internal(struct rs_pool *pool, struct rs_code *rs,
+				  void **data, int n, int len, int stride,
+				  int *status, int wide);
+
+/* The symbols are uint16_t if wide is non-zero and uint8_t otherwise */
+int rs_update_parity_internal(struct rs_code *rs, void *par, int len,
+			      const int *pos, const void *old_sym,
+			      const void *new_sym, int n, int wide);
+int rs_update_parity_cache_internal(struct rs_code *rs);
+
+struct rs_channel *rs_channel_create_internal(struct rs_code *rs,
+					      const struct rs_channel_params *p,
+					      uint64_t seed);
+void rs_channel_destroy_internal(struct rs_channel *ch);
+/* The symbols are uint16_t if wide is non-zero and uint8_t otherwise */
+int rs_channel_apply_internal(struct rs_channel *ch, void **data, int n,
+			      int len, int stride, int *eras, int *no_eras,
+			      int wide);
+/* Restarts the channel on stream of seed, as if it had just been created */
+void rs_channel_seed_internal(struct rs_channel *ch, uint64_t seed,
+			      uint64_t stream);
+/* Sets the weights of an RS_CHANNEL_FIXED channel */
+void rs_channel_weight_internal(struct rs_channel *ch, int errors,
+				int erasures);
+/* The positions of the last word of an RS_CHANNEL_FIXED channel, the
+ * erasures first */
+const int *rs_channel_positions_internal(struct rs_channel *ch);
+
+int rs_sim_run_internal(struct rs_pool *pool, struct rs_code *rs,
+			const struct rs_sim_params *p,
+			struct rs_sim_result *res);
+
+struct rs_stream *rs_stream_create_internal(struct rs_code *rs, int len,
+					    int depth);
+void rs_stream_destroy_internal(struct rs_stream *st);
+size_t rs_stream_frame_len_internal(struct rs_stream *st);
+size_t rs_stream_payload_len_internal(struct rs_stream *st);
+size_t rs_stream_encoder_push_internal(struct rs_stream *st,
+				       const uint8_t *buf, size_t n,
+				       uint8_t *out);
+size_t rs_stream_encoder_flush_internal(struct rs_stream *st, uint8_t *out);
+size_t rs_stream_decoder_push_internal(struct rs_stream *st,
+				       const uint8_t *buf, size_t n,
+				       uint8_t *out, int *status);
+
+/* Instruction set levels of the vectorized kernels */
+enum rs_simd {
+	RS_SIMD_NONE,
+	RS_SIMD_SSSE3,
+	RS_SIMD_AVX2,
+};
+
+/* Returns the best instruction set level supported by the CPU, which is
+ * detected once when the library is loaded */
+int rs_simd_level(void);
+
+/* Sets up the vectorized encoder for rs if the code and the CPU support it.
+ * Returns non-zero on allocation failure. */
+int rs_encode_simd_init(struct rs_code *rs);
+
+/* Sets up the vectorized syndrome kernel for rs if the code and the CPU
+ * support it and the tables fit in limit bytes. Returns non-zero on allocation
+ * failure. */
+int rs_syndrome_simd_init(struct rs_code *rs, size_t limit);
+
+/*
+ * Computes the syndrome s of the received word data of length len. The symbols
+ * are uint16_t if wide is non-zero and uint8_t otherwise. Returns zero without
+ * touching s if the vectorized kernel cannot be used. scratch holds
+ * SYNDROME_SCRATCH_LEN(nroots) bytes, or is NULL to use a fixed 4 KiB buffer
+ * on the stack, which takes the roots in groups.
+ */
+int rs_syndrome_simd(struct rs_code *rs, uint16_t *s, const void *data,
+		     int len, int stride, int wide, uint8_t *scratch);
+
+#define SYNDROME_SCRATCH_LEN(nroots) (64 * (nroots))
+
+/*
+ * Chien search over the positions pad..nn-1 of the codeword, see chien() in
+ * reed_solomon.c. lambda is in index form. Returns the number of roots found,
+ * or a negative number if the vectorized search cannot be used. scratch holds
+ * CHIEN_SCRATCH_LEN bytes, or is NULL to use at most 4 KiB of stack, which
+ * leaves the larger locators to the scalar search.
+ */
+int rs_chien_simd(struct rs_code *rs, const uint16_t *lambda, int deg,
+		  int pad, uint16_t *root, uint16_t *loc, uint8_t *scratch);
+
+/*
+ * Inversionless Berlekamp-Massey algorithm, see bm_inversionless() in
+ * reed_solomon.c, from the syndrome s in poly form. lambda is in poly form and
+ * has nroots + 1 entries. Returns a negative number if the vectorized kernel
+ * cannot be used.
+ */
+int rs_bm_simd(struct rs_code *rs, uint16_t *lambda, const uint16_t *s,
+	       int no_eras);
+
+/* Larger locators are left to the scalar search */
+#define CHIEN_MAX_TERMS 64
+#define CHIEN_SCRATCH_LEN (CHIEN_MAX_TERMS * (256 + 64))
+
+/*
+ * Batch encoders. The symbols are uint16_t if wide is non-zero and uint8_t
+ * otherwise. Both return the number of codewords encoded, which is zero if
+ * the vectorized encoder is not available, and the caller encodes the rest.
+ *
+ * rs_encode_simd_multi encodes the codewords data[0..n-1], each with the given
+ * stride, and stores the parity of codeword c in par[c] with stride pstride.
+ * rs_encode_simd_soa encodes n codewords stored side by side, with message
+ * symbol i of codeword c at data[i * n + c] and parity symbol k at
+ * par[k * n + c].
+ */
+int rs_encode_simd_multi(struct rs_code *rs, const void *const *data,
+			 void *const *par, int n, int dlen, int stride,
+			 int pstride, int wide);
+int rs_encode_simd_soa(struct rs_code *rs, void *data, void *par, int n,
+		       int dlen, int wide);
+
+/*
+ * Same as rs_encode_soa or rs_encode8_soa, with the parity of the n codewords
+ * stored side by side at par instead of after the message symbols.
+ */
+void rs_encode_soa_internal(struct rs_code *rs, void *data, void *par, int n,
+			    int dlen, int wide);
+
+/*
+ * Scratch memory of the decoder. rs_decode keeps it on the stack, and an
+ * rs_decoder in memory allocated up front. The uint16_t arrays have room for
+ * nroots + 1 entries. syn and chien are the scratch of the vectorized
+ * kernels, or NULL if they use the stack.
+ */
+struct rs_work {
+	uint16_t *s;            /* Syndrome */
+	uint16_t *si;           /* Syndrome, index form */
+	uint16_t *root;         /* Roots of lambda, index form */
+	uint16_t *loc;          /* Error locations */
+	uint16_t *cor;          /* Error values, index form */
+	uint16_t *lambda;       /* Error and erasure locator poly */
+	uint16_t *omega;        /* Error and erasure evaluator poly */
+	uint16_t *b;
+	uint16_t *t;
+	uint8_t *syn;
+	uint8_t *chien;
+};
+
+/* Number of uint16_t arrays in struct rs_work */
+#define WORK_ARRAYS 9
+
+/* Rounds x up to the 32 byte boundary of the context arrays */
+#undef ALIGN
+#define ALIGN(x) (((x) + 31) & ~(size_t) 31)
+
+struct rs_decoder {
+	struct rs_code *rs;
+	struct rs_work work;
+	void *mem;
+	struct rs_eras_cache *eras;     /* Erasure patterns, see erasure.c */
+	struct rs_eras_work *eras_work; /* Allocated with the patterns */
+};
+
+/* A set of erasures for the words of one length, see erasure.c */
+struct rs_eras {
+	int len;
+	int no_eras;
+	int *eras;              /* Positions, in increasing order */
+	uint16_t *lambda;       /* Erasure locator, index form */
+	uint16_t *m;            /* Y_j = sum_i S_i * alpha^m[j * no_eras + i] */
+	uint8_t *tab;           /* Tables for the vectorized kernel, or NULL */
+};
+
+/* Words per call of rs_eras_solve_internal */
+#define RS_ERAS_BLOCK 32
+
+/* The blocks of rs_eras_solve_internal, kept with the patterns of a context */
+struct rs_eras_work {
+	uint16_t *syn;          /* Syndromes, syn[c * nroots + i] */
+	uint16_t *val;          /* Erasure values, val[c * nroots + j] */
+	uint8_t *bad;           /* Non-zero if word c has other errors */
+	uint8_t *simd;          /* Syndromes and values of the kernel, or NULL */
+};
+
+/*
+ * Returns the pattern of the no_eras erasures eras in words of length len
+ * from the cache of dec, building it if needed. Returns NULL if the erasures
+ * are not distinct positions in the word, or on allocation failure. When it
+ * returns a pattern, dec->eras_work is allocated too.
+ */
+struct rs_eras *rs_eras_get_internal(struct rs_decoder *dec, int len,
+				     const int *eras, int no_eras);
+void rs_eras_cache_free_internal(struct rs_decoder *dec);
+
+/*
+ * Computes the erasure values of n <= RS_ERAS_BLOCK words from their
+ * syndromes in dec->eras_work->syn into dec->eras_work->val, both in poly
+ * form, in the order of p->eras. bad[c] is set if the syndrome of word c is
+ * not that of errors at the erasures.
+ */
+void rs_eras_solve_internal(struct rs_decoder *dec, const struct rs_eras *p,
+			    int n);
+
+struct rs_encoder {
+	struct rs_code *rs;
+	uint16_t *par;          /* Parity register, as in rs_encode */
+	uint8_t *par8;          /* The register for the byte symbol functions */
+	int wide;               /* Non-zero if par holds the register */
+};
+
+/*
+ * The antilog table alpha_to is extended to ALPHA_TO_LEN(nn) entries with
+ * alpha_to[i] = alpha**(i mod nn), so that any sum of up to three logs can be
+ * used as an index without reducing it modulo nn. Note that this makes
+ * alpha_to[nn] = 1, so log(0) = nn must still be checked for by the caller.
+ */
+#define ALPHA_TO_LEN(nn) (3 * (nn))
+
+/*
+ * The field tables of GF(2^mm), in one array: alpha_to, then index_of and the
+ * roots of y^2 + y = c (see rs_field_init), nn + 1 entries each.
+ */
+#define FIELD_TAB_LEN(nn) (ALPHA_TO_LEN(nn) + 2 * ((nn) + 1))
+
+/* Fills the field tables. Returns non-zero if gfpoly is not primitive. */
+int rs_field_init(int mm, int gfpoly, uint16_t *tab);
+
+/*
+ * Precomputed field tables, built at compile time by gen_tables. tab8 holds
+ * the byte sized copies of alpha_to and index_of for mm <= 8.
+ */
+struct rs_field {
+	int mm;
+	int gfpoly;
+	const uint16_t *tab;
+	const uint8_t *tab8;
+};
+
+extern const struct rs_field rs_fields[];
+extern const int rs_nfields;
+
 static inline int modnn(struct rs_code *rs, int x)
 {
 	while (x >= rs->nn) {
@@ -41,4 +416,10 @@ static inline int modnn(struct rs_code *rs, int x)
 	return x;
 }
 
+/* Reduces x modulo nn when it is known that 0 <= x < 2 * nn */
+static inline int subnn(struct rs_code *rs, int x)
+{
+	return x >= rs->nn ? x - rs->nn : x;
+}
+
 #endif /* FB_LIBRS_INTERNAL_H */
@@ -28,18 +28,43 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
-#define RS_ERROR_DEG_LAMBDA_ZERO -1;
-#define RS_ERROR_IMPOSSIBLE_ERR_POS -2;
-#define RS_ERROR_DEG_LAMBDA_NEQ_COUNT -3;
-#define RS_ERROR_NOT_A_CODEWORD -4;
-#define RS_ERROR_TOO_MANY_ERASURES -5;
+#define RS_ERROR_DEG_LAMBDA_ZERO (-1)
+#define RS_ERROR_IMPOSSIBLE_ERR_POS (-2)
+#define RS_ERROR_DEG_LAMBDA_NEQ_COUNT (-3)
+#define RS_ERROR_NOT_A_CODEWORD (-4)
+#define RS_ERROR_TOO_MANY_ERASURES (-5)
+
+/* Number of RS_ERROR_* codes */
+#define RS_NUM_ERRORS 5
+
+/* Stages of the decoder, see struct rs_stats */
+enum rs_stage {
+	RS_STAGE_SYNDROME,
+	RS_STAGE_BM,            /* Berlekamp-Massey, or the closed-form decoder */
+	RS_STAGE_CHIEN,         /* Chien search */
+	RS_STAGE_FORNEY,        /* Error values */
+	RS_STAGE_CHECK,         /* Syndrome check of the correction */
+	RS_NUM_STAGES
+};
+
+/* Berlekamp-Massey variants, see rs_set_bm */
+enum rs_bm {
+	RS_BM_AUTO,             /* Vectorized when possible, else classic */
+	RS_BM_CLASSIC,          /* Log form, one inversion per step */
+	RS_BM_INVERSIONLESS,    /* Poly form without branches, vectorized */
+};
+
+/* Default for rs_set_table_limit */
+#define RS_DEFAULT_TABLE_LIMIT (1 << 20)
 
 struct rs_code {
 	uint16_t *alpha_to;     /* log lookup table */
 	uint16_t *index_of;     /* Antilog lookup table */
 	uint16_t *genpoly;      /* Generator polynomial */
+	uint16_t *rootlog;      /* Roots of the generator polynomial, index form */
 	int mm;                 /* Bits per symbol */
 	int nn;                 /* Symbols per block (= (1<<mm)-1) */
 	int nroots;             /* Number of generator roots = number of parity symbols */
@@ -47,7 +72,19 @@ struct rs_code {
 	int prim;               /* Primitive element, index form */
 	int iprim;              /* prim-th root of 1, index form */
 	int gfpoly;
-	int users;
+	uint8_t *enc_tab;       /* Split-nibble parity tables (symsize <= 8) */
+	int enc_tab_w;          /* Row width of enc_tab in bytes */
+	/* Vectorized encoders, NULL if not available for this code */
+	void (*enc_simd)(struct rs_code *rs, const uint16_t *data,
+			 uint16_t *par, int dlen, int stride);
+	void (*enc_simd8)(struct rs_code *rs, const uint8_t *data,
+			  uint8_t *par, int dlen, int stride);
+	uint8_t *alpha_to8;     /* log lookup table (symsize <= 8) */
+	uint8_t *index_of8;     /* Antilog lookup table (symsize <= 8) */
+	uint16_t *enc_rows;     /* Generator product rows, NULL if too large */
+	uint8_t *syn_tab;       /* Syndrome multiplication tables */
+	int syn_lanes;          /* Lanes of the syndrome kernel, 0 if none */
+	uint16_t *quad;         /* Roots of y^2 + y = c, see init_lookup */
 };
 
 /* Initialize a Reed-Solomon code
@@ -62,11 +99,298 @@ struct rs_code *rs_init(int symsize, int gfpoly,
 
 void rs_free(struct rs_code *rs);
 
+/* Limits the size of the encoder and syndrome tables rs_init allocates for a
+ * code
+ * bytes = maximum table size in bytes
+ * Codes with larger tables use slower code without them. Only codes
+ * initialized after the call are affected, and codes are only shared between
+ * rs_init calls made under the same limit.
+ */
+void rs_set_table_limit(size_t bytes);
+
+/* Selects the Berlekamp-Massey variant the decoders use for rs
+ * All variants give the same results; they differ in speed. The setting is
+ * shared by all users of the code, and is RS_BM_AUTO after rs_init.
+ */
+void rs_set_bm(struct rs_code *rs, enum rs_bm bm);
+
+/* Decode statistics of a code
+ * rs_set_stats turns counting on or off for rs; it is off after rs_init.
+ * The setting and the counters are shared by all users of the code. Every
+ * decode of a counted code, by any of the decode functions, is counted once.
+ * Returns non-zero on allocation failure.
+ * rs_get_stats fills in stats and, unless hist is NULL, stores the number of
+ * words decoded with k corrected symbols in hist[k], for k = 0..nroots.
+ * Returns non-zero if counting was never turned on for the code.
+ */
+struct rs_stats {
+	uint64_t decoded;       /* Words decoded */
+	uint64_t clean;         /* Words without errors */
+	uint64_t corrected;     /* Symbols corrected */
+	uint64_t failed;        /* Uncorrectable words */
+	/* Uncorrectable words by error, failures[-1 - RS_ERROR_*] */
+	uint64_t failures[RS_NUM_ERRORS];
+	/* Cycles spent in each stage, if built with --enable-stage-timing */
+	uint64_t cycles[RS_NUM_STAGES];
+};
+
+int rs_set_stats(struct rs_code *rs, int enable);
+int rs_get_stats(struct rs_code *rs, struct rs_stats *stats, uint64_t *hist);
+void rs_reset_stats(struct rs_code *rs);
+
 void rs_encode(struct rs_code *rs, uint16_t *data, int len, int stride);
+
+/* Decode a received word with no_eras erasures
+ * Returns the number of corrected symbols, stored in increasing order in
+ * err_pos if it is non-null, or a negative RS_ERROR_* code. Roots of the
+ * error locator outside the word give RS_ERROR_DEG_LAMBDA_NEQ_COUNT.
+ */
 int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 	      int stride, const int *eras, int no_eras, int *err_pos);
 int rs_is_cword(struct rs_code *rs, uint16_t *data, int len, int stride);
 
+/* Decode a received word whose errors are all at the given erasures
+ * Skips the Berlekamp-Massey algorithm and the Chien search. Returns the same
+ * as rs_decode, and RS_ERROR_NOT_A_CODEWORD, leaving data as received, if the
+ * syndrome shows errors elsewhere. err_pos is in the order of eras.
+ */
+int rs_decode_erasures(struct rs_code *rs, uint16_t *data, int len,
+		       int stride, const int *eras, int no_eras, int *err_pos);
+
+/* Encode n codewords of the same code at once
+ * rs_encode_batch encodes data[0..n-1] as rs_encode would.
+ * rs_encode_soa encodes n codewords stored side by side, with symbol i of
+ * codeword c at data[i * n + c].
+ */
+void rs_encode_batch(struct rs_code *rs, uint16_t **data, int n, int len,
+		     int stride);
+void rs_encode_soa(struct rs_code *rs, uint16_t *data, int n, int len);
+
+/* Decode n received words of the same code at once
+ * status[c] = what rs_decode returns for data[c] without erasures
+ * Returns the number of uncorrectable words.
+ */
+int rs_decode_batch(struct rs_code *rs, uint16_t **data, int n, int len,
+		    int stride, int *status);
+
+/* Byte symbol variants, only valid for codes with symsize <= 8 */
+void rs_encode8(struct rs_code *rs, uint8_t *data, int len, int stride);
+int rs_decode8(struct rs_code *rs, uint8_t *data, int len,
+	       int stride, const int *eras, int no_eras, int *err_pos);
+int rs_decode8_erasures(struct rs_code *rs, uint8_t *data, int len,
+			int stride, const int *eras, int no_eras, int *err_pos);
+int rs_is_cword8(struct rs_code *rs, uint8_t *data, int len, int stride);
+void rs_encode8_batch(struct rs_code *rs, uint8_t **data, int n, int len,
+		      int stride);
+void rs_encode8_soa(struct rs_code *rs, uint8_t *data, int n, int len);
+int rs_decode8_batch(struct rs_code *rs, uint8_t **data, int n, int len,
+		     int stride, int *status);
+
+/* Worker pool for the batch functions
+ * nthreads = number of threads, the calling thread included; the number of
+ *            online CPUs if nthreads <= 0
+ * The pool functions work like the batch functions without the pool, but
+ * split the words between the threads. A pool runs one call at a time, and
+ * an rs_code may be shared by any number of threads and pools.
+ */
+struct rs_pool;
+
+struct rs_pool *rs_pool_create(int nthreads);
+void rs_pool_destroy(struct rs_pool *pool);
+
+void rs_pool_encode_batch(struct rs_pool *pool, struct rs_code *rs,
+			  uint16_t **data, int n, int len, int stride);
+int rs_pool_decode_batch(struct rs_pool *pool, struct rs_code *rs,
+			 uint16_t **data, int n, int len, int stride,
+			 int *status);
+void rs_pool_encode8_batch(struct rs_pool *pool, struct rs_code *rs,
+			   uint8_t **data, int n, int len, int stride);
+int rs_pool_decode8_batch(struct rs_pool *pool, struct rs_code *rs,
+			  uint8_t **data, int n, int len, int stride,
+			  int *status);
+
+/* Decoder context with preallocated scratch memory
+ * rs_decode_ctx and rs_decode8_ctx work like rs_decode and rs_decode8, but
+ * never allocate and keep their workspace in the context instead of on the
+ * stack. A context is for one thread at a time; the code must outlive it.
+ */
+struct rs_decoder;
+
+struct rs_decoder *rs_decoder_create(struct rs_code *rs);
+void rs_decoder_destroy(struct rs_decoder *dec);
+
+int rs_decode_ctx(struct rs_decoder *dec, uint16_t *data, int len,
+		  int stride, const int *eras, int no_eras, int *err_pos);
+int rs_decode8_ctx(struct rs_decoder *dec, uint8_t *data, int len,
+		   int stride, const int *eras, int no_eras, int *err_pos);
+
+/* Decode n received words that share the same erasures
+ * status[c] = what rs_decode_erasures returns for data[c]
+ * The locator of the erasures and the terms of the Forney algorithm are
+ * computed once for all the words, and kept in dec for the next calls with
+ * the same erasures, for the last few sets of erasures. Unlike the other
+ * context functions, these allocate memory for a new set of erasures.
+ * Returns the number of uncorrectable words.
+ */
+int rs_decode_erasures_batch(struct rs_decoder *dec, uint16_t **data, int n,
+			     int len, int stride, const int *eras, int no_eras,
+			     int *status);
+int rs_decode8_erasures_batch(struct rs_decoder *dec, uint8_t **data, int n,
+			      int len, int stride, const int *eras,
+			      int no_eras, int *status);
+
+/* Incremental encoder
+ * Computes the parity of a message that arrives in segments. After
+ * rs_encoder_init, the update functions take the message symbols in order,
+ * n at a time with the given stride, and rs_encoder_final writes the parity
+ * with the given stride and starts over. The parity equals what rs_encode
+ * computes for the whole message. The uint16_t and uint8_t functions may be
+ * mixed for codes with symsize <= 8. An encoder is for one thread at a time;
+ * the code must outlive it.
+ */
+struct rs_encoder;
+
+struct rs_encoder *rs_encoder_create(struct rs_code *rs);
+void rs_encoder_destroy(struct rs_encoder *enc);
+void rs_encoder_init(struct rs_encoder *enc);
+void rs_encoder_update(struct rs_encoder *enc, const uint16_t *data, int n,
+		       int stride);
+void rs_encoder_final(struct rs_encoder *enc, uint16_t *par, int stride);
+void rs_encoder_update8(struct rs_encoder *enc, const uint8_t *data, int n,
+			int stride);
+void rs_encoder_final8(struct rs_encoder *enc, uint8_t *par, int stride);
+
+/* Parity update for changed message symbols
+ * Updates the parity par of a codeword of length len whose message symbols
+ * at the positions pos[0..n-1] change from old_sym[i] to new_sym[i], without
+ * the rest of the message. The positions count from the start of the
+ * codeword, as in rs_decode. The symbols are added to the parity in
+ * O(nroots) each, from a table of x^k mod g(x) for all positions if the code
+ * has one, and otherwise with O(nroots^2) extra work per call.
+ * rs_update_parity_cache builds that table for the code, once. It takes
+ * (2^symsize - 1 - nroots) * nroots * 2 bytes.
+ * Return non-zero if a position is outside the message or on allocation
+ * failure.
+ */
+int rs_update_parity(struct rs_code *rs, uint16_t *par, int len,
+		     const int *pos, const uint16_t *old_sym,
+		     const uint16_t *new_sym, int n);
+int rs_update_parity8(struct rs_code *rs, uint8_t *par, int len,
+		      const int *pos, const uint8_t *old_sym,
+		      const uint8_t *new_sym, int n);
+int rs_update_parity_cache(struct rs_code *rs);
+
+/* Channel models
+ * A channel adds errors and erasures to batches of words, in place, with
+ * random numbers from a generator seeded with seed. The models are
+ * RS_CHANNEL_FIXED: exactly p->errors symbol errors and p->erasures erasures
+ *                   per word, at distinct random positions
+ * RS_CHANNEL_SYMMETRIC: the q-ary symmetric channel; every symbol is in error
+ *                   with probability p->p, and erased with probability
+ *                   p->p_erasure. With p->p = 0 it is an erasure channel.
+ * RS_CHANNEL_GILBERT_ELLIOTT: burst errors from a good and a bad state, with
+ *                   error probability p->p and p->p_bad in them. The state
+ *                   carries over from word to word. Erasures as above.
+ * The errors are random non-zero values XORed into the symbols, and the
+ * erasures random values. rs_channel_apply adds them to the n words of
+ * length len in data; the erasure positions of word c go to
+ * eras[c * len ...] and their number to no_eras[c] if these are not NULL.
+ * A channel is for one thread at a time; the code must outlive it.
+ * rs_channel_create returns NULL on invalid parameters or allocation failure,
+ * and rs_channel_apply -1 on invalid lengths.
+ */
+enum rs_channel_model {
+	RS_CHANNEL_FIXED,
+	RS_CHANNEL_SYMMETRIC,
+	RS_CHANNEL_GILBERT_ELLIOTT,
+};
+
+struct rs_channel_params {
+	enum rs_channel_model model;
+	int errors;             /* Fixed errors per word */
+	int erasures;           /* Fixed erasures per word */
+	double p;               /* Symbol error probability (good state) */
+	double p_bad;           /* Symbol error probability in the bad state */
+	double p_gb;            /* Probability of going from good to bad */
+	double p_bg;            /* Probability of going from bad to good */
+	double p_erasure;       /* Erasure probability */
+};
+
+struct rs_channel;
+
+struct rs_channel *rs_channel_create(struct rs_code *rs,
+				     const struct rs_channel_params *p,
+				     uint64_t seed);
+void rs_channel_destroy(struct rs_channel *ch);
+int rs_channel_apply(struct rs_channel *ch, uint16_t **data, int n, int len,
+		     int stride, int *eras, int *no_eras);
+int rs_channel_apply8(struct rs_channel *ch, uint8_t **data, int n, int len,
+		      int stride, int *eras, int *no_eras);
+
+/* Monte Carlo simulation
+ * Decodes p->trials random words of length p->len (the full length if 0)
+ * for every number of errors in min_errors..max_errors and of erasures in
+ * min_erasures..max_erasures, and counts the outcomes. The errors and
+ * erasures fall on distinct random positions; the errors get random non-zero
+ * values and the erasures random values. The trials are split between the
+ * threads of pool, or run on the calling thread if pool is NULL. Every block
+ * of trials has its own random number generator seeded from p->seed, so the
+ * results depend only on the parameters and not on the pool.
+ * res gets one entry per point, the number of erasures varying fastest:
+ * (max_errors - min_errors + 1) * (max_erasures - min_erasures + 1) entries.
+ * Return -1 on invalid parameters or allocation failure.
+ */
+struct rs_sim_params {
+	int len;                /* Codeword length, 0 for the full length */
+	int min_errors;         /* Range of symbol errors per word */
+	int max_errors;
+	int min_erasures;       /* Range of erasures per word */
+	int max_erasures;
+	uint64_t trials;        /* Words per point */
+	uint64_t seed;          /* Seed of the random number generators */
+};
+
+struct rs_sim_result {
+	int errors;             /* Symbol errors per word */
+	int erasures;           /* Erasures per word */
+	uint64_t trials;        /* Words decoded */
+	uint64_t word_errors;   /* Words failed or miscorrected */
+	uint64_t miscorrections;        /* Words decoded to another codeword */
+	uint64_t symbol_errors; /* Wrong message symbols after decoding */
+	/* Uncorrectable words by error, failures[-1 - RS_ERROR_*] */
+	uint64_t failures[RS_NUM_ERRORS];
+};
+
+int rs_sim_run(struct rs_pool *pool, struct rs_code *rs,
+	       const struct rs_sim_params *p, struct rs_sim_result *res);
+
+/* Streaming framer
+ * Cuts a byte stream into frames of depth interleaved codewords of length
+ * len, with symbol i of codeword c at frame symbol i * depth + c. The
+ * symbols are packed into bytes, most significant bit first. A stream is used
+ * either for encoding or for decoding.
+ * rs_stream_encoder_push takes any number of payload bytes and writes the
+ * frames they complete to out, at most (n / payload_len + 1) frames.
+ * rs_stream_encoder_flush pads the last payload with zeros and writes its
+ * frame.
+ * rs_stream_decoder_push takes any number of frame bytes, and writes the
+ * payload of each frame they complete to out and the rs_decode results of
+ * its depth codewords to status (NULL to ignore).
+ * The push and flush functions return the number of bytes written to out.
+ */
+struct rs_stream;
+
+struct rs_stream *rs_stream_create(struct rs_code *rs, int len, int depth);
+void rs_stream_destroy(struct rs_stream *st);
+size_t rs_stream_frame_len(struct rs_stream *st);
+size_t rs_stream_payload_len(struct rs_stream *st);
+
+size_t rs_stream_encoder_push(struct rs_stream *st, const uint8_t *buf,
+			      size_t n, uint8_t *out);
+size_t rs_stream_encoder_flush(struct rs_stream *st, uint8_t *out);
+size_t rs_stream_decoder_push(struct rs_stream *st, const uint8_t *buf,
+			      size_t n, uint8_t *out, int *status);
+
 /* Convenience functions */
 static inline int rs_mind(struct rs_code* rs)
 { return rs->nroots + 1; }
@@ -0,0 +1,807 @@
+/*
+ * librs.hpp
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Header-only C++ codec for one fixed code, for instance
+ *
+ *     using ccsds = rs::code<8, 0x187, 112, 11, 32>;
+ *     ccsds::encode(data, 255);
+ *     int ret = ccsds::decode(data, 255);
+ *
+ * The field tables, the generator polynomial and, for symbols of at most 8
+ * bits, the encoder, syndrome and Chien search product tables are built at
+ * compile time, and the loops over the roots of the encoder, the syndrome and
+ * the Berlekamp-Massey update are unrolled. The functions give exactly the
+ * same results as rs_encode, rs_decode and rs_is_cword (and their byte
+ * variants) of the same code, and the library is not needed to use them.
+ * The symbols are uint8_t or uint16_t.
+ *
+ * For codes of byte symbols, a received word is reduced with the packed
+ * encoder before the syndrome is taken, so a clean word costs about as much
+ * as encoding it. tests/cpp_bench compares the two with the library. Wider
+ * symbols get no product tables, and there the vectorized kernels of the
+ * library are faster.
+ */
+
+#ifndef FB_LIBRS_HPP
+#define FB_LIBRS_HPP
+
+#include "librs.h"
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace rs {
+
+namespace detail {
+
+template <typename F, std::size_t... I>
+inline void unroll(F &&f, std::index_sequence<I...>)
+{
+	(f(std::integral_constant<int, I>()), ...);
+}
+
+/* Calls f(0), ..., f(N - 1), with the index as a compile time constant */
+template <int N, typename F>
+inline void unroll(F &&f)
+{
+	unroll(f, std::make_index_sequence<N>());
+}
+
+template <int mm>
+struct field_tables {
+	static constexpr int nn = (1 << mm) - 1;
+
+	std::array<uint16_t, 2 * nn> alpha_to; /* Sums of two logs need not be reduced */
+	std::array<uint16_t, nn + 1> index_of;
+	std::array<uint16_t, nn + 1> quad;     /* Even root of y^2 + y = c, or 0 */
+	bool primitive;
+};
+
+/* Same tables as rs_field_init */
+template <int mm, int gfpoly>
+constexpr field_tables<mm> make_field()
+{
+	constexpr int nn = (1 << mm) - 1;
+	field_tables<mm> f{};
+	int sr = 1;
+
+	f.index_of[0] = nn;
+	for (int i = 0; i < nn; i++) {
+		f.index_of[sr] = i;
+		f.alpha_to[i] = sr;
+		sr <<= 1;
+		if (sr & (1 << mm))
+			sr ^= gfpoly;
+		sr &= nn;
+	}
+	f.primitive = sr == 1;
+
+	for (int i = nn; i < 2 * nn; i++)
+		f.alpha_to[i] = f.alpha_to[i - nn];
+
+	for (int y = 2; y <= nn; y += 2) {
+		int y2 = f.alpha_to[(2 * f.index_of[y]) % nn];
+		f.quad[y2 ^ y] = y;
+	}
+
+	return f;
+}
+
+} /* namespace detail */
+
+/* GF(2^mm) with the field generator polynomial gfpoly */
+template <int mm, int gfpoly>
+struct field {
+	static_assert(mm >= 1 && mm <= 16, "symbols are at most 16 bits");
+
+	static constexpr int nn = (1 << mm) - 1;
+	static constexpr detail::field_tables<mm> tab =
+		detail::make_field<mm, gfpoly>();
+
+	static_assert(tab.primitive, "gfpoly is not primitive");
+
+	/* Reduces x modulo nn when it is known that 0 <= x < 2 * nn */
+	static constexpr int subnn(int x)
+	{
+		return x >= nn ? x - nn : x;
+	}
+
+	/* Product of two field elements in index form, in poly-form */
+	static constexpr uint16_t mul_log(int a, int b)
+	{
+		return (a == nn || b == nn) ? 0 : tab.alpha_to[a + b];
+	}
+};
+
+namespace detail {
+
+template <int nroots>
+struct poly_tables {
+	std::array<uint16_t, nroots + 1> genpoly;       /* index form */
+	std::array<uint16_t, nroots + 1> rootlog;       /* roots of genpoly */
+	int iprim;                                      /* prim-th root of 1 */
+};
+
+template <int mm, int gfpoly, int fcr, int prim, int nroots>
+constexpr poly_tables<nroots> make_poly()
+{
+	constexpr int nn = (1 << mm) - 1;
+	constexpr auto &tab = field<mm, gfpoly>::tab;
+	poly_tables<nroots> p{};
+	std::array<uint16_t, nroots + 1> g{};   /* poly-form */
+
+	g[0] = 1;
+	for (int i = 0, root = ((long long) fcr * prim) % nn; i < nroots;
+	     i++, root = (root + prim) % nn) {
+		p.rootlog[i] = root;
+
+		/* g(x) *= x + alpha^root */
+		g[i + 1] = 1;
+		for (int j = i; j > 0; j--) {
+			g[j] = g[j - 1]
+			       ^ field<mm, gfpoly>::mul_log(tab.index_of[g[j]], root);
+		}
+		g[0] = field<mm, gfpoly>::mul_log(tab.index_of[g[0]], root);
+	}
+
+	for (int i = 0; i <= nroots; i++)
+		p.genpoly[i] = tab.index_of[g[i]];
+
+	int iprim = 1;
+	while (iprim % prim != 0)
+		iprim += nn;
+	p.iprim = iprim / prim;
+
+	return p;
+}
+
+/*
+ * enc[x] = x * (the feedback coefficients), for the parity register of
+ * encode. Coefficient k is byte k % 8 of word k / 8.
+ */
+template <int mm, int gfpoly, int nroots, bool small>
+constexpr auto make_enc(const poly_tables<nroots> &p)
+{
+	constexpr int nn = (1 << mm) - 1;
+	constexpr auto &tab = field<mm, gfpoly>::tab;
+	std::array<std::array<uint64_t, (nroots + 7) / 8 + 1>,
+		   small ? nn + 1 : 1> t{};
+
+	if constexpr (small) {
+		for (int x = 1; x <= nn; x++) {
+			for (int k = 0; k < nroots; k++) {
+				uint64_t v = tab.alpha_to[tab.index_of[x]
+					+ p.genpoly[nroots - 1 - k]];
+				t[x][k / 8] |= v << (8 * (k % 8));
+			}
+		}
+	}
+
+	return t;
+}
+
+/* syn[i][x] = x * alpha^rootlog[i] */
+template <int mm, int gfpoly, int nroots, bool small>
+constexpr auto make_syn(const poly_tables<nroots> &p)
+{
+	constexpr int nn = (1 << mm) - 1;
+	constexpr auto &tab = field<mm, gfpoly>::tab;
+	std::array<std::array<uint8_t, small ? nn + 1 : 1>, nroots + 1> t{};
+
+	if constexpr (small) {
+		for (int i = 0; i < nroots; i++) {
+			for (int x = 1; x <= nn; x++) {
+				t[i][x] = tab.alpha_to[tab.index_of[x]
+					+ p.rootlog[i]];
+			}
+		}
+	}
+
+	return t;
+}
+
+/* chien[j][x] = x * alpha^(j * prim), the step of term j of chien */
+template <int mm, int gfpoly, int prim, int nroots, bool small>
+constexpr auto make_chien()
+{
+	constexpr int nn = (1 << mm) - 1;
+	constexpr auto &tab = field<mm, gfpoly>::tab;
+	std::array<std::array<uint8_t, small ? nn + 1 : 1>, nroots + 1> t{};
+
+	if constexpr (small) {
+		for (int j = 1; j <= nroots; j++) {
+			int step = ((long long) j * prim) % nn;
+			for (int x = 1; x <= nn; x++)
+				t[j][x] = tab.alpha_to[tab.index_of[x] + step];
+		}
+	}
+
+	return t;
+}
+
+} /* namespace detail */
+
+/*
+ * Reed-Solomon code with the parameters of rs_init
+ * mm = symbol size, bits
+ * gfpoly = Field generator polynomial coefficients
+ * fcr = first root of RS code generator polynomial, index form
+ * prim = primitive element to generate polynomial roots
+ * nroots = RS code generator polynomial degree (number of roots)
+ */
+template <int mm, int gfpoly, int fcr, int prim, int nroots>
+class code {
+	using gf = field<mm, gfpoly>;
+
+public:
+	static constexpr int nn = gf::nn;
+
+	static_assert(fcr >= 0 && fcr < (1 << mm), "fcr out of range");
+	static_assert(prim > 0 && prim < (1 << mm), "prim out of range");
+	static_assert(nroots >= 0 && nroots < (1 << mm), "nroots out of range");
+
+	/* Same as rs_encode or rs_encode8 */
+	template <typename T>
+	static void encode(T *data, int len, int stride = 1)
+	{
+		check_symbol<T>();
+		int dlen = len - nroots;
+		T *p = data + dlen * stride;
+
+		if constexpr (small) {
+			std::array<uint64_t, words + 1> par{};
+
+			for (int i = 0; i < dlen; i++)
+				encode_byte(par, data[i * stride]);
+
+			for (int i = 0; i < nroots; i++)
+				p[i * stride] = par[i / 8] >> (8 * (i % 8)) & 0xff;
+		} else {
+			std::array<uint16_t, nroots + 1> par{};
+
+			for (int i = 0; i < dlen; i++)
+				encode_symbol(par, data[i * stride]);
+
+			for (int i = 0; i < nroots; i++)
+				p[i * stride] = par[i];
+		}
+	}
+
+	/* Same as rs_decode or rs_decode8 */
+	template <typename T>
+	static int decode(T *data, int len, int stride = 1,
+			  const int *eras = nullptr, int no_eras = 0,
+			  int *err_pos = nullptr)
+	{
+		check_symbol<T>();
+		if (no_eras > nroots)
+			return RS_ERROR_TOO_MANY_ERASURES;
+
+		std::array<uint16_t, nroots + 1> s, loc{}, cor{};
+		if (!syndrome(s, data, len, stride))
+			return 0;
+
+		int pad = nn - len;
+		int num_corrected = find_errors(s, pad, eras, no_eras, loc, cor);
+		if (num_corrected <= 0)
+			return num_corrected;
+
+		for (int i = 0; i < num_corrected; i++)
+			data[(loc[i] - pad) * stride] ^= tab.alpha_to[cor[i]];
+
+		if (err_pos != nullptr) {
+			for (int i = 0; i < num_corrected; i++)
+				err_pos[i] = loc[i] - pad;
+		}
+
+		return num_corrected;
+	}
+
+	/* Same as rs_is_cword or rs_is_cword8 */
+	template <typename T>
+	static int is_cword(const T *data, int len, int stride = 1)
+	{
+		check_symbol<T>();
+		std::array<uint16_t, nroots + 1> s;
+
+		return !syndrome(s, data, len, stride);
+	}
+
+private:
+	static constexpr auto &tab = gf::tab;
+
+	/* Byte symbols get product tables instead of log lookups */
+	static constexpr bool small = mm <= 8;
+
+	/* Words of the packed parity register of byte symbols */
+	static constexpr int words = (nroots + 7) / 8;
+
+	template <typename T>
+	static constexpr void check_symbol()
+	{
+		static_assert(std::is_same<T, uint8_t>::value
+			      || std::is_same<T, uint16_t>::value,
+			      "symbols are uint8_t or uint16_t");
+		static_assert(8 * sizeof(T) >= mm, "symbol type too small");
+	}
+
+	static constexpr int subnn(int x)
+	{
+		return gf::subnn(x);
+	}
+
+	static constexpr int mul_log(int a, int b)
+	{
+		return gf::mul_log(a, b);
+	}
+
+	static constexpr detail::poly_tables<nroots> poly =
+		detail::make_poly<mm, gfpoly, fcr, prim, nroots>();
+
+	/* Product tables, a single dummy row if not small */
+	static constexpr auto enc =
+		detail::make_enc<mm, gfpoly, nroots, small>(poly);
+	static constexpr auto syn =
+		detail::make_syn<mm, gfpoly, nroots, small>(poly);
+	static constexpr auto chien_tab =
+		detail::make_chien<mm, gfpoly, prim, nroots, small>();
+
+	/*
+	 * Shifts one message symbol into the parity register, with the
+	 * coefficients packed as in enc.
+	 */
+	static void encode_byte(std::array<uint64_t, words + 1> &par,
+				unsigned sym)
+	{
+		const auto &row = enc[(sym ^ par[0]) & 0xff];
+
+		detail::unroll<words>([&](auto w) {
+			par[w] = (par[w] >> 8 | par[w + 1] << 56) ^ row[w];
+		});
+	}
+
+	/* Same as encode_byte, with one symbol per entry */
+	static void encode_symbol(std::array<uint16_t, nroots + 1> &par,
+				  unsigned sym)
+	{
+		if constexpr (nroots > 0) {
+			int fb = tab.index_of[sym ^ par[0]];
+			if (fb == nn) {
+				detail::unroll<nroots - 1>([&](auto k) {
+					par[k] = par[k + 1];
+				});
+				par[nroots - 1] = 0;
+				return;
+			}
+
+			detail::unroll<nroots>([&](auto k) {
+				uint16_t g = tab.alpha_to[fb
+					+ poly.genpoly[nroots - 1 - k]];
+				par[k] = par[k + 1] ^ g;
+			});
+		}
+	}
+
+	/* form the syndromes; i.e., evaluate data(x) at roots of g(x) */
+	template <typename T>
+	static void horner(std::array<uint16_t, nroots + 1> &s,
+			   const T *data, int len, int stride)
+	{
+		for (int i = 0; i < nroots; i++)
+			s[i] = data[0];
+
+		for (int j = 1; j < len; j++) {
+			unsigned d = data[j * stride];
+
+			detail::unroll<nroots>([&](auto i) {
+				if constexpr (small) {
+					s[i] = d ^ syn[i][s[i]];
+				} else {
+					s[i] = s[i] ? d ^ tab.alpha_to[
+						tab.index_of[s[i]]
+						+ poly.rootlog[i]] : d;
+				}
+			});
+		}
+	}
+
+	/*
+	 * Computes the syndrome s of a received word. Returns false, with s
+	 * not set, if the word is a codeword.
+	 *
+	 * Words of byte symbols are first reduced modulo g(x): the packed
+	 * encoder register gives the parity of the message, and the received
+	 * parity is added. That is one row of enc and words shift-xor steps
+	 * per symbol, where the syndrome takes nroots table lookups. Since
+	 * g(x) vanishes at the roots, the syndrome of the word is that of the
+	 * nroots symbols of the remainder, and a clean word needs none.
+	 */
+	template <typename T>
+	static bool syndrome(std::array<uint16_t, nroots + 1> &s,
+			     const T *data, int len, int stride)
+	{
+		unsigned diff = 0;
+
+		if constexpr (small) {
+			std::array<uint64_t, words + 1> par{};
+			std::array<uint8_t, nroots + 1> rem;
+			int dlen = len - nroots;
+
+			for (int i = 0; i < dlen; i++)
+				encode_byte(par, data[i * stride]);
+
+			for (int i = 0; i < nroots; i++) {
+				rem[i] = (par[i / 8] >> (8 * (i % 8)) & 0xff)
+					 ^ data[(dlen + i) * stride];
+				diff |= rem[i];
+			}
+
+			if (!diff)
+				return false;
+
+			horner(s, rem.data(), nroots, 1);
+			return true;
+		} else {
+			horner(s, data, len, stride);
+			for (int i = 0; i < nroots; i++)
+				diff |= s[i];
+
+			return diff != 0;
+		}
+	}
+
+	/* Position in the codeword of the error locator X = alpha^x */
+	static int locator_pos(int x)
+	{
+		return nn - 1 - (int) (((long long) x * poly.iprim) % nn);
+	}
+
+	/* Same as decode_direct in reed_solomon.c */
+	static int find_direct(const std::array<uint16_t, nroots + 1> &s,
+			       const std::array<uint16_t, nroots + 1> &si,
+			       int pad, std::array<uint16_t, nroots + 1> &loc,
+			       std::array<uint16_t, nroots + 1> &cor)
+	{
+		if constexpr (nroots < 2) {
+			return 0;
+		} else {
+			if (si[0] != nn && si[1] != nn) {
+				int x = subnn(si[1] + nn - si[0]);
+				int i;
+				for (i = 2; i < nroots; i++) {
+					if (si[i] != subnn(si[i - 1] + x))
+						break;
+				}
+
+				if (i == nroots) {
+					int k = locator_pos(x);
+					if (k < pad)
+						return 0;
+
+					loc[0] = k;
+					cor[0] = (si[0] + (long long) (nn - fcr) * x) % nn;
+					return 1;
+				}
+			}
+
+			if constexpr (nroots < 4)
+				return 0;
+			else
+				return find_two(s, si, pad, loc, cor);
+		}
+	}
+
+	static int find_two(const std::array<uint16_t, nroots + 1> &s,
+			    const std::array<uint16_t, nroots + 1> &si,
+			    int pad, std::array<uint16_t, nroots + 1> &loc,
+			    std::array<uint16_t, nroots + 1> &cor)
+	{
+		uint16_t det = mul_log(si[1], si[1]) ^ mul_log(si[0], si[2]);
+		uint16_t n1 = mul_log(si[1], si[2]) ^ mul_log(si[0], si[3]);
+		uint16_t n2 = mul_log(si[1], si[3]) ^ mul_log(si[2], si[2]);
+		if (!det || !n1 || !n2)
+			return 0;
+
+		int dl = tab.index_of[det];
+		int l1 = subnn(tab.index_of[n1] + nn - dl);
+		int l2 = subnn(tab.index_of[n2] + nn - dl);
+		uint16_t y = tab.quad[tab.alpha_to[(l2 + 2 * (nn - l1)) % nn]];
+		if (!y)
+			return 0;
+
+		int x[2] = {
+			subnn(l1 + tab.index_of[y]),
+			subnn(l1 + tab.index_of[y ^ 1]),
+		};
+
+		uint16_t v = s[1] ^ mul_log(si[0], x[1]);
+		if (!v)
+			return 0;
+
+		int e[2];
+		e[0] = subnn(tab.index_of[v] + nn - l1);
+		v = s[0] ^ tab.alpha_to[e[0]];
+		if (!v)
+			return 0;
+		e[1] = tab.index_of[v];
+
+		for (int i = 0, a = e[0], b = e[1]; i < nroots; i++) {
+			if ((tab.alpha_to[a] ^ tab.alpha_to[b]) != s[i])
+				return 0;
+			a = subnn(a + x[0]);
+			b = subnn(b + x[1]);
+		}
+
+		int k[2] = { locator_pos(x[0]), locator_pos(x[1]) };
+		if (k[0] < pad || k[1] < pad)
+			return 0;
+
+		int first = k[0] > k[1];
+		for (int j = 0; j < 2; j++) {
+			int l = j ^ first;
+			loc[j] = k[l];
+			cor[j] = (e[l] + (long long) (nn - fcr) * x[l]) % nn;
+		}
+
+		return 2;
+	}
+
+	/*
+	 * Finds the roots of lambda (index form, degree deg) at the positions
+	 * pad..nn-1, in order, and stops after deg roots.
+	 */
+	static int chien(const std::array<uint16_t, nroots + 1> &lambda,
+			 int deg, int pad, std::array<uint16_t, nroots + 1> &root,
+			 std::array<uint16_t, nroots + 1> &loc)
+	{
+		/* b[m] = lambda[j] + i * j for the non-zero terms of lambda */
+		std::array<uint16_t, nroots + 1> b{}, step{};
+		int i = ((long long) (pad + 1) * prim) % nn;
+		int count = 0;
+		int terms = 0;
+
+		/*
+		 * With byte symbols, term j is kept in poly form and stepped by
+		 * a lookup in chien_tab[j]: one load and one xor per term.
+		 */
+		if constexpr (small) {
+			std::array<uint8_t, nroots + 1> v{};
+
+			for (int j = 1; j <= deg; j++) {
+				if (lambda[j] != nn)
+					v[j] = tab.alpha_to[(lambda[j]
+						+ (long long) j * i) % nn];
+			}
+
+			for (int k = pad; k < nn; k++, i = subnn(i + prim)) {
+				unsigned q = 1;
+				for (int j = 1; j <= deg; j++) {
+					q ^= v[j];
+					v[j] = chien_tab[j][v[j]];
+				}
+				if (q != 0)
+					continue;
+
+				root[count] = i;
+				loc[count] = k;
+				if (++count == deg)
+					break;
+			}
+
+			return count;
+		}
+
+		for (int j = 1; j <= deg; j++) {
+			if (lambda[j] != nn) {
+				step[terms] = ((long long) j * prim) % nn;
+				b[terms++] = (lambda[j] + (long long) j * i) % nn;
+			}
+		}
+
+		for (int k = pad; k < nn; k++, i = subnn(i + prim)) {
+			uint16_t q = 1;
+			for (int m = 0; m < terms; m++) {
+				q ^= tab.alpha_to[b[m]];
+				b[m] = subnn(b[m] + step[m]);
+			}
+			if (q != 0)
+				continue;
+
+			root[count] = i;
+			loc[count] = k;
+			if (++count == deg)
+				break;
+		}
+
+		return count;
+	}
+
+	/* Same as decode in reed_solomon.c */
+	static int find_errors(const std::array<uint16_t, nroots + 1> &s,
+			       int pad, const int *eras, int no_eras,
+			       std::array<uint16_t, nroots + 1> &loc,
+			       std::array<uint16_t, nroots + 1> &cor)
+	{
+		std::array<uint16_t, nroots + 1> si, lambda, omega, b, t, root;
+
+		int syn_error = 0;
+		for (int i = 0; i < nroots; i++) {
+			syn_error |= s[i];
+			si[i] = tab.index_of[s[i]];
+		}
+
+		if (!syn_error)
+			return 0;
+
+		if (no_eras == 0) {
+			int count = find_direct(s, si, pad, loc, cor);
+			if (count > 0)
+				return count;
+		}
+
+		lambda.fill(0);
+		lambda[0] = 1;
+
+		if (no_eras > 0) {
+			/* Init lambda to be the erasure locator polynomial */
+			lambda[1] = tab.alpha_to[((long long) prim
+				* (nn - 1 - (eras[0] + pad))) % nn];
+			for (int i = 1; i < no_eras; i++) {
+				int u = ((long long) prim
+					 * (nn - 1 - (eras[i] + pad))) % nn;
+				for (int j = i + 1; j > 0; j--) {
+					int tmp = tab.index_of[lambda[j - 1]];
+					if (tmp != nn)
+						lambda[j] ^= tab.alpha_to[u + tmp];
+				}
+			}
+		}
+
+		for (int i = 0; i < nroots + 1; i++)
+			b[i] = tab.index_of[lambda[i]];
+
+		/* Berlekamp-Massey algorithm */
+		int el = no_eras;
+		for (int r = no_eras + 1; r <= nroots; r++) {
+			/* lambda has degree at most el */
+			uint16_t discr_r = 0;
+			for (int i = 0; i < r && i <= el; i++) {
+				if (lambda[i] != 0 && si[r - i - 1] != nn) {
+					discr_r ^= tab.alpha_to[
+						tab.index_of[lambda[i]]
+						+ si[r - i - 1]];
+				}
+			}
+
+			discr_r = tab.index_of[discr_r];
+
+			if (discr_r == nn) {
+				shift(b);
+				continue;
+			}
+
+			t[0] = lambda[0];
+			detail::unroll<nroots>([&](auto i) {
+				t[i + 1] = lambda[i + 1];
+				if (b[i] != nn)
+					t[i + 1] ^= tab.alpha_to[discr_r + b[i]];
+			});
+
+			if (2 * el <= r + no_eras - 1) {
+				el = r + no_eras - el;
+				for (int i = 0; i <= nroots; i++) {
+					b[i] = lambda[i] == 0 ? nn
+					       : subnn(tab.index_of[lambda[i]]
+						       - discr_r + nn);
+				}
+			} else {
+				shift(b);
+			}
+			lambda = t;
+		}
+
+		int deg_lambda = 0;
+		for (int i = 0; i < nroots + 1; i++) {
+			lambda[i] = tab.index_of[lambda[i]];
+			if (lambda[i] != nn)
+				deg_lambda = i;
+		}
+
+		if (deg_lambda == 0)
+			return RS_ERROR_DEG_LAMBDA_ZERO;
+
+		int count = chien(lambda, deg_lambda, pad, root, loc);
+		if (deg_lambda != count)
+			return RS_ERROR_DEG_LAMBDA_NEQ_COUNT;
+
+		/* omega(x) = s(x) * lambda(x) mod x^nroots, index form */
+		int deg_omega = deg_lambda - 1;
+		for (int i = 0; i <= deg_omega; i++) {
+			uint16_t tmp = 0;
+			for (int j = i; j >= 0; j--) {
+				if (si[i - j] != nn && lambda[j] != nn)
+					tmp ^= tab.alpha_to[si[i - j] + lambda[j]];
+			}
+
+			omega[i] = tab.index_of[tmp];
+		}
+
+		/* Forney: omega(1/X) * (1/X)^(fcr - 1) / lambda'(1/X) */
+		int num_corrected = 0;
+		for (int j = 0; j < count; j++) {
+			int rj = subnn(root[j]);
+			uint16_t num1 = 0;
+			for (int i = 0, e = 0; i <= deg_omega; i++, e = subnn(e + rj)) {
+				if (omega[i] != nn)
+					num1 ^= tab.alpha_to[omega[i] + e];
+			}
+
+			if (num1 == 0)
+				continue;
+
+			num1 = tab.index_of[num1];
+			int num2 = ((long long) rj * (fcr - 1 + nn)) % nn;
+			uint16_t den = 0;
+
+			int r2 = subnn(2 * rj);
+			int cutoff = deg_lambda < nroots - 1 ? deg_lambda : nroots - 1;
+			for (int i = 0, e = 0; i <= cutoff; i += 2, e = subnn(e + r2)) {
+				if (lambda[i + 1] != nn)
+					den ^= tab.alpha_to[lambda[i + 1] + e];
+			}
+
+			den = tab.index_of[den];
+			int c = num1 + num2 - den;
+			if (c < 0)
+				c += nn;
+			cor[num_corrected] = subnn(c);
+			loc[num_corrected++] = loc[j];
+		}
+
+		/* The errors must give the syndrome of the received word */
+		t.fill(0);
+		for (int j = 0; j < num_corrected; j++) {
+			int xl = ((long long) prim * (nn - loc[j] - 1)) % nn;
+			int e = ((long long) fcr * xl) % nn;
+			for (int i = 0; i < nroots; i++, e = subnn(e + xl))
+				t[i] ^= tab.alpha_to[cor[j] + e];
+		}
+
+		for (int i = 0; i < nroots; i++) {
+			if (t[i] != s[i])
+				return RS_ERROR_NOT_A_CODEWORD;
+		}
+
+		return num_corrected;
+	}
+
+	/* B(x) <-- x*B(x) */
+	static void shift(std::array<uint16_t, nroots + 1> &b)
+	{
+		for (int i = nroots; i > 0; i--)
+			b[i] = b[i - 1];
+		b[0] = nn;
+	}
+};
+
+} /* namespace rs */
+
+#endif /* FB_LIBRS_HPP */
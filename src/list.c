@@ -127,3 +127,20 @@ void LIST_remove(LIST* list, LIST_NODE* node, int free_node)
     if(free_node)
         LIST_NODE_free(node);
 }
+
+void LIST_move_front(LIST* list, LIST_NODE* node)
+{
+    if(!node->prev) // node is already the first node
+        return;
+
+    LIST_remove(list, node, 0);
+    node->next = list->first;
+    node->prev = NULL;
+
+    if(!list->first)    // The list is empty
+        list->last = node;
+    else
+        list->first->prev = node;
+
+    list->first = node;
+}
@@ -54,6 +54,9 @@ void* LIST_pop_back(LIST* list);
 
 void LIST_remove(LIST* list, LIST_NODE* node, int free_node);
 
+/*! \brief Moves the given node of the list to the front. */
+void LIST_move_front(LIST* list, LIST_NODE* node);
+
 static inline int LIST_empty(LIST* list)
 { return !list->first; }
 
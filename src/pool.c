@@ -0,0 +1,336 @@
+/*
+ * pool.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Worker pool for the batch functions. A job is a parallel for loop over
+ * [0, n). Every thread, the caller included, gets an equal part of the range
+ * and takes chunks of grain items from the front of it. A thread that runs out
+ * of work takes chunks from the parts of the other threads, so a few slow
+ * items (words that need error correction) do not leave the rest idle.
+ *
+ * The front of each part is an atomic counter that is only ever incremented,
+ * so the owner and the thieves never get the same chunk.
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Chunk size of the batch jobs, a multiple of the batch functions' width */
+#define GRAIN 16
+
+struct range {
+	_Alignas(64) atomic_int next;
+	int end;
+};
+
+struct rs_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;    /* Signaled when a job is posted */
+	pthread_cond_t done;    /* Signaled when the last worker finishes */
+	pthread_mutex_t run_lock; /* Serializes the jobs */
+	pthread_t *threads;
+	int nthreads;           /* Number of threads, the caller included */
+	struct range *ranges;
+	unsigned long gen;      /* Job counter */
+	int busy;               /* Workers still running the current job */
+	int stop;
+
+	/* The current job */
+	void (*fn)(void *arg, int thread, int begin, int end);
+	void *arg;
+	int grain;
+};
+
+struct worker {
+	struct rs_pool *pool;
+	int id;
+};
+
+static int take(struct rs_pool *pool, struct range *r, int *begin, int *end)
+{
+	int b = atomic_fetch_add_explicit(&r->next, pool->grain,
+					  memory_order_relaxed);
+	if (b >= r->end)
+		return 0;
+
+	*begin = b;
+	*end = MIN(b + pool->grain, r->end);
+	return 1;
+}
+
+static void run_ranges(struct rs_pool *pool, int id)
+{
+	int begin, end;
+
+	/* Own part first, then the others starting from the next thread */
+	for (int k = 0; k < pool->nthreads; k++) {
+		struct range *r = pool->ranges + (id + k) % pool->nthreads;
+		while (take(pool, r, &begin, &end))
+			pool->fn(pool->arg, id, begin, end);
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct rs_pool *pool = w->pool;
+	unsigned long seen = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->stop && pool->gen == seen)
+			pthread_cond_wait(&pool->work, &pool->lock);
+
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		seen = pool->gen;
+		pthread_mutex_unlock(&pool->lock);
+
+		run_ranges(pool, w->id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	free(w);
+	return NULL;
+}
+
+static void stop_workers(struct rs_pool *pool, int nworkers)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < nworkers; i++)
+		pthread_join(pool->threads[i], NULL);
+}
+
+static void free_pool(struct rs_pool *pool)
+{
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->run_lock);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->ranges);
+	free(pool->threads);
+	free(pool);
+}
+
+struct rs_pool *rs_pool_create_internal(int nthreads)
+{
+	if (nthreads <= 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? ncpu : 1;
+	}
+
+	struct rs_pool *pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_mutex_init(&pool->run_lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->nthreads = nthreads;
+
+	pool->ranges = aligned_alloc(64, nthreads * sizeof(*pool->ranges));
+	if (!pool->ranges)
+		goto err;
+
+	pool->threads = calloc(nthreads, sizeof(*pool->threads));
+	if (!pool->threads)
+		goto err;
+
+	int started;
+	for (started = 0; started < nthreads - 1; started++) {
+		struct worker *w = malloc(sizeof(*w));
+		if (!w)
+			goto err_threads;
+
+		w->pool = pool;
+		w->id = started + 1;
+		if (pthread_create(pool->threads + started, NULL,
+				   worker_main, w)) {
+			free(w);
+			goto err_threads;
+		}
+	}
+
+	return pool;
+
+err_threads:
+	stop_workers(pool, started);
+err:
+	free_pool(pool);
+	return NULL;
+}
+
+void rs_pool_destroy_internal(struct rs_pool *pool)
+{
+	if (!pool)
+		return;
+
+	stop_workers(pool, pool->nthreads - 1);
+	free_pool(pool);
+}
+
+int rs_pool_threads(struct rs_pool *pool)
+{
+	return pool ? pool->nthreads : 1;
+}
+
+void rs_pool_run(struct rs_pool *pool,
+		 void (*fn)(void *arg, int thread, int begin, int end),
+		 void *arg, int n, int grain)
+{
+	if (!pool || pool->nthreads == 1 || n <= grain) {
+		if (n > 0)
+			fn(arg, 0, 0, n);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->run_lock);
+
+	/* Split the range into equal parts, rounded to whole chunks */
+	int nthreads = pool->nthreads;
+	int part = (n + nthreads - 1) / nthreads;
+	part = (part + grain - 1) / grain * grain;
+	for (int i = 0; i < nthreads; i++) {
+		int begin = MIN(i * part, n);
+		atomic_init(&pool->ranges[i].next, begin);
+		pool->ranges[i].end = MIN(begin + part, n);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->grain = grain;
+	pool->busy = nthreads - 1;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_ranges(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_unlock(&pool->run_lock);
+}
+
+/* Arguments of the batch jobs */
+struct batch_job {
+	struct rs_code *rs;
+	void **data;
+	int len;
+	int stride;
+	int *status;
+	atomic_int failed;
+};
+
+static void encode_job(void *arg, int thread, int begin, int end)
+{
+	struct batch_job *job = arg;
+
+	(void) thread;
+	rs_encode_batch(job->rs, (uint16_t **) job->data + begin, end - begin,
+			job->len, job->stride);
+}
+
+static void encode8_job(void *arg, int thread, int begin, int end)
+{
+	struct batch_job *job = arg;
+
+	(void) thread;
+	rs_encode8_batch(job->rs, (uint8_t **) job->data + begin, end - begin,
+			 job->len, job->stride);
+}
+
+static void decode_job(void *arg, int thread, int begin, int end)
+{
+	struct batch_job *job = arg;
+
+	(void) thread;
+	int failed = rs_decode_batch(job->rs, (uint16_t **) job->data + begin,
+				     end - begin, job->len, job->stride,
+				     job->status + begin);
+	if (failed)
+		atomic_fetch_add(&job->failed, failed);
+}
+
+static void decode8_job(void *arg, int thread, int begin, int end)
+{
+	struct batch_job *job = arg;
+
+	(void) thread;
+	int failed = rs_decode8_batch(job->rs, (uint8_t **) job->data + begin,
+				      end - begin, job->len, job->stride,
+				      job->status + begin);
+	if (failed)
+		atomic_fetch_add(&job->failed, failed);
+}
+
+static int run_batch(struct rs_pool *pool,
+		     void (*fn)(void *arg, int thread, int begin, int end),
+		     struct rs_code *rs, void **data, int n, int len,
+		     int stride, int *status)
+{
+	struct batch_job job = {
+		.rs = rs,
+		.data = data,
+		.len = len,
+		.stride = stride,
+		.status = status,
+	};
+
+	atomic_init(&job.failed, 0);
+	rs_pool_run(pool, fn, &job, n, GRAIN);
+	return atomic_load(&job.failed);
+}
+
+void rs_pool_encode_batch_internal(struct rs_pool *pool, struct rs_code *rs,
+				   void **data, int n, int len, int stride,
+				   int wide)
+{
+	run_batch(pool, wide ? encode_job : encode8_job, rs, data, n, len,
+		  stride, NULL);
+}
+
+int rs_pool_decode_batch_internal(struct rs_pool *pool, struct rs_code *rs,
+				  void **data, int n, int len, int stride,
+				  int *status, int wide)
+{
+	return run_batch(pool, wide ? decode_job : decode8_job, rs, data, n,
+			 len, stride, status);
+}
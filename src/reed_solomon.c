@@ -30,6 +30,12 @@
 #undef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/* Number of codewords the batch functions process side by side */
+#define MULTI 4
+
+/* RS_BM_AUTO runs the vectorized inversionless kernel from this many steps on */
+#define BM_AUTO_STEPS 8
+
 /* Initialize a Reed-Solomon codec
  * symsize = symbol size, bits
  * gfpoly = Field generator polynomial coefficients
@@ -59,35 +65,413 @@ void rs_free(struct rs_code *rs)
 	rs_free_internal(rs);
 }
 
-static void encode(struct rs_code *rs, uint16_t *data, uint16_t *par,
-		   int dlen, int stride)
+void rs_set_table_limit(size_t bytes)
+{
+	rs_set_table_limit_internal(bytes);
+}
+
+void rs_set_bm(struct rs_code *rs, enum rs_bm bm)
+{
+	atomic_store_explicit(&code_priv(rs)->bm, bm, memory_order_relaxed);
+}
+
+int rs_set_stats(struct rs_code *rs, int enable)
+{
+	return rs_set_stats_internal(rs, enable);
+}
+
+int rs_get_stats(struct rs_code *rs, struct rs_stats *stats, uint64_t *hist)
+{
+	return rs_get_stats_internal(rs, stats, hist);
+}
+
+void rs_reset_stats(struct rs_code *rs)
+{
+	rs_reset_stats_internal(rs);
+}
+
+struct rs_pool *rs_pool_create(int nthreads)
+{
+	return rs_pool_create_internal(nthreads);
+}
+
+void rs_pool_destroy(struct rs_pool *pool)
+{
+	rs_pool_destroy_internal(pool);
+}
+
+void rs_pool_encode_batch(struct rs_pool *pool, struct rs_code *rs,
+			  uint16_t **data, int n, int len, int stride)
+{
+	rs_pool_encode_batch_internal(pool, rs, (void **) data, n, len,
+				      stride, 1);
+}
+
+int rs_pool_decode_batch(struct rs_pool *pool, struct rs_code *rs,
+			 uint16_t **data, int n, int len, int stride,
+			 int *status)
+{
+	return rs_pool_decode_batch_internal(pool, rs, (void **) data, n, len,
+					     stride, status, 1);
+}
+
+void rs_pool_encode8_batch(struct rs_pool *pool, struct rs_code *rs,
+			   uint8_t **data, int n, int len, int stride)
+{
+	rs_pool_encode_batch_internal(pool, rs, (void **) data, n, len,
+				      stride, 0);
+}
+
+int rs_pool_decode8_batch(struct rs_pool *pool, struct rs_code *rs,
+			  uint8_t **data, int n, int len, int stride,
+			  int *status)
+{
+	return rs_pool_decode_batch_internal(pool, rs, (void **) data, n, len,
+					     stride, status, 0);
+}
+
+int rs_update_parity(struct rs_code *rs, uint16_t *par, int len,
+		     const int *pos, const uint16_t *old_sym,
+		     const uint16_t *new_sym, int n)
+{
+	return rs_update_parity_internal(rs, par, len, pos, old_sym, new_sym,
+					 n, 1);
+}
+
+int rs_update_parity8(struct rs_code *rs, uint8_t *par, int len,
+		      const int *pos, const uint8_t *old_sym,
+		      const uint8_t *new_sym, int n)
+{
+	return rs_update_parity_internal(rs, par, len, pos, old_sym, new_sym,
+					 n, 0);
+}
+
+int rs_update_parity_cache(struct rs_code *rs)
+{
+	return rs_update_parity_cache_internal(rs);
+}
+
+struct rs_channel *rs_channel_create(struct rs_code *rs,
+				     const struct rs_channel_params *p,
+				     uint64_t seed)
+{
+	return rs_channel_create_internal(rs, p, seed);
+}
+
+void rs_channel_destroy(struct rs_channel *ch)
+{
+	rs_channel_destroy_internal(ch);
+}
+
+int rs_channel_apply(struct rs_channel *ch, uint16_t **data, int n, int len,
+		     int stride, int *eras, int *no_eras)
+{
+	return rs_channel_apply_internal(ch, (void **) data, n, len, stride,
+					 eras, no_eras, 1);
+}
+
+int rs_channel_apply8(struct rs_channel *ch, uint8_t **data, int n, int len,
+		      int stride, int *eras, int *no_eras)
+{
+	return rs_channel_apply_internal(ch, (void **) data, n, len, stride,
+					 eras, no_eras, 0);
+}
+
+int rs_sim_run(struct rs_pool *pool, struct rs_code *rs,
+	       const struct rs_sim_params *p, struct rs_sim_result *res)
+{
+	return rs_sim_run_internal(pool, rs, p, res);
+}
+
+struct rs_stream *rs_stream_create(struct rs_code *rs, int len, int depth)
+{
+	return rs_stream_create_internal(rs, len, depth);
+}
+
+void rs_stream_destroy(struct rs_stream *st)
+{
+	rs_stream_destroy_internal(st);
+}
+
+size_t rs_stream_frame_len(struct rs_stream *st)
+{
+	return rs_stream_frame_len_internal(st);
+}
+
+size_t rs_stream_payload_len(struct rs_stream *st)
+{
+	return rs_stream_payload_len_internal(st);
+}
+
+size_t rs_stream_encoder_push(struct rs_stream *st, const uint8_t *buf,
+			      size_t n, uint8_t *out)
+{
+	return rs_stream_encoder_push_internal(st, buf, n, out);
+}
+
+size_t rs_stream_encoder_flush(struct rs_stream *st, uint8_t *out)
+{
+	return rs_stream_encoder_flush_internal(st, out);
+}
+
+size_t rs_stream_decoder_push(struct rs_stream *st, const uint8_t *buf,
+			      size_t n, uint8_t *out, int *status)
+{
+	return rs_stream_decoder_push_internal(st, buf, n, out, status);
+}
+
+/*
+ * The scalar encoders are written once for both symbol widths. The wide
+ * argument is a compile time constant in every caller, so the width checks
+ * are folded away when the functions are inlined.
+ */
+#define LOAD(p, i) (wide ? ((const uint16_t *) (p))[i] \
+		  : ((const uint8_t *) (p))[i])
+
+#define STORE(p, i, x) do {					\
+		if (wide)					\
+			((uint16_t *) (p))[i] = (x);		\
+		else						\
+			((uint8_t *) (p))[i] = (x);		\
+	} while (0)
+
+/*
+ * Encoder using the generator product rows of the code. The feedback symbol
+ * is split at bit 8, and the two rows give fb * g(x) for all coefficients.
+ *
+ * The parity register is kept as a ring buffer, with ring[h] = par[0], so
+ * nothing is shifted. The old par[0] becomes the new par[nroots - 1], which
+ * is zero before the feedback is added.
+ */
+static inline int encode_rows(struct rs_code *rs, const void *data,
+			      uint16_t *ring, int h, int dlen, int stride,
+			      int wide)
+{
+	const uint16_t *rows = rs->enc_rows;
+	int nroots = rs->nroots;
+
+	int cutoff = dlen * stride;
+	for (int i = 0; i < cutoff; i += stride) {
+		unsigned fb = LOAD(data, i) ^ ring[h];
+		const uint16_t *lo = rows + (fb & 0xff) * nroots;
+		const uint16_t *hi = rows + (256 + (fb >> 8)) * nroots;
+
+		ring[h] = 0;
+		if (++h == nroots)
+			h = 0;
+
+		int n1 = nroots - h;
+		for (int k = 0; k < n1; k++)
+			ring[h + k] ^= lo[k] ^ hi[k];
+		for (int k = n1; k < nroots; k++)
+			ring[k - n1] ^= lo[k] ^ hi[k];
+	}
+
+	return h;
+}
+
+/* Encoder for codes whose product rows would exceed the table limit */
+static inline int encode_logs(struct rs_code *rs, const void *data,
+			      uint16_t *ring, int h, int dlen, int stride,
+			      int wide)
 {
 	uint16_t *alpha_to = rs->alpha_to;
 	uint16_t *index_of = rs->index_of;
+	uint8_t *alpha_to8 = rs->alpha_to8;
+	uint8_t *index_of8 = rs->index_of8;
 	uint16_t *gp = rs->genpoly;
 	int nroots = rs->nroots;
 	int nn = rs->nn;
 
-	memset(par, 0, nroots * sizeof(*par));
+	int cutoff = dlen * stride;
+	for (int i = 0; i < cutoff; i += stride) {
+		unsigned sym = LOAD(data, i) ^ ring[h];
+		int fb = wide ? index_of[sym] : index_of8[sym];
+
+		ring[h] = 0;
+		if (++h == nroots)
+			h = 0;
+
+		if (fb == nn)
+			continue;
+
+		/* feedback term is non-zero */
+		const uint16_t *g = gp + nroots - 1;
+		int n1 = nroots - h;
+		for (int k = 0; k < n1; k++) {
+			ring[h + k] ^= wide ? alpha_to[fb + g[-k]]
+				       : alpha_to8[fb + g[-k]];
+		}
+		for (int k = n1; k < nroots; k++) {
+			ring[k - n1] ^= wide ? alpha_to[fb + g[-k]]
+					: alpha_to8[fb + g[-k]];
+		}
+	}
+
+	return h;
+}
+
+static inline void encode_scalar(struct rs_code *rs, const void *data,
+				 void *par, int dlen, int stride, int wide)
+{
+	int nroots = rs->nroots;
+	uint16_t ring[nroots];
+	int h = 0;
+
+	if (nroots == 0)
+		return;
+
+	for (int k = 0; k < nroots; k++)
+		ring[k] = LOAD(par, k);
+
+	if (rs->enc_rows)
+		h = encode_rows(rs, data, ring, h, dlen, stride, wide);
+	else
+		h = encode_logs(rs, data, ring, h, dlen, stride, wide);
+
+	/* Unroll the ring buffer */
+	for (int k = 0; k < nroots; k++) {
+		STORE(par, k, ring[h]);
+		if (++h == nroots)
+			h = 0;
+	}
+}
+
+/*
+ * Runs encode_rows on MULTI codewords at once. The chains are independent,
+ * so the table loads of one codeword overlap with the updates of the others.
+ * The parity of codeword c is written to par[c] with stride pstride.
+ */
+__attribute__((always_inline))
+static inline void encode_rows_multi(struct rs_code *rs,
+				     const void *const *data, void *const *par,
+				     int dlen, int stride, int pstride, int wide)
+{
+	const uint16_t *rows = rs->enc_rows;
+	int nroots = rs->nroots;
+	uint16_t ring[MULTI][nroots];
+	int h = 0;
+
+	memset(ring, 0, sizeof(ring));
 
 	int cutoff = dlen * stride;
 	for (int i = 0; i < cutoff; i += stride) {
-		uint16_t fb = index_of[data[i] ^ par[0]];
-		if (fb != nn) {
-			/* feedback term is non-zero */
-			for (int j = 1; j < nroots; j++) {
-				par[j] ^= alpha_to[modnn(rs,
-						fb + gp[nroots - j])];
-			}
+		const uint16_t *lo[MULTI], *hi[MULTI];
+		for (int c = 0; c < MULTI; c++) {
+			unsigned fb = LOAD(data[c], i) ^ ring[c][h];
+			lo[c] = rows + (fb & 0xff) * nroots;
+			hi[c] = rows + (256 + (fb >> 8)) * nroots;
+			ring[c][h] = 0;
 		}
 
-		/* Shift */
-		memmove(&par[0], &par[1], sizeof(*par) * (nroots - 1));
-		if (fb != nn)
-			par[nroots - 1] = alpha_to[modnn(rs, fb + gp[0])];
-		else
-			par[nroots - 1] = 0;
+		if (++h == nroots)
+			h = 0;
+
+		int n1 = nroots - h;
+		for (int c = 0; c < MULTI; c++) {
+			uint16_t *r = ring[c];
+			for (int k = 0; k < n1; k++)
+				r[h + k] ^= lo[c][k] ^ hi[c][k];
+			for (int k = n1; k < nroots; k++)
+				r[k - n1] ^= lo[c][k] ^ hi[c][k];
+		}
+	}
+
+	for (int k = 0; k < nroots; k++) {
+		for (int c = 0; c < MULTI; c++)
+			STORE(par[c], k * pstride, ring[c][h]);
+		if (++h == nroots)
+			h = 0;
+	}
+}
+
+/*
+ * Encodes MULTI codewords at once. Returns zero if the code has no batch
+ * encoder, in which case the codewords must be encoded one by one.
+ */
+static int encode_multi(struct rs_code *rs, const void *const *data,
+			void *const *par, int dlen, int stride, int pstride,
+			int wide)
+{
+	if (rs_encode_simd_multi(rs, data, par, MULTI, dlen, stride, pstride,
+				 wide))
+		return 1;
+
+	if (!rs->enc_rows || rs->nroots == 0)
+		return 0;
+
+	if (wide)
+		encode_rows_multi(rs, data, par, dlen, stride, pstride, 1);
+	else
+		encode_rows_multi(rs, data, par, dlen, stride, pstride, 0);
+
+	return 1;
+}
+
+/*
+ * Encodes the codewords data[0..n-1] in groups of MULTI and returns the number
+ * of codewords encoded. The parity of codeword c is written to
+ * data[c] + dlen * stride.
+ */
+static int encode_batch(struct rs_code *rs, void *const *data, int n,
+			int dlen, int stride, int wide)
+{
+	int size = wide ? 2 : 1;
+	int done;
+
+	for (done = 0; done + MULTI <= n; done += MULTI) {
+		void *par[MULTI];
+		for (int c = 0; c < MULTI; c++)
+			par[c] = (char *) data[done + c] + dlen * stride * size;
+
+		if (!encode_multi(rs, (const void *const *) data + done, par,
+				  dlen, stride, stride, wide))
+			break;
+	}
+
+	return done;
+}
+
+/* Same as encode_batch, but for codewords start, ..., n - 1 in SoA layout */
+static int encode_soa(struct rs_code *rs, void *data, void *pdata, int start,
+		      int n, int dlen, int wide)
+{
+	int size = wide ? 2 : 1;
+	int done;
+
+	for (done = start; done + MULTI <= n; done += MULTI) {
+		const void *d[MULTI];
+		void *par[MULTI];
+		for (int c = 0; c < MULTI; c++) {
+			d[c] = (char *) data + (done + c) * size;
+			par[c] = (char *) pdata + (done + c) * size;
+		}
+
+		if (!encode_multi(rs, d, par, dlen, n, n, wide))
+			break;
 	}
+
+	return done;
+}
+
+#undef LOAD
+#undef STORE
+
+/* Runs the parity register par over dlen data symbols */
+static void encode_update(struct rs_code *rs, const uint16_t *data,
+			  uint16_t *par, int dlen, int stride)
+{
+	if (rs->enc_simd)
+		rs->enc_simd(rs, data, par, dlen, stride);
+	else
+		encode_scalar(rs, data, par, dlen, stride, 1);
+}
+
+static void encode(struct rs_code *rs, uint16_t *data, uint16_t *par,
+		   int dlen, int stride)
+{
+	memset(par, 0, rs->nroots * sizeof(*par));
+	encode_update(rs, data, par, dlen, stride);
 }
 
 void rs_encode(struct rs_code *rs, uint16_t *data, int len, int stride)
@@ -110,92 +494,237 @@ void rs_encode(struct rs_code *rs, uint16_t *data, int len, int stride)
 	}
 }
 
-static inline void update_si(struct rs_code *rs, uint16_t *s, uint16_t data, int i)
+void rs_encode_batch(struct rs_code *rs, uint16_t **data, int n, int len,
+		     int stride)
+{
+	int dlen = len - rs->nroots;
+
+	int done = encode_batch(rs, (void *const *) data, n, dlen, stride, 1);
+	for (int c = done; c < n; c++)
+		rs_encode(rs, data[c], len, stride);
+}
+
+void rs_encode_soa(struct rs_code *rs, uint16_t *data, int n, int len)
+{
+	int dlen = len - rs->nroots;
+
+	rs_encode_soa_internal(rs, data, data + dlen * n, n, dlen, 1);
+}
+
+static inline void update_si(struct rs_code *rs, uint16_t *s, uint16_t data,
+			     const uint16_t *rlog, int i)
 {
 	uint16_t *alpha_to = rs->alpha_to;
 	uint16_t *index_of = rs->index_of;
-	int fcr = rs->fcr;
-	int prim = rs->prim;
 
-	if (s[i] == 0) {
+	if (s[i] == 0)
 		s[i] = data;
-	} else {
-		int tmp = index_of[s[i]] + (fcr + i) * prim;
-		s[i] = data ^ alpha_to[modnn(rs, tmp)];
-	}
+	else
+		s[i] = data ^ alpha_to[index_of[s[i]] + rlog[i]];
 }
 
 /* form the syndromes; i.e., evaluate data(x) at roots of g(x) */
 static void compute_syndrome(struct rs_code *rs, uint16_t *s,
-			     uint16_t* data, int len, int stride)
+			     uint16_t* data, int len, int stride,
+			     uint8_t *scratch)
 {
+	uint16_t *rlog = rs->rootlog;
+
+	if (rs_syndrome_simd(rs, s, data, len, stride, 1, scratch))
+		return;
+
 	for (int i = 0; i < rs->nroots; i++)
 		s[i] = data[0];
 
 	int cutoff = len * stride;
 	for (int j = stride; j < cutoff; j += stride) {
 		for (int i = 0; i < rs->nroots; i++)
-			update_si(rs, s, data[j], i);
+			update_si(rs, s, data[j], rlog, i);
 	}
 }
 
-int rs_decode(struct rs_code *rs, uint16_t *data, int len,
-	      int stride, const int *eras, int no_eras, int *err_pos)
+/*
+ * Finds the roots of lambda (index form, degree deg) at the positions
+ * pad..nn-1, in order, and stops after deg roots. Position k corresponds to
+ * the root alpha^i with i = (k + 1) * prim. b and step are workspace of
+ * deg + 1 entries. Returns the number of roots found.
+ */
+static int chien(struct rs_code *rs, const uint16_t *lambda, int deg,
+		 int pad, uint16_t *root, uint16_t *loc, uint16_t *b,
+		 uint16_t *step)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	int nn = rs->nn;
+	int prim = rs->prim;
+	int i = ((long long) (pad + 1) * prim) % nn;
+	int count = 0;
+
+	/* b[j] = lambda[j] + i * j for the current position */
+	for (int j = 1; j <= deg; j++) {
+		step[j] = ((long long) j * prim) % nn;
+		b[j] = (lambda[j] + (long long) j * i) % nn;
+	}
+
+	for (int k = pad; k < nn; k++, i = subnn(rs, i + prim)) {
+		uint16_t q = 1; /* lambda[0] is always 0 */
+		for (int j = deg; j > 0; j--) {
+			if (lambda[j] != nn) {
+				q ^= alpha_to[b[j]];
+				b[j] = subnn(rs, b[j] + step[j]);
+			}
+		}
+		if (q != 0)
+			continue; /* Not a root */
+
+		/* store root (index-form) and error location number */
+		root[count] = i;
+		loc[count] = k;
+		/* If we've already found max possible roots,
+		 * abort the search to save time
+		 */
+		if (++count == deg)
+			break;
+	}
+
+	return count;
+}
+
+/* Product of two field elements in index form, in poly-form */
+static inline uint16_t mul_log(struct rs_code *rs, int a, int b)
+{
+	if (a == rs->nn || b == rs->nn)
+		return 0;
+
+	return rs->alpha_to[a + b];
+}
+
+/* Position in the codeword of the error locator X = alpha^x */
+static inline int locator_pos(struct rs_code *rs, int x)
+{
+	return rs->nn - 1 - (int) (((long long) x * rs->iprim) % rs->nn);
+}
+
+/*
+ * Closed-form decoder for one or two errors without erasures. With the
+ * locators X_l and the error values Y_l, the syndromes are
+ * s[i] = sum_l Y'_l * X_l^i, where Y'_l = Y_l * X_l^fcr. A single error gives
+ * X = s[1] / s[0]. For two errors the locators solve
+ * X^2 + sigma1 * X + sigma2 = 0, with sigma1 and sigma2 from the first four
+ * syndromes, and the substitution X = sigma1 * y gives y^2 + y = c, whose roots
+ * are in rs->quad.
+ *
+ * A solution is only accepted if it reproduces all nroots syndromes. Since
+ * 2 * count <= nroots it is then the unique error pattern of that weight, so
+ * the general decoder would find the same one. Returns the number of errors
+ * stored in loc and cor, in the order of decode, or 0 if the syndromes are
+ * not those of one or two errors in the word.
+ */
+static int decode_direct(struct rs_code *rs, const uint16_t *s,
+			 const uint16_t *si, int pad, uint16_t *loc,
+			 uint16_t *cor)
 {
 	uint16_t *alpha_to = rs->alpha_to;
 	uint16_t *index_of = rs->index_of;
 	int nn = rs->nn;
 	int nroots = rs->nroots;
 	int fcr = rs->fcr;
-	int prim = rs->prim;
-	int iprim = rs->iprim;
-	int pad = nn - len;
 
-	uint16_t s[nroots], si[nroots];
-	uint16_t root[nroots], loc[nroots];
-	uint16_t lambda[nroots + 1];	/* Error and erasure locator poly */
-	uint16_t omega[nroots + 1];	/* Error and erasure evaluator poly */
-	uint16_t b[nroots + 1], t[nroots + 1];	/* workspace */
+	if (nroots < 2)
+		return 0;
 
-	if (no_eras > nroots)
-		return RS_ERROR_TOO_MANY_ERASURES;
+	/* One error: the syndromes form a geometric sequence */
+	if (si[0] != nn && si[1] != nn) {
+		int x = subnn(rs, si[1] + nn - si[0]);
+		int i;
+		for (i = 2; i < nroots; i++) {
+			if (si[i] != subnn(rs, si[i - 1] + x))
+				break;
+		}
 
-	compute_syndrome(rs, s, data, len, stride);
+		if (i == nroots) {
+			int k = locator_pos(rs, x);
+			if (k < pad)
+				return 0;
 
-	/* Convert syndromes to index form, checking for nonzero condition */
-	int syn_error = 0;
-	for (int i = 0; i < nroots; i++) {
-		syn_error |= s[i];
-		si[i] = index_of[s[i]];
+			loc[0] = k;
+			cor[0] = (si[0] + (long long) (nn - fcr) * x) % nn;
+			return 1;
+		}
 	}
 
-	if (!syn_error) {
-		/* if syndrome is zero, data[] is a codeword and there are no
-		 * errors to correct. So return data[] unmodified
-		 */
+	if (nroots < 4)
 		return 0;
-	}
 
-	memset(&lambda[1], 0, nroots * sizeof(lambda[0]));
-	lambda[0] = 1;
+	/* Two errors */
+	uint16_t det = mul_log(rs, si[1], si[1]) ^ mul_log(rs, si[0], si[2]);
+	uint16_t n1 = mul_log(rs, si[1], si[2]) ^ mul_log(rs, si[0], si[3]);
+	uint16_t n2 = mul_log(rs, si[1], si[3]) ^ mul_log(rs, si[2], si[2]);
+	if (!det || !n1 || !n2)
+		return 0;
 
-	if (no_eras > 0) {
-		/* Init lambda to be the erasure locator polynomial */
-		lambda[1] = alpha_to[modnn(rs, prim * (nn - 1 - (eras[0] + pad)))];
-		for (int i = 1; i < no_eras; i++) {
-			uint16_t u = modnn(rs, prim * (nn - 1 - (eras[i] + pad)));
-			for (int j = i + 1; j > 0; j--) {
-				uint16_t tmp = index_of[lambda[j - 1]];
-				if (tmp != nn)
-					lambda[j] ^= alpha_to[modnn(rs, u + tmp)];
-			}
-		}
-	}
+	int dl = index_of[det];
+	int l1 = subnn(rs, index_of[n1] + nn - dl);   /* sigma1 */
+	int l2 = subnn(rs, index_of[n2] + nn - dl);   /* sigma2 */
+	uint16_t y = rs->quad[alpha_to[(l2 + 2 * (nn - l1)) % nn]];
+	if (!y)
+		return 0;
 
-	for (int i = 0; i < nroots + 1; i++)
-		b[i] = index_of[lambda[i]];
+	int x[2] = {
+		subnn(rs, l1 + index_of[y]),
+		subnn(rs, l1 + index_of[y ^ 1]),
+	};
 
-	/*
+	/* Y'_0 = (s[1] + s[0] * X_1) / sigma1 and Y'_1 = s[0] + Y'_0 */
+	uint16_t v = s[1] ^ mul_log(rs, si[0], x[1]);
+	if (!v)
+		return 0;
+
+	int e[2];
+	e[0] = subnn(rs, index_of[v] + nn - l1);
+	v = s[0] ^ alpha_to[e[0]];
+	if (!v)
+		return 0;
+	e[1] = index_of[v];
+
+	for (int i = 0, a = e[0], b = e[1]; i < nroots; i++) {
+		if ((alpha_to[a] ^ alpha_to[b]) != s[i])
+			return 0;
+		a = subnn(rs, a + x[0]);
+		b = subnn(rs, b + x[1]);
+	}
+
+	int k[2] = { locator_pos(rs, x[0]), locator_pos(rs, x[1]) };
+	if (k[0] < pad || k[1] < pad)
+		return 0;
+
+	/* The general decoder reports the errors by position */
+	int first = k[0] > k[1];
+	for (int j = 0; j < 2; j++) {
+		int l = j ^ first;
+		loc[j] = k[l];
+		cor[j] = (e[l] + (long long) (nn - fcr) * x[l]) % nn;
+	}
+
+	return 2;
+}
+
+/*
+ * Berlekamp-Massey algorithm. Turns the erasure locator in lambda (poly form)
+ * into the error and erasure locator of the syndrome si (index form), in poly
+ * form. b and t are workspace of nroots + 1 entries.
+ */
+static void bm_classic(struct rs_code *rs, uint16_t *lambda, uint16_t *b,
+		       uint16_t *t, const uint16_t *si, int no_eras)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+
+	for (int i = 0; i < nroots + 1; i++)
+		b[i] = index_of[lambda[i]];
+
+	/*
 	 * Begin Berlekamp-Massey algorithm to determine error+erasure
 	 * locator polynomial
 	 */
@@ -206,8 +735,8 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 		uint16_t discr_r = 0;
 		for (int i = 0; i < r; i++)
 			if ((lambda[i] != 0) && (si[r - i - 1] != nn)) {
-				discr_r ^= alpha_to[modnn(rs,
-						index_of[lambda[i]] + si[r - i - 1])];
+				discr_r ^= alpha_to[index_of[lambda[i]]
+						    + si[r - i - 1]];
 			}
 
 		discr_r = index_of[discr_r]; /* Index form */
@@ -222,7 +751,7 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 			for (int i = 0; i < nroots; i++) {
 				if (b[i] != nn) {
 					t[i + 1] = lambda[i + 1]
-						^ alpha_to[modnn(rs, discr_r + b[i])];
+						^ alpha_to[discr_r + b[i]];
 				} else {
 					t[i + 1] = lambda[i + 1];
 				}
@@ -236,7 +765,7 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 				 */
 				for (int i = 0; i <= nroots; i++) {
 					b[i] = (lambda[i] == 0) ? nn
-					       : modnn(rs, index_of[
+					       : subnn(rs, index_of[
 							lambda[i]] - discr_r + nn);
 				}
 			} else {
@@ -247,6 +776,231 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 			memcpy(lambda, t, (nroots + 1) * sizeof(t[0]));
 		}
 	}
+}
+
+/* Product of x in poly form and alpha^l, l < 2 * nn, without branches */
+static inline uint16_t mul_poly(struct rs_code *rs, uint16_t x, int l)
+{
+	return rs->alpha_to[rs->index_of[x] + l] & -(uint16_t) (x != 0);
+}
+
+/*
+ * Inversionless Berlekamp-Massey algorithm, with the same arguments and
+ * result as bm_classic. Instead of scaling B(x) by the inverse of the
+ * discrepancy, lambda(x) is scaled by the discrepancy gamma of the last
+ * length change:
+ *
+ *   lambda(x) <-- gamma * lambda(x) - discr * x * B(x)
+ *
+ * The steps and length changes are those of bm_classic, so lambda(x) ends up
+ * a non-zero multiple of its locator, and dividing by lambda_0 gives the same
+ * polynomial. Everything stays in poly form, and the selections are masks.
+ */
+static void bm_inversionless(struct rs_code *rs, uint16_t *lambda,
+			     uint16_t *b, const uint16_t *si, int no_eras)
+{
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int lgamma = 0;         /* Index form, gamma is never zero */
+	int el = no_eras;
+
+	memcpy(b, lambda, (nroots + 1) * sizeof(*b));
+
+	for (int r = no_eras + 1; r <= nroots; r++) {
+		uint16_t discr = 0;
+		for (int i = 0; i < r; i++)
+			discr ^= mul_poly(rs, lambda[i], si[r - 1 - i])
+				 & -(uint16_t) (si[r - 1 - i] != nn);
+
+		int ldiscr = index_of[discr];
+		uint16_t dmask = -(uint16_t) (discr != 0);
+		uint16_t upd = dmask & -(uint16_t) (2 * el <= r + no_eras - 1);
+
+		/* lambda and B have degree < r before the step */
+		for (int i = r; i >= 0; i--) {
+			uint16_t bp = i ? b[i - 1] : 0;
+			uint16_t l = lambda[i];
+
+			lambda[i] = mul_poly(rs, l, lgamma)
+				    ^ (mul_poly(rs, bp, ldiscr) & dmask);
+			b[i] = (l & upd) | (bp & ~upd);
+		}
+
+		el = upd ? r + no_eras - el : el;
+		lgamma = upd ? ldiscr : lgamma;
+	}
+
+	int norm = nn - index_of[lambda[0]];
+	for (int i = 0; i <= nroots; i++)
+		lambda[i] = mul_poly(rs, lambda[i], norm);
+}
+
+/*
+ * The variant of rs_set_bm for a decode with no_eras erasures. RS_BM_AUTO
+ * means the vectorized kernel if there is one, and bm_classic otherwise; the
+ * scalar inversionless loop is no faster than bm_classic.
+ */
+static inline int bm_variant(struct rs_code *rs, int no_eras)
+{
+	int bm = atomic_load_explicit(&code_priv(rs)->bm, memory_order_relaxed);
+
+	if (bm == RS_BM_AUTO && rs->nroots - no_eras < BM_AUTO_STEPS)
+		return RS_BM_CLASSIC;
+
+	return bm;
+}
+
+/* Sets lambda (poly form) to the locator of the no_eras erasures eras */
+static void erasure_locator(struct rs_code *rs, uint16_t *lambda,
+			    const int *eras, int no_eras, int pad)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int prim = rs->prim;
+
+	memset(&lambda[1], 0, rs->nroots * sizeof(lambda[0]));
+	lambda[0] = 1;
+
+	if (no_eras > 0) {
+		/* Init lambda to be the erasure locator polynomial */
+		lambda[1] = alpha_to[modnn(rs, prim * (nn - 1 - (eras[0] + pad)))];
+		for (int i = 1; i < no_eras; i++) {
+			uint16_t u = modnn(rs, prim * (nn - 1 - (eras[i] + pad)));
+			for (int j = i + 1; j > 0; j--) {
+				uint16_t tmp = index_of[lambda[j - 1]];
+				if (tmp != nn)
+					lambda[j] ^= alpha_to[u + tmp];
+			}
+		}
+	}
+}
+
+/*
+ * Forney algorithm. Computes the error values at the count roots of lambda
+ * (index form, degree deg_lambda) in root, with the evaluator omega (index
+ * form, degree deg_lambda - 1). The locations in loc with a non-zero error
+ * are moved to the front, and their values (index form) stored in cor.
+ * Returns their number, or RS_ERROR_IMPOSSIBLE_ERR_POS if a root is not
+ * simple.
+ */
+static int forney(struct rs_code *rs, const uint16_t *lambda, int deg_lambda,
+		  const uint16_t *omega, const uint16_t *root, uint16_t *loc,
+		  uint16_t *cor, int count)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int fcr = rs->fcr;
+	int deg_omega = deg_lambda - 1;
+	int num_corrected = 0;
+
+	/*
+	 * Compute error values in poly-form. num1 = omega(inv(X(l))), num2 =
+	 * inv(X(l))**(fcr-1) and den = lambda_pr(inv(X(l))) all in poly-form
+	 */
+	for (int j = 0; j < count; j++) {
+		/* The powers of root[j] are accumulated in e */
+		int rj = subnn(rs, root[j]);
+		uint16_t num1 = 0;
+		for (int i = 0, e = 0; i <= deg_omega; i++, e = subnn(rs, e + rj)) {
+			if (omega[i] != nn)
+				num1 ^= alpha_to[omega[i] + e];
+		}
+
+		if (num1 == 0)
+			continue;
+
+		num1 = index_of[num1];
+		uint16_t num2 = ((long long) rj * (fcr - 1 + nn)) % nn;
+		uint16_t den = 0;
+
+		/* lambda[i+1] for i even is the formal derivative lambda_pr of lambda[i] */
+		int r2 = subnn(rs, 2 * rj);
+		int cutoff = MIN(deg_lambda, nroots - 1);
+		for (int i = 0, e = 0; i <= cutoff; i += 2, e = subnn(rs, e + r2)) {
+			if (lambda[i + 1] != nn)
+				den ^= alpha_to[lambda[i + 1] + e];
+		}
+
+		/* A multiple root, which the Chien search never finds */
+		if (den == 0)
+			return RS_ERROR_IMPOSSIBLE_ERR_POS;
+
+		den = index_of[den];
+		int c = num1 + num2 - den;
+		if (c < 0)
+			c += nn;
+		cor[num_corrected] = subnn(rs, c);
+		loc[num_corrected++] = loc[j];
+	}
+
+	return num_corrected;
+}
+
+/*
+ * Finds the errors in a received word of length len from its syndrome w->s.
+ * Returns the number of corrected symbols, or a negative number if the word
+ * is uncorrectable. The error locations and the error values (index form) are
+ * stored in w->loc and w->cor.
+ */
+static int decode(struct rs_code *rs, struct rs_work *w, int len,
+		  const int *eras, int no_eras)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int fcr = rs->fcr;
+	int prim = rs->prim;
+	int pad = nn - len;
+
+	uint16_t *s = w->s, *si = w->si, *root = w->root;
+	uint16_t *loc = w->loc, *cor = w->cor;
+	uint16_t *lambda = w->lambda, *omega = w->omega;
+	uint16_t *b = w->b, *t = w->t;
+
+	RS_TIMER(timer);
+
+	/* Convert syndromes to index form, checking for nonzero condition */
+	int syn_error = 0;
+	for (int i = 0; i < nroots; i++) {
+		syn_error |= s[i];
+		si[i] = index_of[s[i]];
+	}
+
+	if (!syn_error) {
+		/* if syndrome is zero, data[] is a codeword and there are no
+		 * errors to correct. So return data[] unmodified
+		 */
+		return 0;
+	}
+
+	if (no_eras == 0) {
+		int count = decode_direct(rs, s, si, pad, loc, cor);
+		if (count > 0) {
+			RS_STAGE(rs, timer, RS_STAGE_BM);
+			RS_PROBE(direct, rs, count);
+			return count;
+		}
+	}
+
+	erasure_locator(rs, lambda, eras, no_eras, pad);
+
+	switch (bm_variant(rs, no_eras)) {
+	case RS_BM_INVERSIONLESS:
+		if (rs_bm_simd(rs, lambda, s, no_eras) < 0)
+			bm_inversionless(rs, lambda, b, si, no_eras);
+		break;
+	case RS_BM_AUTO:
+		if (rs_bm_simd(rs, lambda, s, no_eras) == 0)
+			break;
+		/* fall through */
+	default:
+		bm_classic(rs, lambda, b, t, si, no_eras);
+	}
 
 	/* Convert lambda to index form and compute deg(lambda(x)) */
 	int deg_lambda = 0;
@@ -256,6 +1010,9 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 			deg_lambda = i;
 	}
 
+	RS_STAGE(rs, timer, RS_STAGE_BM);
+	RS_PROBE(bm, rs, deg_lambda);
+
 	if (deg_lambda == 0) {
 		/* deg(lambda) is zero even though the syndrome is non-zero
 		 * => uncorrectable error detected
@@ -263,33 +1020,18 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 		return RS_ERROR_DEG_LAMBDA_ZERO;
 	}
 
-	/* Find roots of the error+erasure locator polynomial by Chien search */
-	memcpy(&b[1], &lambda[1], nroots * sizeof(b[0]));
-	int count = 0;          /* Number of roots of lambda(x) */
-	for (int i = 1, k = iprim - 1; i <= nn; i++, k = modnn(rs, k + iprim)) {
-		uint16_t q = 1; /* lambda[0] is always 0 */
-		for (int j = deg_lambda; j > 0; j--) {
-			if (b[j] != nn) {
-				b[j] = modnn(rs, b[j] + j);
-				q ^= alpha_to[b[j]];
-			}
-		}
-		if (q != 0)
-			continue; /* Not a root */
-
-		if (k < pad)
-			/* Impossible error location. Uncorrectable error. */
-			return RS_ERROR_IMPOSSIBLE_ERR_POS;
+	/*
+	 * Find roots of the error+erasure locator polynomial by Chien search.
+	 * Only the positions of the shortened code are searched, so a locator
+	 * with roots in the padding is reported as having too few roots.
+	 */
+	int count = rs_chien_simd(rs, lambda, deg_lambda, pad, root, loc,
+				  w->chien);
+	if (count < 0)
+		count = chien(rs, lambda, deg_lambda, pad, root, loc, b, t);
 
-		/* store root (index-form) and error location number */
-		root[count] = i;
-		loc[count] = k;
-		/* If we've already found max possible roots,
-		 * abort the search to save time
-		 */
-		if (++count == deg_lambda)
-			break;
-	}
+	RS_STAGE(rs, timer, RS_STAGE_CHIEN);
+	RS_PROBE(chien, rs, count);
 
 	if (deg_lambda != count) {
 		/*
@@ -308,58 +1050,217 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 		uint16_t tmp = 0;
 		for (int j = i; j >= 0; j--) {
 			if ((si[i - j] != nn) && (lambda[j] != nn))
-				tmp ^= alpha_to[modnn(rs, si[i - j] + lambda[j])];
+				tmp ^= alpha_to[si[i - j] + lambda[j]];
 		}
 
 		omega[i] = index_of[tmp];
 	}
 
-	/* We reuse the buffer for b with a more appropriate name */
-	uint16_t *const cor = b;
-	int num_corrected = 0;
+	int num_corrected = forney(rs, lambda, deg_lambda, omega, root, loc,
+				   cor, count);
 
-	/*
-	 * Compute error values in poly-form. num1 = omega(inv(X(l))), num2 =
-	 * inv(X(l))**(fcr-1) and den = lambda_pr(inv(X(l))) all in poly-form
-	 */
-	for (int j = 0; j < count; j++) {
-		uint16_t num1 = 0;
-		for (int i = deg_omega; i >= 0; i--) {
-			if (omega[i] != nn)
-				num1 ^= alpha_to[modnn(rs, omega[i] + i * root[j])];
-		}
+	RS_STAGE(rs, timer, RS_STAGE_FORNEY);
+	RS_PROBE(forney, rs, num_corrected);
 
-		if (num1 == 0)
-			continue;
+	/* We compute the syndrome of the 'error' and check that it matches the
+	 * syndrome of the received word. The buffer t is reused for it. */
+	memset(t, 0, nroots * sizeof(t[0]));
+	for (int j = 0; j < num_corrected; j++) {
+		/* X_j**((fcr + i) * prim) is accumulated in e */
+		int xl = ((long long) prim * (nn - loc[j] - 1)) % nn;
+		int e = ((long long) fcr * xl) % nn;
+		for (int i = 0; i < nroots; i++, e = subnn(rs, e + xl))
+			t[i] ^= alpha_to[cor[j] + e];
+	}
 
-		num1 = index_of[num1];
-		uint16_t num2 = modnn(rs, root[j] * (fcr - 1) + nn);
-		uint16_t den = 0;
+	int ok = !memcmp(t, s, nroots * sizeof(t[0]));
 
-		/* lambda[i+1] for i even is the formal derivative lambda_pr of lambda[i] */
-		for (int i = MIN(deg_lambda, nroots - 1) & ~1; i >= 0; i -= 2) {
-			if (lambda[i + 1] != nn)
-				den ^= alpha_to[modnn(rs, lambda[i + 1] + i * root[j])];
-		}
+	RS_STAGE(rs, timer, RS_STAGE_CHECK);
+	RS_PROBE(check, rs, ok);
 
-		den = index_of[den];
-		cor[num_corrected] = modnn(rs, num1 + num2 + nn - den);
-		loc[num_corrected++] = loc[j];
+	return ok ? num_corrected : RS_ERROR_NOT_A_CODEWORD;
+}
+
+/*
+ * Finds the errors in a received word of length len from its syndrome w->s,
+ * given that they are all at the no_eras erasures. The erasure locator is
+ * the error locator, so the Berlekamp-Massey algorithm and the Chien search
+ * are skipped. The coefficients of x^no_eras ... x^(nroots-1) of the erasure
+ * locator times the syndrome are the discrepancies the Berlekamp-Massey
+ * algorithm would find; they are zero if and only if the syndrome is that of
+ * errors at the erasures, which replaces the final syndrome check. Returns the
+ * same as decode.
+ */
+static int decode_erasures(struct rs_code *rs, struct rs_work *w, int len,
+			   const int *eras, int no_eras)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int prim = rs->prim;
+	int pad = nn - len;
+
+	uint16_t *s = w->s, *si = w->si, *root = w->root;
+	uint16_t *loc = w->loc, *cor = w->cor;
+	uint16_t *lambda = w->lambda, *omega = w->omega;
+
+	RS_TIMER(timer);
+
+	int syn_error = 0;
+	for (int i = 0; i < nroots; i++) {
+		syn_error |= s[i];
+		si[i] = index_of[s[i]];
 	}
 
-	/* We compute the syndrome of the 'error' and check that it matches the
-	 * syndrome of the received word */
+	if (!syn_error)
+		return 0;
+
+	for (int j = 0; j < no_eras; j++) {
+		if (eras[j] < 0 || eras[j] >= len)
+			return RS_ERROR_IMPOSSIBLE_ERR_POS;
+	}
+
+	erasure_locator(rs, lambda, eras, no_eras, pad);
+	for (int i = 0; i < nroots + 1; i++)
+		lambda[i] = index_of[lambda[i]];
+
+	/* omega(x) = s(x) * lambda(x) mod x^no_eras, and the discrepancies */
 	for (int i = 0; i < nroots; i++) {
 		uint16_t tmp = 0;
-		for (int j = 0; j < num_corrected; j++) {
-			int k = (fcr + i) * prim * (nn - loc[j] - 1);
-			tmp ^= alpha_to[modnn(rs, cor[j] + k)];
+		for (int j = MIN(i, no_eras); j >= 0; j--) {
+			if ((si[i - j] != nn) && (lambda[j] != nn))
+				tmp ^= alpha_to[si[i - j] + lambda[j]];
 		}
 
-		if (tmp != s[i])
+		if (i < no_eras)
+			omega[i] = index_of[tmp];
+		else if (tmp)
 			return RS_ERROR_NOT_A_CODEWORD;
 	}
 
+	RS_STAGE(rs, timer, RS_STAGE_BM);
+	RS_PROBE(bm, rs, no_eras);
+
+	/* Position k is the root alpha^((k + 1) * prim), as in chien */
+	for (int j = 0; j < no_eras; j++) {
+		loc[j] = eras[j] + pad;
+		root[j] = ((long long) (loc[j] + 1) * prim) % nn;
+	}
+
+	int num_corrected = forney(rs, lambda, no_eras, omega, root, loc, cor,
+				   no_eras);
+
+	RS_STAGE(rs, timer, RS_STAGE_FORNEY);
+	RS_PROBE(forney, rs, num_corrected);
+
+	return num_corrected;
+}
+
+/* Points the arrays of w to mem, with n entries per array, w->s first */
+static void init_work(struct rs_work *w, uint16_t *mem, int n)
+{
+	uint16_t **arrays[WORK_ARRAYS] = {
+		&w->s, &w->si, &w->root, &w->loc, &w->cor,
+		&w->lambda, &w->omega, &w->b, &w->t,
+	};
+
+	for (int i = 0; i < WORK_ARRAYS; i++)
+		*arrays[i] = mem + i * n;
+
+	w->syn = NULL;
+	w->chien = NULL;
+}
+
+/*
+ * Workspace for a decoder on the stack. STACK_MEM declares the memory, whose
+ * first entries are the syndrome, and STACK_WORK lays out the arrays in it.
+ * The decoders compute the syndrome into the memory first and only lay out
+ * the workspace for a word with errors, which matters for the smallest
+ * codes, where the syndrome of a clean word is only a few table lookups.
+ */
+#define STACK_MEM(m, rs)						\
+	uint16_t m[WORK_ARRAYS * ((rs)->nroots + 1)]
+
+#define STACK_WORK(w, m, rs)						\
+	struct rs_work w;						\
+	init_work(&w, m, (rs)->nroots + 1)
+
+/* Counts the word as clean and returns 1 if the syndrome s is zero */
+static int clean_word(struct rs_code *rs, const uint16_t *s)
+{
+	uint16_t syn_error = 0;
+
+	for (int i = 0; i < rs->nroots; i++)
+		syn_error |= s[i];
+
+	if (syn_error)
+		return 0;
+
+	rs_count(rs, 0, 1);
+	return 1;
+}
+
+struct rs_decoder *rs_decoder_create(struct rs_code *rs)
+{
+	struct rs_decoder *dec = calloc(1, sizeof(*dec));
+	if (!dec)
+		return NULL;
+
+	/* Every array starts on a 32 byte boundary */
+	size_t n = ALIGN((rs->nroots + 1) * sizeof(uint16_t));
+	size_t syn = rs->syn_lanes ? ALIGN(SYNDROME_SCRATCH_LEN(rs->nroots)) : 0;
+	size_t chien = rs_simd_level() != RS_SIMD_NONE ? CHIEN_SCRATCH_LEN : 0;
+
+	uint8_t *mem = aligned_alloc(32, WORK_ARRAYS * n + syn + ALIGN(chien));
+	if (!mem) {
+		free(dec);
+		return NULL;
+	}
+
+	dec->rs = rs;
+	dec->mem = mem;
+	init_work(&dec->work, (uint16_t *) mem, n / sizeof(uint16_t));
+	mem += WORK_ARRAYS * n;
+	if (syn) {
+		dec->work.syn = mem;
+		mem += syn;
+	}
+	if (chien)
+		dec->work.chien = mem;
+
+	return dec;
+}
+
+void rs_decoder_destroy(struct rs_decoder *dec)
+{
+	if (!dec)
+		return;
+
+	rs_eras_cache_free_internal(dec);
+	free(dec->mem);
+	free(dec);
+}
+
+/*
+ * Corrects the errors in data given the syndrome w->s of the received word,
+ * only at the erasures if eras_only is set. Returns the same as rs_decode.
+ */
+static int correct(struct rs_code *rs, struct rs_work *w, uint16_t *data,
+		   int len, int stride, const int *eras, int no_eras,
+		   int *err_pos, int eras_only)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *loc = w->loc, *cor = w->cor;
+	int pad = rs->nn - len;
+
+	int ret = eras_only ? decode_erasures(rs, w, len, eras, no_eras)
+			    : decode(rs, w, len, eras, no_eras);
+	int num_corrected = rs_count(rs, ret, 1);
+	RS_PROBE(decode, rs, len, no_eras, num_corrected);
+	if (num_corrected <= 0)
+		return num_corrected;
+
 	/* Apply error to data */
 	for (int i = 0; i < num_corrected; i++)
 		data[(loc[i] - pad) * stride] ^= alpha_to[cor[i]];
@@ -373,11 +1274,126 @@ int rs_decode(struct rs_code *rs, uint16_t *data, int len,
 	return num_corrected;
 }
 
+int rs_decode(struct rs_code *rs, uint16_t *data, int len,
+	      int stride, const int *eras, int no_eras, int *err_pos)
+{
+	if (no_eras > rs->nroots)
+		return rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+
+	STACK_MEM(mem, rs);
+	RS_TIMER(timer);
+	compute_syndrome(rs, mem, data, len, stride, NULL);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, len);
+	if (clean_word(rs, mem))
+		return 0;
+
+	STACK_WORK(w, mem, rs);
+	return correct(rs, &w, data, len, stride, eras, no_eras, err_pos, 0);
+}
+
+int rs_decode_ctx(struct rs_decoder *dec, uint16_t *data, int len,
+		  int stride, const int *eras, int no_eras, int *err_pos)
+{
+	struct rs_code *rs = dec->rs;
+	struct rs_work *w = &dec->work;
+
+	if (no_eras > rs->nroots)
+		return rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+
+	RS_TIMER(timer);
+	compute_syndrome(rs, w->s, data, len, stride, w->syn);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, len);
+	return correct(rs, w, data, len, stride, eras, no_eras, err_pos, 0);
+}
+
+int rs_decode_erasures(struct rs_code *rs, uint16_t *data, int len,
+		       int stride, const int *eras, int no_eras, int *err_pos)
+{
+	if (no_eras > rs->nroots)
+		return rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+
+	STACK_MEM(mem, rs);
+	RS_TIMER(timer);
+	compute_syndrome(rs, mem, data, len, stride, NULL);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, len);
+	if (clean_word(rs, mem))
+		return 0;
+
+	STACK_WORK(w, mem, rs);
+	return correct(rs, &w, data, len, stride, eras, no_eras, err_pos, 1);
+}
+
+/*
+ * Checks the received word data against the parity par computed from its
+ * message symbols, and corrects it if they differ. The received word is a
+ * codeword if and only if the parity matches. Otherwise the difference is the
+ * remainder of the received word modulo g(x), which has the same syndrome as
+ * the received word, so the syndrome is computed from nroots symbols only.
+ * par is overwritten.
+ */
+static int check_word(struct rs_code *rs, uint16_t *data, uint16_t *par,
+		      int len, int stride)
+{
+	int nroots = rs->nroots;
+	const uint16_t *rpar = data + (len - nroots) * stride;
+	uint16_t diff = 0;
+
+	for (int i = 0; i < nroots; i++) {
+		par[i] ^= rpar[i * stride];
+		diff |= par[i];
+	}
+
+	if (!diff)
+		return rs_count(rs, 0, 1);
+
+	STACK_MEM(mem, rs);
+	STACK_WORK(w, mem, rs);
+	RS_TIMER(timer);
+	compute_syndrome(rs, w.s, par, nroots, 1, NULL);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, nroots);
+	return correct(rs, &w, data, len, stride, NULL, 0, NULL, 0);
+}
+
+int rs_decode_batch(struct rs_code *rs, uint16_t **data, int n, int len,
+		    int stride, int *status)
+{
+	int nroots = rs->nroots;
+	int dlen = len - nroots;
+	uint16_t par[MULTI][nroots];
+	void *p[MULTI];
+	int failed = 0;
+
+	for (int c = 0; c < MULTI; c++)
+		p[c] = par[c];
+
+	for (int c = 0; c < n; c += MULTI) {
+		int m = MIN(MULTI, n - c);
+		if (m < MULTI || !encode_multi(rs, (const void *const *) data + c,
+					       p, dlen, stride, 1, 1)) {
+			for (int k = 0; k < m; k++)
+				encode(rs, data[c + k], par[k], dlen, stride);
+		}
+
+		for (int k = 0; k < m; k++) {
+			status[c + k] = check_word(rs, data[c + k], par[k],
+						   len, stride);
+			if (status[c + k] < 0)
+				failed++;
+		}
+	}
+
+	return failed;
+}
+
 int rs_is_cword(struct rs_code *rs, uint16_t *data, int len, int stride)
 {
 	uint16_t s[rs->nroots];
 
-	compute_syndrome(rs, s, data, len, stride);
+	compute_syndrome(rs, s, data, len, stride, NULL);
 
 	/* Check if non-zero */
 	for (int i = 0; i < rs->nroots; i++)
@@ -386,3 +1402,448 @@ int rs_is_cword(struct rs_code *rs, uint16_t *data, int len, int stride)
 
 	return 1;
 }
+
+static void encode_update8(struct rs_code *rs, const uint8_t *data,
+			   uint8_t *par, int dlen, int stride)
+{
+	if (rs->enc_simd8)
+		rs->enc_simd8(rs, data, par, dlen, stride);
+	else
+		encode_scalar(rs, data, par, dlen, stride, 0);
+}
+
+static void encode8(struct rs_code *rs, uint8_t *data, uint8_t *par,
+		    int dlen, int stride)
+{
+	memset(par, 0, rs->nroots * sizeof(*par));
+	encode_update8(rs, data, par, dlen, stride);
+}
+
+void rs_encode8(struct rs_code *rs, uint8_t *data, int len, int stride)
+{
+	int nroots = rs->nroots;
+	int dlen = len - nroots;
+
+	if (stride == 1) {
+		/* Calculate parity in-place */
+		encode8(rs, data, data + dlen, dlen, stride);
+	} else {
+		/* Calculate parity in buffer */
+		uint8_t parity[nroots];
+		encode8(rs, data, parity, dlen, stride);
+
+		/* Write the parity data to the real parity location */
+		uint8_t *par = data + dlen * stride;
+		for (int i = 0; i < nroots; i++)
+			par[i * stride] = parity[i];
+	}
+}
+
+void rs_encode8_batch(struct rs_code *rs, uint8_t **data, int n, int len,
+		      int stride)
+{
+	int dlen = len - rs->nroots;
+
+	int done = encode_batch(rs, (void *const *) data, n, dlen, stride, 0);
+	for (int c = done; c < n; c++)
+		rs_encode8(rs, data[c], len, stride);
+}
+
+void rs_encode8_soa(struct rs_code *rs, uint8_t *data, int n, int len)
+{
+	int dlen = len - rs->nroots;
+
+	rs_encode_soa_internal(rs, data, data + dlen * n, n, dlen, 0);
+}
+
+void rs_encode_soa_internal(struct rs_code *rs, void *data, void *par, int n,
+			    int dlen, int wide)
+{
+	int nroots = rs->nroots;
+
+	int done = rs_encode_simd_soa(rs, data, par, n, dlen, wide);
+	done = encode_soa(rs, data, par, done, n, dlen, wide);
+
+	/* The rest one by one, through a buffer as for a stride */
+	for (int c = done; c < n; c++) {
+		if (wide) {
+			uint16_t parity[nroots], *p = (uint16_t *) par + c;
+			encode(rs, (uint16_t *) data + c, parity, dlen, n);
+			for (int i = 0; i < nroots; i++)
+				p[i * n] = parity[i];
+		} else {
+			uint8_t parity[nroots], *p = (uint8_t *) par + c;
+			encode8(rs, (uint8_t *) data + c, parity, dlen, n);
+			for (int i = 0; i < nroots; i++)
+				p[i * n] = parity[i];
+		}
+	}
+}
+
+static inline void update_si8(struct rs_code *rs, uint16_t *s, uint8_t data,
+			      const uint16_t *rlog, int i)
+{
+	uint8_t *alpha_to = rs->alpha_to8;
+	uint8_t *index_of = rs->index_of8;
+
+	if (s[i] == 0)
+		s[i] = data;
+	else
+		s[i] = data ^ alpha_to[index_of[s[i]] + rlog[i]];
+}
+
+static void compute_syndrome8(struct rs_code *rs, uint16_t *s,
+			      uint8_t *data, int len, int stride,
+			      uint8_t *scratch)
+{
+	uint16_t *rlog = rs->rootlog;
+
+	if (rs_syndrome_simd(rs, s, data, len, stride, 0, scratch))
+		return;
+
+	for (int i = 0; i < rs->nroots; i++)
+		s[i] = data[0];
+
+	int cutoff = len * stride;
+	for (int j = stride; j < cutoff; j += stride) {
+		for (int i = 0; i < rs->nroots; i++)
+			update_si8(rs, s, data[j], rlog, i);
+	}
+}
+
+static int correct8(struct rs_code *rs, struct rs_work *w, uint8_t *data,
+		    int len, int stride, const int *eras, int no_eras,
+		    int *err_pos, int eras_only)
+{
+	uint8_t *alpha_to = rs->alpha_to8;
+	uint16_t *loc = w->loc, *cor = w->cor;
+	int pad = rs->nn - len;
+
+	int ret = eras_only ? decode_erasures(rs, w, len, eras, no_eras)
+			    : decode(rs, w, len, eras, no_eras);
+	int num_corrected = rs_count(rs, ret, 1);
+	RS_PROBE(decode, rs, len, no_eras, num_corrected);
+	if (num_corrected <= 0)
+		return num_corrected;
+
+	/* Apply error to data */
+	for (int i = 0; i < num_corrected; i++)
+		data[(loc[i] - pad) * stride] ^= alpha_to[cor[i]];
+
+	/* Return the error positions if the caller wants them */
+	if (err_pos != NULL) {
+		for (int i = 0; i < num_corrected; i++)
+			err_pos[i] = loc[i] - pad;
+	}
+
+	return num_corrected;
+}
+
+int rs_decode8(struct rs_code *rs, uint8_t *data, int len,
+	       int stride, const int *eras, int no_eras, int *err_pos)
+{
+	if (no_eras > rs->nroots)
+		return rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+
+	STACK_MEM(mem, rs);
+	RS_TIMER(timer);
+	compute_syndrome8(rs, mem, data, len, stride, NULL);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, len);
+	if (clean_word(rs, mem))
+		return 0;
+
+	STACK_WORK(w, mem, rs);
+	return correct8(rs, &w, data, len, stride, eras, no_eras, err_pos, 0);
+}
+
+int rs_decode8_ctx(struct rs_decoder *dec, uint8_t *data, int len,
+		   int stride, const int *eras, int no_eras, int *err_pos)
+{
+	struct rs_code *rs = dec->rs;
+	struct rs_work *w = &dec->work;
+
+	if (no_eras > rs->nroots)
+		return rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+
+	RS_TIMER(timer);
+	compute_syndrome8(rs, w->s, data, len, stride, w->syn);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, len);
+	return correct8(rs, w, data, len, stride, eras, no_eras, err_pos, 0);
+}
+
+int rs_decode8_erasures(struct rs_code *rs, uint8_t *data, int len,
+			int stride, const int *eras, int no_eras, int *err_pos)
+{
+	if (no_eras > rs->nroots)
+		return rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+
+	STACK_MEM(mem, rs);
+	RS_TIMER(timer);
+	compute_syndrome8(rs, mem, data, len, stride, NULL);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, len);
+	if (clean_word(rs, mem))
+		return 0;
+
+	STACK_WORK(w, mem, rs);
+	return correct8(rs, &w, data, len, stride, eras, no_eras, err_pos, 1);
+}
+
+/*
+ * Decodes n words of length len that share the erasures eras, as
+ * rs_decode_erasures would. The symbols are uint16_t if wide is non-zero and
+ * uint8_t otherwise. The words are solved RS_ERAS_BLOCK at a time with the
+ * pattern of the erasures from the cache of dec; erasures that are not
+ * distinct positions in the word have no pattern and go through
+ * decode_erasures one word at a time.
+ */
+static int erasures_batch(struct rs_decoder *dec, void **data, int n,
+			  int len, int stride, const int *eras, int no_eras,
+			  int *status, int wide)
+{
+	struct rs_code *rs = dec->rs;
+	struct rs_work *w = &dec->work;
+	int nroots = rs->nroots;
+	int failed = 0;
+
+	if (no_eras > nroots) {
+		for (int c = 0; c < n; c++)
+			status[c] = rs_count(rs, RS_ERROR_TOO_MANY_ERASURES, 1);
+		return n;
+	}
+
+	struct rs_eras *p = rs_eras_get_internal(dec, len, eras, no_eras);
+	if (!p) {
+		for (int c = 0; c < n; c++) {
+			if (wide) {
+				compute_syndrome(rs, w->s, data[c], len,
+						 stride, w->syn);
+				status[c] = correct(rs, w, data[c], len, stride,
+						    eras, no_eras, NULL, 1);
+			} else {
+				compute_syndrome8(rs, w->s, data[c], len,
+						  stride, w->syn);
+				status[c] = correct8(rs, w, data[c], len, stride,
+						     eras, no_eras, NULL, 1);
+			}
+			failed += status[c] < 0;
+		}
+		return failed;
+	}
+
+	uint16_t *syn = dec->eras_work->syn, *val = dec->eras_work->val;
+	uint8_t *bad = dec->eras_work->bad;
+
+	for (int c = 0; c < n; c += RS_ERAS_BLOCK) {
+		int m = MIN(RS_ERAS_BLOCK, n - c);
+
+		RS_TIMER(timer);
+		for (int k = 0; k < m; k++) {
+			if (wide)
+				compute_syndrome(rs, syn + k * nroots, data[c + k],
+						 len, stride, w->syn);
+			else
+				compute_syndrome8(rs, syn + k * nroots,
+						  data[c + k], len, stride,
+						  w->syn);
+		}
+		RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+
+		rs_eras_solve_internal(dec, p, m);
+		RS_STAGE(rs, timer, RS_STAGE_FORNEY);
+
+		for (int k = 0; k < m; k++) {
+			const uint16_t *v = val + k * nroots;
+			int ret = 0;
+
+			if (bad[k]) {
+				ret = RS_ERROR_NOT_A_CODEWORD;
+			} else if (wide) {
+				uint16_t *d = data[c + k];
+				for (int j = 0; j < no_eras; j++) {
+					d[p->eras[j] * stride] ^= v[j];
+					ret += v[j] != 0;
+				}
+			} else {
+				uint8_t *d = data[c + k];
+				for (int j = 0; j < no_eras; j++) {
+					d[p->eras[j] * stride] ^= v[j];
+					ret += v[j] != 0;
+				}
+			}
+
+			status[c + k] = rs_count(rs, ret, 1);
+			RS_PROBE(decode, rs, len, no_eras, ret);
+			failed += ret < 0;
+		}
+	}
+
+	return failed;
+}
+
+int rs_decode_erasures_batch(struct rs_decoder *dec, uint16_t **data, int n,
+			     int len, int stride, const int *eras, int no_eras,
+			     int *status)
+{
+	return erasures_batch(dec, (void **) data, n, len, stride, eras,
+			      no_eras, status, 1);
+}
+
+int rs_decode8_erasures_batch(struct rs_decoder *dec, uint8_t **data, int n,
+			      int len, int stride, const int *eras,
+			      int no_eras, int *status)
+{
+	return erasures_batch(dec, (void **) data, n, len, stride, eras,
+			      no_eras, status, 0);
+}
+
+static int check_word8(struct rs_code *rs, uint8_t *data, uint8_t *par,
+		       int len, int stride)
+{
+	int nroots = rs->nroots;
+	const uint8_t *rpar = data + (len - nroots) * stride;
+	uint8_t diff = 0;
+
+	for (int i = 0; i < nroots; i++) {
+		par[i] ^= rpar[i * stride];
+		diff |= par[i];
+	}
+
+	if (!diff)
+		return rs_count(rs, 0, 1);
+
+	STACK_MEM(mem, rs);
+	STACK_WORK(w, mem, rs);
+	RS_TIMER(timer);
+	compute_syndrome8(rs, w.s, par, nroots, 1, NULL);
+	RS_STAGE(rs, timer, RS_STAGE_SYNDROME);
+	RS_PROBE(syndrome, rs, nroots);
+	return correct8(rs, &w, data, len, stride, NULL, 0, NULL, 0);
+}
+
+int rs_decode8_batch(struct rs_code *rs, uint8_t **data, int n, int len,
+		     int stride, int *status)
+{
+	int nroots = rs->nroots;
+	int dlen = len - nroots;
+	uint8_t par[MULTI][nroots];
+	void *p[MULTI];
+	int failed = 0;
+
+	for (int c = 0; c < MULTI; c++)
+		p[c] = par[c];
+
+	for (int c = 0; c < n; c += MULTI) {
+		int m = MIN(MULTI, n - c);
+		if (m < MULTI || !encode_multi(rs, (const void *const *) data + c,
+					       p, dlen, stride, 1, 0)) {
+			for (int k = 0; k < m; k++)
+				encode8(rs, data[c + k], par[k], dlen, stride);
+		}
+
+		for (int k = 0; k < m; k++) {
+			status[c + k] = check_word8(rs, data[c + k], par[k],
+						    len, stride);
+			if (status[c + k] < 0)
+				failed++;
+		}
+	}
+
+	return failed;
+}
+
+int rs_is_cword8(struct rs_code *rs, uint8_t *data, int len, int stride)
+{
+	uint16_t s[rs->nroots];
+
+	compute_syndrome8(rs, s, data, len, stride, NULL);
+
+	/* Check if non-zero */
+	for (int i = 0; i < rs->nroots; i++)
+		if (s[i])
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Incremental encoder. The state of the encoder is the parity register of
+ * rs_encode, which all the encoders continue from, so the updates simply run
+ * the encoder over each segment. The register is kept in par or par8 for the
+ * functions of each symbol width, and moved over when the width changes.
+ */
+struct rs_encoder *rs_encoder_create(struct rs_code *rs)
+{
+	int nroots = rs->nroots;
+	struct rs_encoder *enc = malloc(sizeof(*enc) + nroots
+					* (sizeof(*enc->par) + 1));
+	if (!enc)
+		return NULL;
+
+	enc->rs = rs;
+	enc->par = (uint16_t *) (enc + 1);
+	enc->par8 = (uint8_t *) (enc->par + nroots);
+	rs_encoder_init(enc);
+
+	return enc;
+}
+
+void rs_encoder_destroy(struct rs_encoder *enc)
+{
+	free(enc);
+}
+
+void rs_encoder_init(struct rs_encoder *enc)
+{
+	memset(enc->par, 0, enc->rs->nroots * sizeof(*enc->par));
+	enc->wide = 1;
+}
+
+/* Moves the register to par if wide is non-zero and to par8 otherwise */
+static void encoder_width(struct rs_encoder *enc, int wide)
+{
+	if (enc->wide == wide)
+		return;
+
+	for (int i = 0; i < enc->rs->nroots; i++) {
+		if (wide)
+			enc->par[i] = enc->par8[i];
+		else
+			enc->par8[i] = enc->par[i];
+	}
+	enc->wide = wide;
+}
+
+void rs_encoder_update(struct rs_encoder *enc, const uint16_t *data, int n,
+		       int stride)
+{
+	encoder_width(enc, 1);
+	encode_update(enc->rs, data, enc->par, n, stride);
+}
+
+void rs_encoder_update8(struct rs_encoder *enc, const uint8_t *data, int n,
+			int stride)
+{
+	encoder_width(enc, 0);
+	encode_update8(enc->rs, data, enc->par8, n, stride);
+}
+
+void rs_encoder_final(struct rs_encoder *enc, uint16_t *par, int stride)
+{
+	encoder_width(enc, 1);
+	for (int i = 0; i < enc->rs->nroots; i++)
+		par[i * stride] = enc->par[i];
+
+	rs_encoder_init(enc);
+}
+
+void rs_encoder_final8(struct rs_encoder *enc, uint8_t *par, int stride)
+{
+	encoder_width(enc, 0);
+	for (int i = 0; i < enc->rs->nroots; i++)
+		par[i * stride] = enc->par8[i];
+
+	rs_encoder_init(enc);
+}
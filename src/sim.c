@@ -0,0 +1,226 @@
+/*
+ * sim.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Monte Carlo simulation. The trials of all points are cut into blocks of
+ * SIM_BLOCK trials, and every block restarts the channel on its own stream
+ * of the seed. The counts are sums over the blocks, so the results do not
+ * depend on how the blocks are spread over the threads.
+ *
+ * The code is linear and the decoder only sees the syndrome, so every trial
+ * sends the all-zero codeword, and the symbols left non-zero after decoding
+ * are the errors.
+ */
+
+#include "internal.h"
+#include <limits.h>
+#include <stdlib.h>
+
+#define SIM_BLOCK 256
+
+/* The counts of a point, added up by all threads */
+struct sim_point {
+	_Atomic uint64_t trials;
+	_Atomic uint64_t word_errors;
+	_Atomic uint64_t miscorrections;
+	_Atomic uint64_t symbol_errors;
+	_Atomic uint64_t failures[RS_NUM_ERRORS];
+};
+
+/* Scratch of a thread, reseeded for every block */
+struct sim_work {
+	struct rs_channel *ch;
+	uint16_t *word;
+	int *eras;
+	int *fixed;
+};
+
+struct sim_job {
+	struct rs_code *rs;
+	const struct rs_sim_params *p;
+	int nerasures;          /* Erasure counts per error count */
+	int nblocks;            /* Blocks per point */
+	struct sim_point *points;
+	struct sim_work *work;  /* Scratch of each pool thread */
+};
+
+/* Runs the trials of block b of point pt */
+static void sim_block(struct sim_job *job, struct sim_work *sw, int pt,
+		      int b)
+{
+	struct rs_code *rs = job->rs;
+	const struct rs_sim_params *p = job->p;
+	int len = p->len;
+	int dlen = len - rs->nroots;
+	int ne = p->min_errors + pt / job->nerasures;
+	int nf = p->min_erasures + pt % job->nerasures;
+	struct rs_channel *ch = sw->ch;
+	uint16_t *w = sw->word;
+	int *fixed = sw->fixed;
+
+	uint64_t first = (uint64_t) b * SIM_BLOCK;
+	uint64_t trials = p->trials - first < SIM_BLOCK ? p->trials - first
+							: SIM_BLOCK;
+	uint64_t word_errors = 0, miscorrections = 0, symbol_errors = 0;
+	uint64_t failures[RS_NUM_ERRORS] = { 0 };
+
+	rs_channel_seed_internal(ch, p->seed, (uint64_t) pt * job->nblocks + b);
+	rs_channel_weight_internal(ch, ne, nf);
+
+	for (uint64_t t = 0; t < trials; t++) {
+		rs_channel_apply_internal(ch, (void **) &w, 1, len, 1,
+					  sw->eras, NULL, 1);
+
+		int ret = rs_decode(rs, w, len, 1, sw->eras, nf, fixed);
+
+		/* Only the corrupted and the corrected symbols can be wrong */
+		const int *pos = rs_channel_positions_internal(ch);
+		int wrong = 0;
+		for (int i = 0; i < nf + ne + (ret > 0 ? ret : 0); i++) {
+			int k = i < nf + ne ? pos[i] : fixed[i - nf - ne];
+			if (w[k]) {
+				wrong = 1;
+				symbol_errors += k < dlen;
+				w[k] = 0;
+			}
+		}
+
+		/* A failed word is an error even if no symbol is wrong */
+		if (ret < 0)
+			failures[-1 - ret]++;
+		else if (wrong)
+			miscorrections++;
+		word_errors += ret < 0 || wrong;
+	}
+
+	struct sim_point *sp = job->points + pt;
+	atomic_fetch_add_explicit(&sp->trials, trials, memory_order_relaxed);
+	atomic_fetch_add_explicit(&sp->word_errors, word_errors,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&sp->miscorrections, miscorrections,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&sp->symbol_errors, symbol_errors,
+				  memory_order_relaxed);
+	for (int i = 0; i < RS_NUM_ERRORS; i++)
+		atomic_fetch_add_explicit(sp->failures + i, failures[i],
+					  memory_order_relaxed);
+}
+
+static void sim_job(void *arg, int thread, int begin, int end)
+{
+	struct sim_job *job = arg;
+
+	for (int i = begin; i < end; i++)
+		sim_block(job, job->work + thread, i / job->nblocks,
+			  i % job->nblocks);
+}
+
+static void free_work(struct sim_work *work, int n)
+{
+	if (!work)
+		return;
+
+	for (int i = 0; i < n; i++) {
+		rs_channel_destroy_internal(work[i].ch);
+		free(work[i].word);
+		free(work[i].eras);
+		free(work[i].fixed);
+	}
+	free(work);
+}
+
+static struct sim_work *alloc_work(struct rs_code *rs, int len, int n)
+{
+	struct rs_channel_params cp = { .model = RS_CHANNEL_FIXED };
+	struct sim_work *work = calloc(n, sizeof(*work));
+	if (!work)
+		return NULL;
+
+	for (int i = 0; i < n; i++) {
+		struct sim_work *sw = work + i;
+
+		sw->ch = rs_channel_create_internal(rs, &cp, 0);
+		sw->word = calloc(len, sizeof(*sw->word));
+		sw->eras = malloc(sizeof(*sw->eras) * len);
+		sw->fixed = malloc(sizeof(*sw->fixed) * (rs->nroots + 1));
+		if (!sw->ch || !sw->word || !sw->eras || !sw->fixed) {
+			free_work(work, n);
+			return NULL;
+		}
+	}
+
+	return work;
+}
+
+int rs_sim_run_internal(struct rs_pool *pool, struct rs_code *rs,
+			const struct rs_sim_params *p,
+			struct rs_sim_result *res)
+{
+	struct rs_sim_params q = *p;
+	if (q.len == 0)
+		q.len = rs->nn;
+	p = &q;
+
+	if (p->len <= rs->nroots || p->len > rs->nn
+	    || p->min_errors < 0 || p->min_errors > p->max_errors
+	    || p->min_erasures < 0 || p->min_erasures > p->max_erasures
+	    || p->max_errors + p->max_erasures > p->len)
+		return -1;
+
+	int nerrors = p->max_errors - p->min_errors + 1;
+	int nerasures = p->max_erasures - p->min_erasures + 1;
+	uint64_t nblocks = (p->trials + SIM_BLOCK - 1) / SIM_BLOCK;
+	if ((uint64_t) nerrors * nerasures * nblocks > INT_MAX)
+		return -1;
+
+	int npoints = nerrors * nerasures;
+	int ret = -1;
+	struct sim_job job = {
+		.rs = rs,
+		.p = p,
+		.nerasures = nerasures,
+		.nblocks = nblocks,
+		.points = calloc(npoints, sizeof(*job.points)),
+		.work = alloc_work(rs, p->len, rs_pool_threads(pool)),
+	};
+	if (!job.points || !job.work)
+		goto out;
+
+	rs_pool_run(pool, sim_job, &job, npoints * nblocks, 1);
+
+	for (int pt = 0; pt < npoints; pt++) {
+		struct sim_point *sp = job.points + pt;
+		struct rs_sim_result *r = res + pt;
+
+		r->errors = p->min_errors + pt / nerasures;
+		r->erasures = p->min_erasures + pt % nerasures;
+		r->trials = atomic_load(&sp->trials);
+		r->word_errors = atomic_load(&sp->word_errors);
+		r->miscorrections = atomic_load(&sp->miscorrections);
+		r->symbol_errors = atomic_load(&sp->symbol_errors);
+		for (int i = 0; i < RS_NUM_ERRORS; i++)
+			r->failures[i] = atomic_load(sp->failures + i);
+	}
+
+	ret = 0;
+out:
+	free_work(job.work, rs_pool_threads(pool));
+	free(job.points);
+	return ret;
+}
@@ -0,0 +1,379 @@
+/*
+ * stream.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streaming framer. A frame holds depth codewords of length len, interleaved
+ * symbol by symbol: frame symbol j is symbol j / depth of codeword j % depth,
+ * which is the SoA layout of rs_encode_soa. The message symbols come first,
+ * so the payload of a frame is a contiguous part of the stream.
+ *
+ * The symbols of a frame are packed into bytes most significant bit first.
+ * The payload is the whole bytes of the message symbols, and the remaining
+ * bits of the message symbols are zero. With 8-bit symbols the frames are
+ * built and checked in place without packing.
+ *
+ * The decoder checks a frame by encoding its message symbols again and
+ * comparing the parity. Only the codewords whose parity differs are decoded.
+ * Whole frames are read straight from the caller's buffer; with 8-bit symbols
+ * the message symbols are checked where they are written to out. Only the
+ * partial frames at the ends of a push are kept in frame.
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+struct rs_stream {
+	struct rs_code *rs;
+	int len;                /* Codeword length in symbols */
+	int depth;              /* Codewords per frame */
+	size_t frame_len;       /* Frame length in bytes */
+	size_t payload_len;     /* Payload bytes per frame */
+	size_t fill;            /* Bytes of the partial frame or payload */
+	uint8_t *frame;         /* The partial frame or payload */
+	uint16_t *sym;          /* Unpacked frame, NULL for 8-bit symbols */
+	void *par;              /* Parity of the received message symbols */
+	void *word;             /* One codeword, for the decoder */
+	int *status;            /* Per-codeword results */
+};
+
+/* Reads n symbols of mm bits from the nbytes bytes at in, zero-padded */
+static void unpack(uint16_t *sym, int n, int mm, const uint8_t *in,
+		   size_t nbytes)
+{
+	uint32_t acc = 0;
+	int bits = 0;
+	size_t pos = 0;
+
+	for (int i = 0; i < n; i++) {
+		while (bits < mm) {
+			acc = acc << 8 | (pos < nbytes ? in[pos++] : 0);
+			bits += 8;
+		}
+
+		bits -= mm;
+		sym[i] = acc >> bits & ((1 << mm) - 1);
+		acc &= (1u << bits) - 1;
+	}
+}
+
+/* Writes the first nbytes bytes of the packed n symbols of mm bits to out */
+static void pack(uint8_t *out, size_t nbytes, const uint16_t *sym, int n,
+		 int mm)
+{
+	uint32_t acc = 0;
+	int bits = 0;
+	size_t pos = 0;
+
+	for (int i = 0; i < n && pos < nbytes; i++) {
+		acc = acc << mm | sym[i];
+		bits += mm;
+		while (bits >= 8 && pos < nbytes) {
+			bits -= 8;
+			out[pos++] = acc >> bits;
+		}
+		acc &= (1u << bits) - 1;
+	}
+
+	if (bits > 0 && pos < nbytes)
+		out[pos++] = acc << (8 - bits);
+}
+
+struct rs_stream *rs_stream_create_internal(struct rs_code *rs, int len,
+					    int depth)
+{
+	int nroots = rs->nroots;
+	int mm = rs->mm;
+
+	if (len <= nroots || len > rs->nn || depth < 1)
+		return NULL;
+
+	size_t data_bits = (size_t) depth * (len - nroots) * mm;
+	if (data_bits < 8)
+		return NULL;
+
+	struct rs_stream *st = calloc(1, sizeof(*st));
+	if (!st)
+		return NULL;
+
+	st->rs = rs;
+	st->len = len;
+	st->depth = depth;
+	st->frame_len = ((size_t) depth * len * mm + 7) / 8;
+	st->payload_len = data_bits / 8;
+
+	st->frame = malloc(st->frame_len);
+	st->status = malloc(sizeof(*st->status) * depth);
+	if (!st->frame || !st->status)
+		goto err;
+
+	size_t npar = (size_t) depth * nroots;
+	if (mm == 8) {
+		st->par = malloc(npar);
+		st->word = malloc(len);
+	} else {
+		st->sym = malloc(sizeof(*st->sym) * depth * len);
+		st->par = malloc(sizeof(*st->sym) * npar);
+		st->word = malloc(sizeof(*st->sym) * len);
+		if (!st->sym)
+			goto err;
+	}
+	if ((!st->par && npar) || !st->word)
+		goto err;
+
+	return st;
+
+err:
+	rs_stream_destroy_internal(st);
+	return NULL;
+}
+
+void rs_stream_destroy_internal(struct rs_stream *st)
+{
+	if (!st)
+		return;
+
+	free(st->frame);
+	free(st->sym);
+	free(st->par);
+	free(st->word);
+	free(st->status);
+	free(st);
+}
+
+size_t rs_stream_frame_len_internal(struct rs_stream *st)
+{
+	return st->frame_len;
+}
+
+size_t rs_stream_payload_len_internal(struct rs_stream *st)
+{
+	return st->payload_len;
+}
+
+/*
+ * Encodes the payload at src to a frame at out. With 8-bit symbols the frame
+ * is built in place, and src may be out.
+ */
+static void encode_frame(struct rs_stream *st, const uint8_t *src,
+			 uint8_t *out)
+{
+	struct rs_code *rs = st->rs;
+	int depth = st->depth;
+	int len = st->len;
+
+	if (!st->sym) {
+		if (src != out)
+			memcpy(out, src, st->payload_len);
+		rs_encode8_soa(rs, out, depth, len);
+		return;
+	}
+
+	unpack(st->sym, depth * (len - rs->nroots), rs->mm, src,
+	       st->payload_len);
+	rs_encode_soa(rs, st->sym, depth, len);
+	pack(out, st->frame_len, st->sym, depth * len, rs->mm);
+}
+
+size_t rs_stream_encoder_push_internal(struct rs_stream *st,
+				       const uint8_t *buf, size_t n,
+				       uint8_t *out)
+{
+	size_t plen = st->payload_len;
+	size_t written = 0;
+
+	/* Complete the buffered payload first */
+	if (st->fill > 0) {
+		size_t take = MIN(n, plen - st->fill);
+		memcpy(st->frame + st->fill, buf, take);
+		buf += take;
+		n -= take;
+		st->fill += take;
+		if (st->fill < plen)
+			return 0;
+
+		encode_frame(st, st->frame, out);
+		written = st->frame_len;
+		st->fill = 0;
+	}
+
+	/* Whole payloads are encoded straight from buf */
+	for (; n >= plen; buf += plen, n -= plen) {
+		encode_frame(st, buf, out + written);
+		written += st->frame_len;
+	}
+
+	memcpy(st->frame, buf, n);
+	st->fill = n;
+
+	return written;
+}
+
+size_t rs_stream_encoder_flush_internal(struct rs_stream *st, uint8_t *out)
+{
+	if (st->fill == 0)
+		return 0;
+
+	memset(st->frame + st->fill, 0, st->payload_len - st->fill);
+	encode_frame(st, st->frame, out);
+	st->fill = 0;
+
+	return st->frame_len;
+}
+
+#define LOAD(p, i) (wide ? ((const uint16_t *) (p))[i] \
+		  : ((const uint8_t *) (p))[i])
+
+#define STORE(p, i, x) do {					\
+		if (wide)					\
+			((uint16_t *) (p))[i] = (x);		\
+		else						\
+			((uint8_t *) (p))[i] = (x);		\
+	} while (0)
+
+/*
+ * Checks and corrects the unpacked frame with the message symbols msg and the
+ * received parity rpar, and sets st->status. Only msg is written. The symbols
+ * are uint16_t if wide is non-zero and uint8_t otherwise.
+ */
+static inline void check_frame(struct rs_stream *st, void *msg,
+			       const void *rpar, int wide)
+{
+	struct rs_code *rs = st->rs;
+	int depth = st->depth;
+	int len = st->len;
+	int dlen = len - rs->nroots;
+	size_t size = wide ? 2 : 1;
+	size_t npar = (size_t) depth * rs->nroots;
+
+	memset(st->status, 0, sizeof(*st->status) * depth);
+	rs_encode_soa_internal(rs, msg, st->par, depth, dlen, wide);
+
+	if (!memcmp(st->par, rpar, npar * size)) {
+		rs_count(rs, 0, depth);
+		return;
+	}
+
+	for (size_t j = 0; j < npar; j++) {
+		if (LOAD(rpar, j) != LOAD(st->par, j))
+			st->status[j % depth] = 1;
+	}
+
+	/* The clean codewords are counted here, the others by the decoder */
+	int bad = 0;
+	for (int c = 0; c < depth; c++)
+		bad += st->status[c];
+	rs_count(rs, 0, depth - bad);
+
+	/* Gather the received symbols of the bad codewords and decode them */
+	for (int c = 0; c < depth; c++) {
+		if (!st->status[c])
+			continue;
+
+		for (int i = 0; i < dlen; i++)
+			STORE(st->word, i, LOAD(msg, c + i * depth));
+		for (int k = 0; k < rs->nroots; k++)
+			STORE(st->word, dlen + k, LOAD(rpar, c + k * depth));
+
+		if (wide) {
+			st->status[c] = rs_decode(rs, st->word, len, 1, NULL,
+						  0, NULL);
+		} else {
+			st->status[c] = rs_decode8(rs, st->word, len, 1, NULL,
+						   0, NULL);
+		}
+
+		if (st->status[c] <= 0)
+			continue;
+
+		for (int i = 0; i < dlen; i++)
+			STORE(msg, c + i * depth, LOAD(st->word, i));
+	}
+}
+
+#undef LOAD
+#undef STORE
+
+/* Decodes the full frame at frame and writes the payload to out */
+static void decode_frame(struct rs_stream *st, const uint8_t *frame,
+			 uint8_t *out)
+{
+	struct rs_code *rs = st->rs;
+	int nsym = st->depth * st->len;
+	int dsym = nsym - st->depth * rs->nroots;
+
+	/* The payload is the message symbols, checked in place in out */
+	if (!st->sym) {
+		memmove(out, frame, st->payload_len);
+		check_frame(st, out, frame + st->payload_len, 0);
+		return;
+	}
+
+	unpack(st->sym, nsym, rs->mm, frame, st->frame_len);
+	check_frame(st, st->sym, st->sym + dsym, 1);
+	pack(out, st->payload_len, st->sym, dsym, rs->mm);
+}
+
+size_t rs_stream_decoder_push_internal(struct rs_stream *st,
+				       const uint8_t *buf, size_t n,
+				       uint8_t *out, int *status)
+{
+	size_t flen = st->frame_len;
+	size_t written = 0;
+	int depth = st->depth;
+
+	/* Complete the buffered frame first */
+	if (st->fill > 0) {
+		size_t take = MIN(n, flen - st->fill);
+		memcpy(st->frame + st->fill, buf, take);
+		buf += take;
+		n -= take;
+		st->fill += take;
+		if (st->fill < flen)
+			return 0;
+
+		decode_frame(st, st->frame, out);
+		written = st->payload_len;
+		st->fill = 0;
+
+		if (status) {
+			memcpy(status, st->status, depth * sizeof(*status));
+			status += depth;
+		}
+	}
+
+	/* Whole frames are decoded straight from buf */
+	for (; n >= flen; buf += flen, n -= flen) {
+		decode_frame(st, buf, out + written);
+		written += st->payload_len;
+
+		if (status) {
+			memcpy(status, st->status, depth * sizeof(*status));
+			status += depth;
+		}
+	}
+
+	memcpy(st->frame, buf, n);
+	st->fill = n;
+
+	return written;
+}
@@ -0,0 +1,387 @@
+/*
+ * syndrome_simd.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internal.h"
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * Vectorized syndrome computation.
+ *
+ * The syndrome S_i is the received word evaluated at the root c_i with
+ * Horner's rule. A vector of L lanes splits the word into L interleaved
+ * sequences, where lane l holds the symbols at positions l, L + l, 2L + l, ...
+ * of a block aligned part of the word, and every lane runs Horner's rule with
+ * the constant c_i^L:
+ *
+ *   acc = acc * c_i^L ^ block
+ *
+ * All lanes multiply by the same constant, so the products are table lookups
+ * with PSHUFB on the nibbles of acc. For symsize <= 8 acc is one byte per
+ * lane, and the two tables give n * c_i^L and (n << 4) * c_i^L. For larger
+ * fields acc is kept as two byte planes, and the product of each of the four
+ * nibbles is split into a table for the low byte and one for the high byte.
+ *
+ * The word is padded with leading zeros to a whole number of blocks, and at
+ * the end the lanes are combined as S_i = sum_l acc_l * c_i^(L - 1 - l).
+ */
+
+#ifdef RS_HAVE_X86_SIMD
+
+#include <immintrin.h>
+
+/* Multiplies the field element x by alpha^e, e < nn */
+static inline uint16_t mul_exp(struct rs_code *rs, uint16_t x, int e)
+{
+	if (x == 0)
+		return 0;
+
+	return rs->alpha_to[rs->index_of[x] + e];
+}
+
+#define LOAD(p, i) (wide ? ((const uint16_t *) (p))[i] \
+		  : ((const uint8_t *) (p))[i])
+
+/* Loads the L symbols of a block, gathering them if stride != 1 */
+#define GATHER(buf, p, i, stride, L, wide) do {				\
+		for (int l_ = 0; l_ < (L); l_++)			\
+			(buf)[l_] = LOAD(p, (i) + l_ * (stride));	\
+	} while (0)
+
+__attribute__((target("ssse3"), always_inline))
+static inline __m128i load_ssse3(const void *p, int i, int stride, int wide)
+{
+	if (stride != 1) {
+		uint8_t buf[16];
+		GATHER(buf, p, i, stride, 16, wide);
+		return _mm_loadu_si128((const __m128i *) buf);
+	}
+
+	if (!wide)
+		return _mm_loadu_si128((const __m128i *) ((const uint8_t *) p + i));
+
+	const __m128i *q = (const __m128i *) ((const uint16_t *) p + i);
+	return _mm_packus_epi16(_mm_loadu_si128(q), _mm_loadu_si128(q + 1));
+}
+
+__attribute__((target("ssse3"), always_inline))
+static inline void syndrome_ssse3_body(const uint8_t *tab, int nroots,
+				       const void *data, int nb, int stride,
+				       uint8_t *acc, int wide)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+
+	for (int b = 0; b < nb; b++) {
+		__m128i d = load_ssse3(data, b * 16 * stride, stride, wide);
+
+		for (int i = 0; i < nroots; i++) {
+			__m128i *a = (__m128i *) (acc + 16 * i);
+			const __m128i *t = (const __m128i *) (tab + 64 * i);
+			__m128i x = _mm_loadu_si128(a);
+			__m128i lo = _mm_and_si128(x, mask);
+			__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+
+			x = _mm_xor_si128(_mm_shuffle_epi8(t[0], lo),
+					  _mm_shuffle_epi8(t[2], hi));
+			_mm_storeu_si128(a, _mm_xor_si128(x, d));
+		}
+	}
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i load_avx2(const void *p, int i, int stride, int wide)
+{
+	if (stride != 1) {
+		uint8_t buf[32];
+		GATHER(buf, p, i, stride, 32, wide);
+		return _mm256_loadu_si256((const __m256i *) buf);
+	}
+
+	if (!wide)
+		return _mm256_loadu_si256((const __m256i *) ((const uint8_t *) p + i));
+
+	const __m256i *q = (const __m256i *) ((const uint16_t *) p + i);
+	__m256i x = _mm256_packus_epi16(_mm256_loadu_si256(q),
+					_mm256_loadu_si256(q + 1));
+	return _mm256_permute4x64_epi64(x, 0xd8);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void syndrome_avx2_body(const uint8_t *tab, int nroots,
+				      const void *data, int nb, int stride,
+				      uint8_t *acc, int wide)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+
+	for (int b = 0; b < nb; b++) {
+		__m256i d = load_avx2(data, b * 32 * stride, stride, wide);
+
+		for (int i = 0; i < nroots; i++) {
+			__m256i *a = (__m256i *) (acc + 32 * i);
+			const __m256i *t = (const __m256i *) (tab + 64 * i);
+			__m256i x = _mm256_loadu_si256(a);
+			__m256i lo = _mm256_and_si256(x, mask);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+
+			x = _mm256_xor_si256(_mm256_shuffle_epi8(t[0], lo),
+					     _mm256_shuffle_epi8(t[1], hi));
+			_mm256_storeu_si256(a, _mm256_xor_si256(x, d));
+		}
+	}
+}
+
+/* Two byte plane kernel for symsize > 8, only used with uint16_t symbols */
+__attribute__((target("avx2")))
+static void syndrome16_avx2(const uint8_t *tab, int nroots,
+			    const uint16_t *data, int nb, int stride,
+			    uint8_t *acc)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	const __m256i low = _mm256_set1_epi16(0xff);
+
+	for (int b = 0; b < nb; b++) {
+		__m256i d0, d1;
+		if (stride == 1) {
+			const __m256i *q = (const __m256i *) data + 2 * b;
+			d0 = _mm256_loadu_si256(q);
+			d1 = _mm256_loadu_si256(q + 1);
+		} else {
+			uint16_t buf[32];
+			for (int l = 0; l < 32; l++)
+				buf[l] = data[(32 * b + l) * stride];
+			d0 = _mm256_loadu_si256((const __m256i *) buf);
+			d1 = _mm256_loadu_si256((const __m256i *) buf + 1);
+		}
+
+		__m256i dlo = _mm256_packus_epi16(_mm256_and_si256(d0, low),
+						  _mm256_and_si256(d1, low));
+		__m256i dhi = _mm256_packus_epi16(_mm256_srli_epi16(d0, 8),
+						  _mm256_srli_epi16(d1, 8));
+		dlo = _mm256_permute4x64_epi64(dlo, 0xd8);
+		dhi = _mm256_permute4x64_epi64(dhi, 0xd8);
+
+		for (int i = 0; i < nroots; i++) {
+			__m256i *a = (__m256i *) (acc + 64 * i);
+			const __m256i *t = (const __m256i *) (tab + 256 * i);
+			__m256i xlo = _mm256_loadu_si256(a);
+			__m256i xhi = _mm256_loadu_si256(a + 1);
+			__m256i n[4] = {
+				_mm256_and_si256(xlo, mask),
+				_mm256_and_si256(_mm256_srli_epi16(xlo, 4), mask),
+				_mm256_and_si256(xhi, mask),
+				_mm256_and_si256(_mm256_srli_epi16(xhi, 4), mask),
+			};
+
+			xlo = dlo;
+			xhi = dhi;
+			for (int k = 0; k < 4; k++) {
+				xlo = _mm256_xor_si256(xlo,
+					_mm256_shuffle_epi8(t[2 * k], n[k]));
+				xhi = _mm256_xor_si256(xhi,
+					_mm256_shuffle_epi8(t[2 * k + 1], n[k]));
+			}
+
+			_mm256_storeu_si256(a, xlo);
+			_mm256_storeu_si256(a + 1, xhi);
+		}
+	}
+}
+
+#undef GATHER
+
+__attribute__((target("ssse3")))
+static void syndrome_ssse3(const uint8_t *tab, int nroots, const void *data,
+			   int nb, int stride, uint8_t *acc, int wide)
+{
+	if (wide)
+		syndrome_ssse3_body(tab, nroots, data, nb, stride, acc, 1);
+	else
+		syndrome_ssse3_body(tab, nroots, data, nb, stride, acc, 0);
+}
+
+__attribute__((target("avx2")))
+static void syndrome_avx2(const uint8_t *tab, int nroots, const void *data,
+			  int nb, int stride, uint8_t *acc, int wide)
+{
+	if (wide)
+		syndrome_avx2_body(tab, nroots, data, nb, stride, acc, 1);
+	else
+		syndrome_avx2_body(tab, nroots, data, nb, stride, acc, 0);
+}
+
+/* Accumulators on the stack without scratch, the roots are done in groups */
+#define SYNDROME_STACK_LEN 4096
+
+int rs_syndrome_simd(struct rs_code *rs, uint16_t *s, const void *data,
+		     int len, int stride, int wide, uint8_t *scratch)
+{
+	int lanes = rs->syn_lanes;
+	if (!lanes || len < lanes)
+		return 0;
+
+	uint16_t *rlog = rs->rootlog;
+	int nroots = rs->nroots;
+	int planes = rs->mm > 8 ? 2 : 1;
+	int size = planes == 1 ? 64 : 256;
+	int head = len % lanes;
+	int nb = len / lanes;
+	int group = SYNDROME_STACK_LEN / (planes * lanes);
+	if (scratch || group > nroots)
+		group = nroots;
+	uint8_t stack[scratch ? 1 : group * planes * lanes];
+	uint8_t *acc = scratch ? scratch : stack;
+	uint8_t first[planes * lanes];
+
+	/*
+	 * The symbols before the first block form a block of their own, padded
+	 * with leading zeros, which starts the accumulators of all roots.
+	 */
+	memset(first, 0, sizeof(first));
+	for (int j = 0; j < head; j++) {
+		uint16_t v = LOAD(data, j * stride);
+		first[lanes - head + j] = v & 0xff;
+		if (planes == 2)
+			first[2 * lanes - head + j] = v >> 8;
+	}
+
+	const void *blocks = wide ? (const void *) ((const uint16_t *) data + head * stride)
+				  : (const void *) ((const uint8_t *) data + head * stride);
+
+	for (int r = 0; r < nroots; r += group) {
+		int n = nroots - r < group ? nroots - r : group;
+		const uint8_t *tab = rs->syn_tab + size * r;
+
+		for (int i = 0; i < n; i++)
+			memcpy(acc + i * sizeof(first), first, sizeof(first));
+
+		if (planes == 2)
+			syndrome16_avx2(tab, n, blocks, nb, stride, acc);
+		else if (lanes == 32)
+			syndrome_avx2(tab, n, blocks, nb, stride, acc, wide);
+		else
+			syndrome_ssse3(tab, n, blocks, nb, stride, acc, wide);
+
+		/* Combine the lanes, the last lane has weight 1 */
+		for (int i = 0; i < n; i++) {
+			const uint8_t *a = acc + i * sizeof(first);
+			uint16_t x = 0;
+			int e = 0;
+
+			for (int l = lanes - 1; l >= 0; l--) {
+				uint16_t v = a[l];
+				if (planes == 2)
+					v |= a[lanes + l] << 8;
+
+				x ^= mul_exp(rs, v, e);
+				e = subnn(rs, e + rlog[r + i]);
+			}
+
+			s[r + i] = x;
+		}
+	}
+
+	return 1;
+}
+
+#undef LOAD
+
+int rs_syndrome_simd_init(struct rs_code *rs, size_t limit)
+{
+	int nroots = rs->nroots;
+	int level = rs_simd_level();
+	int lanes, planes;
+
+	if (nroots == 0 || level == RS_SIMD_NONE)
+		return 0;
+
+	if (rs->mm <= 8) {
+		lanes = level == RS_SIMD_AVX2 ? 32 : 16;
+		planes = 1;
+	} else if (level == RS_SIMD_AVX2) {
+		lanes = 32;
+		planes = 2;
+	} else {
+		return 0;
+	}
+
+	/*
+	 * Per root, 32 byte tables with the products of every nibble value
+	 * and c_i^L, repeated in both 128-bit lanes. One plane has the tables
+	 * of the low and the high nibble, two planes have the low and the high
+	 * byte of the products of all four nibbles.
+	 */
+	int size = planes == 1 ? 64 : 256;
+	if ((size_t) size * nroots > limit)
+		return 0;
+
+	rs->syn_tab = aligned_alloc(32, size * nroots);
+	if (!rs->syn_tab)
+		return -1;
+
+	for (int i = 0; i < nroots; i++) {
+		uint8_t *t = rs->syn_tab + size * i;
+		int e = ((long) rs->rootlog[i] * lanes) % rs->nn;
+		uint16_t bit[16] = { 0 };
+		uint16_t prod[16];
+
+		/* The products of c_i^L and x^b, the others are sums of them */
+		for (int b = 0; b < rs->mm; b++)
+			bit[b] = rs->alpha_to[e + b];
+
+		for (int k = 0; k < 2 * planes; k++) {
+			prod[0] = 0;
+			for (int n = 1; n < 16; n++) {
+				prod[n] = prod[n & (n - 1)]
+					^ bit[4 * k + __builtin_ctz(n)];
+			}
+
+			for (int n = 0; n < 32; n++) {
+				uint16_t p = prod[n & 15];
+
+				if (planes == 1) {
+					t[32 * k + n] = p;
+				} else {
+					t[64 * k + n] = p & 0xff;
+					t[64 * k + 32 + n] = p >> 8;
+				}
+			}
+		}
+	}
+
+	rs->syn_lanes = lanes;
+	return 0;
+}
+
+#else
+
+int rs_syndrome_simd_init(struct rs_code *rs, size_t limit)
+{
+	(void) rs; (void) limit;
+	return 0;
+}
+
+int rs_syndrome_simd(struct rs_code *rs, uint16_t *s, const void *data,
+		     int len, int stride, int wide, uint8_t *scratch)
+{
+	(void) rs; (void) s; (void) data;
+	(void) len; (void) stride; (void) wide; (void) scratch;
+	return 0;
+}
+
+#endif /* RS_HAVE_X86_SIMD */
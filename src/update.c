@@ -0,0 +1,243 @@
+/*
+ * update.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parity updates. The message symbol at position pos of a codeword of length
+ * len is the coefficient of x^k, k = len - 1 - pos, and the parity is the
+ * remainder of the message modulo g(x). The code is linear, so changing the
+ * symbol by d changes the parity by d * r_k(x), where r_k(x) = x^k mod g(x).
+ *
+ * With the table of all r_k the update is a row per changed symbol. Without
+ * it, the change D(x) of the parity is found from its values at the roots
+ * b_j of g(x), which are the changes of the syndromes,
+ * D(b_j) = sum_i d_i * b_j^k_i, and D(x) is interpolated from them as
+ * D(x) = sum_j c_j * g(x) / (x - b_j), with c_j = D(b_j) / g'(b_j). The
+ * coefficient of x^m of g(x) / (x - b) is sum_(t > m) g_t * b^(t - 1 - m), so
+ * D_m = sum_(t > m) g_t * S_(t - 1 - m), with S_u = sum_j c_j * b_j^u.
+ */
+
+#include "internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOAD(p, i) (wide ? ((const uint16_t *) (p))[i] \
+		  : ((const uint8_t *) (p))[i])
+
+#define STORE(p, i, x) do {					\
+		if (wide)					\
+			((uint16_t *) (p))[i] = (x);		\
+		else						\
+			((uint8_t *) (p))[i] = (x);		\
+	} while (0)
+
+pthread_mutex_t _pos_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Product of a in poly form and b in index form */
+static inline uint16_t mul_log(struct rs_code *rs, uint16_t a, int b_log)
+{
+	if (a == 0 || b_log == rs->nn)
+		return 0;
+
+	return rs->alpha_to[rs->index_of[a] + b_log];
+}
+
+/*
+ * Builds the table of r_k for k = nroots, ..., nn - 1, one row of nroots
+ * coefficients in index form per k, highest degree first like the parity.
+ * r_nroots = g(x) - x^nroots, and r_(k+1) = x * r_k mod g(x).
+ */
+static uint16_t *build_pos_table(struct rs_code *rs)
+{
+	uint16_t *index_of = rs->index_of;
+	uint16_t *gp = rs->genpoly;
+	int nroots = rs->nroots;
+	int nn = rs->nn;
+	uint16_t r[nroots];     /* r_k in poly form, r[j] for x^j */
+
+	uint16_t *tab = malloc(sizeof(*tab) * (nn - nroots) * nroots);
+	if (!tab)
+		return NULL;
+
+	for (int j = 0; j < nroots; j++)
+		r[j] = mul_log(rs, 1, gp[j]);
+
+	for (int k = 0; k < nn - nroots; k++) {
+		uint16_t *row = tab + k * nroots;
+		for (int i = 0; i < nroots; i++)
+			row[i] = index_of[r[nroots - 1 - i]];
+
+		uint16_t top = r[nroots - 1];
+		memmove(r + 1, r, (nroots - 1) * sizeof(*r));
+		r[0] = 0;
+		if (top) {
+			for (int j = 0; j < nroots; j++)
+				r[j] ^= mul_log(rs, top, gp[j]);
+		}
+	}
+
+	return tab;
+}
+
+int rs_update_parity_cache_internal(struct rs_code *rs)
+{
+	struct rs_code_priv *priv = code_priv(rs);
+	int ret = 0;
+
+	if (rs->nroots == 0
+	    || atomic_load_explicit(&priv->pos_tab, memory_order_acquire))
+		return 0;
+
+	pthread_mutex_lock(&_pos_lock);
+	if (!atomic_load_explicit(&priv->pos_tab, memory_order_relaxed)) {
+		uint16_t *tab = build_pos_table(rs);
+		if (tab)
+			atomic_store_explicit(&priv->pos_tab, tab,
+					      memory_order_release);
+		else
+			ret = -1;
+	}
+	pthread_mutex_unlock(&_pos_lock);
+
+	return ret;
+}
+
+/* Adds d_i * r_k_i to d for all changed symbols, from the table */
+static inline void delta_table(struct rs_code *rs, const uint16_t *tab,
+			       uint16_t *d, int len, const int *pos,
+			       const void *old_sym, const void *new_sym, int n,
+			       int wide)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	int nroots = rs->nroots;
+	int nn = rs->nn;
+
+	for (int i = 0; i < n; i++) {
+		int dl = index_of[LOAD(old_sym, i) ^ LOAD(new_sym, i)];
+		if (dl == nn)
+			continue;
+
+		const uint16_t *row = tab + (len - 1 - pos[i] - nroots) * nroots;
+		for (int j = 0; j < nroots; j++) {
+			if (row[j] != nn)
+				d[j] ^= alpha_to[dl + row[j]];
+		}
+	}
+}
+
+/* The same without the table, by interpolation at the roots of g(x) */
+static inline void delta_roots(struct rs_code *rs, uint16_t *d, int len,
+			       const int *pos, const void *old_sym,
+			       const void *new_sym, int n, int wide)
+{
+	uint16_t *alpha_to = rs->alpha_to;
+	uint16_t *index_of = rs->index_of;
+	uint16_t *gp = rs->genpoly;
+	uint16_t *rlog = rs->rootlog;
+	int nroots = rs->nroots;
+	int nn = rs->nn;
+	int lq = rs->prim % nn;
+	uint16_t c[nroots], s[nroots];
+
+	/* D(b_j); b_j^k is accumulated in e, as b_(j+1) = b_j * alpha^prim */
+	memset(c, 0, sizeof(c));
+	for (int i = 0; i < n; i++) {
+		int dl = index_of[LOAD(old_sym, i) ^ LOAD(new_sym, i)];
+		if (dl == nn)
+			continue;
+
+		int k = len - 1 - pos[i];
+		int step = ((long long) k * lq) % nn;
+		int e = (dl + (long long) k * rlog[0]) % nn;
+		for (int j = 0; j < nroots; j++, e = subnn(rs, e + step))
+			c[j] ^= alpha_to[e];
+	}
+
+	memset(s, 0, sizeof(s));
+	for (int j = 0; j < nroots; j++) {
+		if (!c[j])
+			continue;
+
+		/* g'(b_j) = sum_(t odd) g_t * b_j^(t - 1), non-zero */
+		int r2 = subnn(rs, 2 * rlog[j]);
+		uint16_t dg = 0;
+		for (int t = 1, e = 0; t <= nroots; t += 2, e = subnn(rs, e + r2)) {
+			if (gp[t] != nn)
+				dg ^= alpha_to[gp[t] + e];
+		}
+
+		int cj = subnn(rs, index_of[c[j]] + nn - index_of[dg]);
+		for (int u = 0, e = cj; u < nroots; u++, e = subnn(rs, e + rlog[j]))
+			s[u] ^= alpha_to[e];
+	}
+
+	for (int u = 0; u < nroots; u++)
+		s[u] = index_of[s[u]];
+
+	/* D_m goes to d[nroots - 1 - m] */
+	for (int m = 0; m < nroots; m++) {
+		uint16_t dm = 0;
+		for (int t = m + 1; t <= nroots; t++) {
+			if (s[t - 1 - m] != nn && gp[t] != nn)
+				dm ^= alpha_to[s[t - 1 - m] + gp[t]];
+		}
+		d[nroots - 1 - m] ^= dm;
+	}
+}
+
+int rs_update_parity_internal(struct rs_code *rs, void *par, int len,
+			      const int *pos, const void *old_sym,
+			      const void *new_sym, int n, int wide)
+{
+	int nroots = rs->nroots;
+
+	if (len > rs->nn)
+		return -1;
+
+	for (int i = 0; i < n; i++) {
+		if (pos[i] < 0 || pos[i] >= len - nroots)
+			return -1;
+	}
+
+	if (nroots == 0)
+		return 0;
+
+	uint16_t d[nroots];
+	memset(d, 0, sizeof(d));
+
+	const uint16_t *tab = atomic_load_explicit(&code_priv(rs)->pos_tab,
+						   memory_order_acquire);
+	if (tab) {
+		if (wide)
+			delta_table(rs, tab, d, len, pos, old_sym, new_sym, n, 1);
+		else
+			delta_table(rs, tab, d, len, pos, old_sym, new_sym, n, 0);
+	} else {
+		if (wide)
+			delta_roots(rs, d, len, pos, old_sym, new_sym, n, 1);
+		else
+			delta_roots(rs, d, len, pos, old_sym, new_sym, n, 0);
+	}
+
+	for (int j = 0; j < nroots; j++)
+		STORE(par, j, LOAD(par, j) ^ d[j]);
+
+	return 0;
+}
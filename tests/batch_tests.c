@@ -0,0 +1,294 @@
+/*
+ * batch_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that the batch encoders and decoders give exactly the same results as
+ * encoding and decoding the words one by one.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 50
+#define MAX_N 70
+#define MAX_LEN 600
+#define MAX_STRIDE 3
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static int test_batch(struct rs_code *rs, int len, int n, int stride)
+{
+	int nn = rs->nn;
+	int size = len * stride;
+	uint16_t *c = malloc(n * size * sizeof(*c));
+	uint16_t *ref = malloc(n * size * sizeof(*ref));
+	uint16_t *ptr[n];
+	int fail = 0;
+
+	if (!c || !ref) {
+		free(c);
+		free(ref);
+		return -1;
+	}
+
+	/* Array of pointers */
+	for (int i = 0; i < n * size; i++)
+		ref[i] = c[i] = random() & nn;
+
+	for (int k = 0; k < n; k++) {
+		ptr[k] = c + k * size;
+		rs_encode(rs, ref + k * size, len, stride);
+	}
+
+	rs_encode_batch(rs, ptr, n, len, stride);
+	if (memcmp(c, ref, n * size * sizeof(*c)))
+		fail++;
+
+	/* Structure of arrays */
+	for (int i = 0; i < n * len; i++)
+		ref[i] = c[i] = random() & nn;
+
+	for (int k = 0; k < n; k++)
+		rs_encode(rs, ref + k, len, n);
+
+	rs_encode_soa(rs, c, n, len);
+	if (memcmp(c, ref, n * len * sizeof(*c)))
+		fail++;
+
+	free(c);
+	free(ref);
+	return fail;
+}
+
+static int test_batch8(struct rs_code *rs, int len, int n, int stride)
+{
+	int nn = rs->nn;
+	int size = len * stride;
+	uint8_t *c = malloc(n * size);
+	uint8_t *ref = malloc(n * size);
+	uint8_t *ptr[n];
+	int fail = 0;
+
+	if (!c || !ref) {
+		free(c);
+		free(ref);
+		return -1;
+	}
+
+	for (int i = 0; i < n * size; i++)
+		ref[i] = c[i] = random() & nn;
+
+	for (int k = 0; k < n; k++) {
+		ptr[k] = c + k * size;
+		rs_encode8(rs, ref + k * size, len, stride);
+	}
+
+	rs_encode8_batch(rs, ptr, n, len, stride);
+	if (memcmp(c, ref, n * size))
+		fail++;
+
+	for (int i = 0; i < n * len; i++)
+		ref[i] = c[i] = random() & nn;
+
+	for (int k = 0; k < n; k++)
+		rs_encode8(rs, ref + k, len, n);
+
+	rs_encode8_soa(rs, c, n, len);
+	if (memcmp(c, ref, n * len))
+		fail++;
+
+	free(c);
+	free(ref);
+	return fail;
+}
+
+/* Adds up to nroots errors to every other word */
+static void corrupt16(int nroots, int nn, uint16_t *c, uint16_t *ref, int len,
+		      int stride)
+{
+	if (random() & 1)
+		return;
+
+	int errs = 1 + random() % nroots;
+	for (int i = 0; i < errs; i++) {
+		int loc = (random() % len) * stride;
+		uint16_t val = random() & nn;
+		c[loc] ^= val;
+		ref[loc] ^= val;
+	}
+}
+
+static int test_decode(struct rs_code *rs, int len, int n, int stride)
+{
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int size = len * stride;
+	uint16_t *c = malloc(n * size * sizeof(*c));
+	uint16_t *ref = malloc(n * size * sizeof(*ref));
+	uint16_t *ptr[n];
+	int status[n];
+	int fail = 0, failed = 0;
+
+	if (!c || !ref) {
+		free(c);
+		free(ref);
+		return -1;
+	}
+
+	for (int i = 0; i < n * size; i++)
+		c[i] = random() & nn;
+
+	for (int k = 0; k < n; k++) {
+		ptr[k] = c + k * size;
+		rs_encode(rs, ptr[k], len, stride);
+	}
+
+	memcpy(ref, c, n * size * sizeof(*c));
+	for (int k = 0; k < n; k++)
+		corrupt16(nroots, nn, ptr[k], ref + k * size, len, stride);
+
+	int ret = rs_decode_batch(rs, ptr, n, len, stride, status);
+	for (int k = 0; k < n; k++) {
+		int ret1 = rs_decode(rs, ref + k * size, len, stride,
+				     NULL, 0, NULL);
+		if (ret1 != status[k])
+			fail++;
+		if (ret1 < 0)
+			failed++;
+	}
+
+	if (ret != failed)
+		fail++;
+	if (memcmp(c, ref, n * size * sizeof(*c)))
+		fail++;
+
+	free(c);
+	free(ref);
+	return fail;
+}
+
+static void corrupt8(int nroots, int nn, uint8_t *c, uint8_t *ref, int len,
+		     int stride)
+{
+	if (random() & 1)
+		return;
+
+	int errs = 1 + random() % nroots;
+	for (int i = 0; i < errs; i++) {
+		int loc = (random() % len) * stride;
+		uint8_t val = random() & nn;
+		c[loc] ^= val;
+		ref[loc] ^= val;
+	}
+}
+
+static int test_decode8(struct rs_code *rs, int len, int n, int stride)
+{
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int size = len * stride;
+	uint8_t *c = malloc(n * size);
+	uint8_t *ref = malloc(n * size);
+	uint8_t *ptr[n];
+	int status[n];
+	int fail = 0, failed = 0;
+
+	if (!c || !ref) {
+		free(c);
+		free(ref);
+		return -1;
+	}
+
+	for (int i = 0; i < n * size; i++)
+		c[i] = random() & nn;
+
+	for (int k = 0; k < n; k++) {
+		ptr[k] = c + k * size;
+		rs_encode8(rs, ptr[k], len, stride);
+	}
+
+	memcpy(ref, c, n * size);
+	for (int k = 0; k < n; k++)
+		corrupt8(nroots, nn, ptr[k], ref + k * size, len, stride);
+
+	int ret = rs_decode8_batch(rs, ptr, n, len, stride, status);
+	for (int k = 0; k < n; k++) {
+		int ret1 = rs_decode8(rs, ref + k * size, len, stride,
+				      NULL, 0, NULL);
+		if (ret1 != status[k])
+			fail++;
+		if (ret1 < 0)
+			failed++;
+	}
+
+	if (ret != failed)
+		fail++;
+	if (memcmp(c, ref, n * size))
+		fail++;
+
+	free(c);
+	free(ref);
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int nroots = rs->nroots;
+	int maxlen = MIN(rs->nn, MAX_LEN);
+
+	for (int j = 0; j < TRIALS; j++) {
+		int len = nroots + 1 + random() % (maxlen - nroots);
+		int n = 1 + random() % MAX_N;
+		int stride = 1 + random() % MAX_STRIDE;
+
+		int ret[4] = { 0 };
+		ret[0] = test_batch(rs, len, n, stride);
+		ret[1] = test_decode(rs, len, n, stride);
+		if (e->symsize <= 8) {
+			ret[2] = test_batch8(rs, len, n, stride);
+			ret[3] = test_decode8(rs, len, n, stride);
+		}
+
+		for (int k = 0; k < 4; k++) {
+			if (ret[k] < 0) {
+				rs_free(rs);
+				return -1;
+			}
+
+			fail += ret[k];
+		}
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
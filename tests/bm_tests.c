@@ -0,0 +1,172 @@
+/*
+ * bm_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decodes the same words with each Berlekamp-Massey variant and checks that
+ * the results are the same, also past the capacity of the code, where the
+ * error locator may have any degree up to nroots. Half of the random words
+ * have at least one erasure, since decode_direct handles most words without
+ * erasures before the algorithm runs. For symsize <= 4 every syndrome is
+ * also tried, with each number of erasures.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 400
+#define MAX_LEN 600
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static const enum rs_bm variants[] = {
+	RS_BM_CLASSIC, RS_BM_INVERSIONLESS, RS_BM_AUTO,
+};
+
+/* Corrupts errs + eras distinct symbols of w, the last eras of them erased */
+static void corrupt_at(struct rs_code *rs, uint16_t *w, int len, int *pos,
+		       int errs, int eras)
+{
+	pick(pos, errs + eras, len);
+
+	/* An erased symbol may also be right */
+	for (int i = 0; i < errs + eras; i++) {
+		if (i < errs)
+			w[pos[i]] ^= 1 + random() % rs->nn;
+		else
+			w[pos[i]] ^= random() % (rs->nn + 1);
+	}
+}
+
+/*
+ * Decodes w with each variant and compares the results with those of
+ * RS_BM_CLASSIC, which are left in ref. Returns the number of mismatches.
+ */
+static int compare(struct rs_code *rs, const uint16_t *w, uint16_t *ref,
+		   int len, const int *eras, int no_eras)
+{
+	uint16_t dec[len];
+	int ref_pos[len], err_pos[len];
+	int ref_ret = 0, fail = 0;
+
+	for (size_t v = 0; v < ARRAY_SIZE(variants); v++) {
+		rs_set_bm(rs, variants[v]);
+		memcpy(dec, w, sizeof(dec));
+		int ret = rs_decode(rs, dec, len, 1, eras, no_eras, err_pos);
+
+		if (v == 0) {
+			ref_ret = ret;
+			memcpy(ref, dec, sizeof(dec));
+			memcpy(ref_pos, err_pos, sizeof(err_pos));
+			continue;
+		}
+
+		fail += ret != ref_ret;
+		fail += memcmp(dec, ref, sizeof(dec)) != 0;
+		if (ret > 0 && ret == ref_ret)
+			fail += memcmp(err_pos, ref_pos,
+				       sizeof(*err_pos) * ret) != 0;
+	}
+
+	return fail;
+}
+
+static int test_word(struct rs_code *rs, const uint16_t *cword, int len,
+		     int min_eras)
+{
+	int nroots = rs->nroots;
+	int errs = random() % (nroots + 1);
+	int max_eras = MIN(nroots, len - errs);
+	int eras = min_eras + random() % (max_eras - min_eras + 1);
+	uint16_t w[len], ref[len];
+	int pos[errs + eras];
+	int fail;
+
+	memcpy(w, cword, sizeof(w));
+	corrupt_at(rs, w, len, pos, errs, eras);
+	fail = compare(rs, w, ref, len, pos + errs, eras);
+
+	/* And within the capacity the word is corrected */
+	if (2 * errs + eras <= nroots)
+		fail += memcmp(ref, cword, sizeof(ref)) != 0;
+
+	return fail;
+}
+
+/*
+ * Tries every syndrome: the parity symbols of a zero word are the digits of
+ * k, and the syndrome is a bijection of them. The erasures, k % (nroots + 1)
+ * of them, are anywhere in the word.
+ */
+static int test_syndromes(struct rs_code *rs, int len)
+{
+	int nroots = rs->nroots;
+	int mm = rs->mm;
+	uint16_t w[len], ref[len];
+	int pos[nroots];
+	int fail = 0;
+
+	for (long k = 0; k < 1L << (mm * nroots); k++) {
+		int no_eras = k % (nroots + 1);
+
+		memset(w, 0, sizeof(w));
+		for (int i = 0; i < nroots; i++)
+			w[len - nroots + i] = (k >> (mm * i)) & rs->nn;
+		pick(pos, no_eras, len);
+
+		fail += compare(rs, w, ref, len, pos, no_eras);
+	}
+
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+	for (int j = 0; j < TRIALS; j++) {
+		int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+		uint16_t cword[len];
+
+		for (int i = 0; i < len; i++)
+			cword[i] = random() & rs->nn;
+		rs_encode(rs, cword, len, 1);
+
+		fail += test_word(rs, cword, len, j % 2);
+	}
+
+	if (rs->mm * rs->nroots <= 20)
+		fail += test_syndromes(rs, rs->nn);
+
+	rs_set_bm(rs, RS_BM_AUTO);
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
@@ -0,0 +1,185 @@
+/*
+ * cache_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs many threads through rs_init and rs_free at the same time. Half of the
+ * codes are held by the main thread, so the threads share them, while the
+ * others are created and freed over and over.
+ *
+ * With -b the test measures the rs_init/rs_free throughput of cached codes
+ * instead, for a growing number of threads.
+ */
+
+#include "librs.h"
+#include "test_codes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define NTHREADS 8
+#define ITERS 20000
+#define NCODES 12
+#define BENCH_ITERS 1000000
+
+struct user {
+	struct rs_code **held;
+	unsigned int seed;
+	int iters;
+	int use;                /* Use the codes, not just look them up */
+	int fail;
+};
+
+static void *user_main(void *arg)
+{
+	struct user *u = arg;
+
+	for (int j = 0; j < u->iters; j++) {
+		int i = rand_r(&u->seed) % NCODES;
+		struct etab *e = &Tab[i];
+		struct rs_code *rs = rs_init(e->symsize, e->gfpoly, e->fcr,
+					     e->prim, e->nroots);
+		if (!rs) {
+			u->fail = -1;
+			break;
+		}
+
+		if (rs->mm != e->symsize || rs->gfpoly != e->gfpoly
+		    || rs->fcr != e->fcr || rs->prim != e->prim
+		    || rs->nroots != e->nroots)
+			u->fail++;
+		if (u->held[i] && rs != u->held[i])
+			u->fail++;
+
+		/* A freed code would show up here */
+		if (u->use) {
+			uint16_t c[rs->nroots + 1];
+			for (int k = 0; k <= rs->nroots; k++)
+				c[k] = rand_r(&u->seed) & rs->nn;
+			rs_encode(rs, c, rs->nroots + 1, 1);
+			if (!rs_is_cword(rs, c, rs->nroots + 1, 1))
+				u->fail++;
+		}
+
+		rs_free(rs);
+	}
+
+	return NULL;
+}
+
+static int run_users(struct rs_code **held, int nthreads, int iters, int use)
+{
+	struct user users[nthreads];
+	pthread_t threads[nthreads];
+	int created[nthreads];
+	int fail = 0;
+
+	for (int i = 0; i < nthreads; i++) {
+		users[i] = (struct user) { held, 1 + i, iters, use, 0 };
+		created[i] = !pthread_create(threads + i, NULL, user_main,
+					     users + i);
+		if (!created[i])
+			users[i].fail = -1;
+	}
+
+	for (int i = 0; i < nthreads; i++) {
+		if (created[i])
+			pthread_join(threads[i], NULL);
+		if (fail >= 0)
+			fail = users[i].fail < 0 ? -1 : fail + users[i].fail;
+	}
+
+	return fail;
+}
+
+static int stress(void)
+{
+	struct rs_code *held[NCODES] = { NULL };
+	int fail;
+
+	for (int i = 0; i < NCODES; i += 2) {
+		struct etab *e = &Tab[i];
+		held[i] = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim,
+				  e->nroots);
+		if (!held[i]) {
+			fail = -1;
+			goto out;
+		}
+	}
+
+	fail = run_users(held, NTHREADS, ITERS, 1);
+
+out:
+	for (int i = 0; i < NCODES; i++)
+		rs_free(held[i]);
+	return fail;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench(void)
+{
+	struct rs_code *held[NCODES] = { NULL };
+	int fail = 0;
+
+	/* Every code is cached, so the threads only take references */
+	for (int i = 0; i < NCODES && !fail; i++) {
+		struct etab *e = &Tab[i];
+		held[i] = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim,
+				  e->nroots);
+		if (!held[i])
+			fail = -1;
+	}
+
+	for (int n = 1; n <= NTHREADS && !fail; n *= 2) {
+		double t = now();
+		fail = run_users(held, n, BENCH_ITERS / n, 0);
+		t = now() - t;
+		printf("%d threads: %.2f M rs_init/rs_free pairs/s\n", n,
+		       BENCH_ITERS / t * 1e-6);
+	}
+
+	for (int i = 0; i < NCODES; i++)
+		rs_free(held[i]);
+	return fail;
+}
+
+int main(int argc, char **argv)
+{
+	int fail;
+
+	if (argc > 1 && !strcmp(argv[1], "-b"))
+		fail = bench();
+	else
+		fail = stress();
+
+	if (fail < 0) {
+		printf("Memory allocation error\n");
+		return -1;
+	}
+
+	printf("tests %s\n", fail ? "failed" : "passed");
+	return fail;
+}
@@ -0,0 +1,256 @@
+/*
+ * channel_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the channel models: the exact weights of the fixed-weight channel,
+ * the erasure lists, the error rates of the random channels, and that a
+ * seed gives the same errors for both symbol widths.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 50
+#define MAX_LEN 600
+#define BATCH 4
+#define RATE_SYMBOLS 200000
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static uint64_t seed(void)
+{
+	return ((uint64_t) random() << 32) | random();
+}
+
+/* Corrupts zero words, and checks the erasure lists against them */
+static int corrupt_zero(struct rs_channel *ch, uint16_t *w, int len,
+			int *eras, int *no_eras, int *nerr)
+{
+	uint16_t *data[BATCH];
+	int fail = 0;
+
+	memset(w, 0, sizeof(*w) * BATCH * len);
+	for (int c = 0; c < BATCH; c++)
+		data[c] = w + c * len;
+
+	if (rs_channel_apply(ch, data, BATCH, len, 1, eras, no_eras))
+		return 1;
+
+	for (int c = 0; c < BATCH; c++) {
+		uint8_t erased[len];
+		memset(erased, 0, len);
+
+		for (int i = 0; i < no_eras[c]; i++) {
+			int k = eras[c * len + i];
+			fail += k < 0 || k >= len || erased[k];
+			if (k >= 0 && k < len)
+				erased[k] = 1;
+		}
+
+		nerr[c] = 0;
+		for (int i = 0; i < len; i++)
+			nerr[c] += w[c * len + i] && !erased[i];
+	}
+
+	return fail;
+}
+
+static int test_fixed(struct rs_code *rs, int len)
+{
+	int nroots = rs->nroots;
+	int errors = random() % (nroots + 1);
+	int erasures = random() % (len - errors + 1);
+	struct rs_channel_params p = {
+		.model = RS_CHANNEL_FIXED,
+		.errors = errors,
+		.erasures = erasures,
+	};
+	uint16_t w[BATCH * len];
+	int eras[BATCH * len], no_eras[BATCH], nerr[BATCH];
+	int fail = 0;
+
+	struct rs_channel *ch = rs_channel_create(rs, &p, seed());
+	if (!ch)
+		return -1;
+
+	fail += corrupt_zero(ch, w, len, eras, no_eras, nerr);
+	for (int c = 0; c < BATCH; c++) {
+		fail += no_eras[c] != erasures;
+		fail += nerr[c] != errors;
+	}
+
+	/* Too short words */
+	uint16_t *data = w;
+	if (errors + erasures > 0)
+		fail += rs_channel_apply(ch, &data, 1, errors + erasures - 1, 1,
+					 NULL, NULL) != -1;
+
+	rs_channel_destroy(ch);
+	return fail;
+}
+
+/* Non-zero if x is more than k standard deviations and one from mean */
+static int outside(double x, double mean, double var, double k)
+{
+	double d = x > mean ? x - mean : mean - x;
+
+	return d > 1 && (d - 1) * (d - 1) > k * k * var;
+}
+
+/* The error and erasure rates of a random channel */
+static int check_rate(struct rs_code *rs, struct rs_channel_params *p,
+		      double err_rate)
+{
+	int len = MIN(rs->nn, MAX_LEN);
+	int words = RATE_SYMBOLS / (BATCH * len) + 1;
+	uint16_t w[BATCH * len];
+	int eras[BATCH * len], no_eras[BATCH], nerr[BATCH];
+	double nerrs = 0, nerasures = 0;
+	int fail = 0;
+
+	struct rs_channel *ch = rs_channel_create(rs, p, seed());
+	if (!ch)
+		return -1;
+
+	for (int i = 0; i < words; i++) {
+		fail += corrupt_zero(ch, w, len, eras, no_eras, nerr);
+		for (int c = 0; c < BATCH; c++) {
+			nerrs += nerr[c];
+			nerasures += no_eras[c];
+		}
+	}
+
+	double n = (double) words * BATCH * len;
+	/* An error can be erased, and an erasure can leave a symbol alone */
+	double pe = err_rate * (1 - p->p_erasure);
+	double pf = p->p_erasure;
+
+	/* A burst channel has correlated errors, allow for that */
+	double k = p->model == RS_CHANNEL_GILBERT_ELLIOTT ? 24 : 6;
+
+	fail += outside(nerrs, n * pe, n * pe * (1 - pe), k);
+	fail += outside(nerasures, n * pf, n * pf * (1 - pf), 6);
+
+	rs_channel_destroy(ch);
+	return fail;
+}
+
+/* A seed gives the same errors and erasures for both widths */
+static int test_widths(struct rs_code *rs)
+{
+	int len = MIN(rs->nn, MAX_LEN);
+	struct rs_channel_params p = {
+		.model = RS_CHANNEL_GILBERT_ELLIOTT,
+		.p = 0.01,
+		.p_bad = 0.5,
+		.p_gb = 0.02,
+		.p_bg = 0.2,
+		.p_erasure = 0.05,
+	};
+	uint64_t s = seed();
+	uint16_t w[len];
+	uint8_t w8[len];
+	uint16_t *data = w;
+	uint8_t *data8 = w8;
+	int eras[len], eras8[len], no_eras, no_eras8;
+	int fail = 0;
+
+	struct rs_channel *ch = rs_channel_create(rs, &p, s);
+	struct rs_channel *ch8 = rs_channel_create(rs, &p, s);
+	if (!ch || !ch8) {
+		rs_channel_destroy(ch);
+		rs_channel_destroy(ch8);
+		return -1;
+	}
+
+	for (int t = 0; t < 3; t++) {
+		memset(w, 0, sizeof(w));
+		memset(w8, 0, sizeof(w8));
+		rs_channel_apply(ch, &data, 1, len, 1, eras, &no_eras);
+		rs_channel_apply8(ch8, &data8, 1, len, 1, eras8, &no_eras8);
+
+		fail += no_eras != no_eras8;
+		fail += memcmp(eras, eras8, sizeof(*eras) * MIN(no_eras, no_eras8)) != 0;
+		for (int i = 0; i < len; i++)
+			fail += w[i] != w8[i];
+	}
+
+	rs_channel_destroy(ch);
+	rs_channel_destroy(ch8);
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+	for (int j = 0; j < TRIALS; j++) {
+		int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+		fail += test_fixed(rs, len);
+	}
+
+	struct rs_channel_params p = {
+		.model = RS_CHANNEL_SYMMETRIC,
+		.p = 0.05,
+	};
+	fail += check_rate(rs, &p, p.p);
+	p.p_erasure = 0.1;
+	fail += check_rate(rs, &p, p.p);
+	p.p = 0;
+	fail += check_rate(rs, &p, p.p);
+	p.p = 1;
+	p.p_erasure = 0;
+	fail += check_rate(rs, &p, p.p);
+
+	/* The bad state is taken p_gb / (p_gb + p_bg) of the time */
+	p.model = RS_CHANNEL_GILBERT_ELLIOTT;
+	p.p = 0.001;
+	p.p_bad = 0.3;
+	p.p_gb = 0.01;
+	p.p_bg = 0.1;
+	p.p_erasure = 0.02;
+	fail += check_rate(rs, &p, (p.p * p.p_bg + p.p_bad * p.p_gb)
+				   / (p.p_gb + p.p_bg));
+
+	if (rs->mm <= 8)
+		fail += test_widths(rs);
+
+	/* Invalid parameters */
+	p.p_bad = 1.5;
+	fail += rs_channel_create(rs, &p, 0) != NULL;
+	p.model = RS_CHANNEL_FIXED;
+	p.errors = -1;
+	fail += rs_channel_create(rs, &p, 0) != NULL;
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
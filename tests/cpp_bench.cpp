@@ -0,0 +1,153 @@
+/*
+ * cpp_bench.cpp
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the codes of librs.hpp with the library on a few fixed codes, and
+ * prints one CSV record per measurement in the format of rs_bench:
+ *
+ *   encode_lib, encode_hpp     ns per codeword
+ *   decode_lib, decode_hpp     ns per decode, for 0, 1 and nroots / 2 errors
+ *
+ * Each value is the minimum over ROUNDS rounds of WORDS words.
+ */
+
+#include "librs.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#define WORDS 500
+#define ROUNDS 25
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+template <int mm, int gfpoly, int fcr, int prim, int nroots>
+static void print_record(int len, const char *metric, int errors,
+			 double value)
+{
+	printf("%d,0x%x,%d,%d,%d,%d,%s,%d,0,%.1f,ns\n", mm, gfpoly, fcr, prim,
+	       nroots, len, metric, errors, value);
+}
+
+/* Minimum time of fn over ROUNDS rounds, in ns per word */
+template <typename F>
+static double measure(F &&fn)
+{
+	double best = 1e30;
+
+	for (int r = 0; r < ROUNDS; r++) {
+		double t = now();
+		for (int c = 0; c < WORDS; c++)
+			fn(c);
+		best = std::min(best, (now() - t) * 1e9 / WORDS);
+	}
+
+	return best;
+}
+
+template <int mm, int gfpoly, int fcr, int prim, int nroots>
+static int bench_code(int len)
+{
+	using code = rs::code<mm, gfpoly, fcr, prim, nroots>;
+	using sym = typename std::conditional<mm <= 8, uint8_t, uint16_t>::type;
+	constexpr int nn = (1 << mm) - 1;
+	std::vector<sym> cword(WORDS * len), recv(WORDS * len), work(len);
+	int fail = 0;
+
+	struct rs_code *rs = rs_init(mm, gfpoly, fcr, prim, nroots);
+	if (!rs)
+		return -1;
+
+	for (int c = 0; c < WORDS; c++) {
+		for (int i = 0; i < len; i++)
+			cword[c * len + i] = random() & nn;
+		code::encode(&cword[c * len], len);
+	}
+
+	auto lib_encode = [&](int c) {
+		if constexpr (mm <= 8)
+			rs_encode8(rs, &cword[c * len], len, 1);
+		else
+			rs_encode(rs, &cword[c * len], len, 1);
+	};
+	auto lib_decode = [&](int c) {
+		std::memcpy(work.data(), &recv[c * len], len * sizeof(sym));
+		if constexpr (mm <= 8)
+			fail += rs_decode8(rs, work.data(), len, 1, NULL, 0,
+					   NULL) < 0;
+		else
+			fail += rs_decode(rs, work.data(), len, 1, NULL, 0,
+					  NULL) < 0;
+	};
+	auto hpp_decode = [&](int c) {
+		std::memcpy(work.data(), &recv[c * len], len * sizeof(sym));
+		fail += code::decode(work.data(), len) < 0;
+	};
+
+	print_record<mm, gfpoly, fcr, prim, nroots>(len, "encode_lib", 0,
+						    measure(lib_encode));
+	print_record<mm, gfpoly, fcr, prim, nroots>(len, "encode_hpp", 0,
+		measure([&](int c) { code::encode(&cword[c * len], len); }));
+
+	int errs[] = { 0, 1, nroots / 2 };
+	for (int errors : errs) {
+		recv = cword;
+		for (int c = 0; c < WORDS; c++) {
+			for (int k = 0; k < errors; k++)
+				recv[c * len + random() % len] ^=
+					1 + random() % nn;
+		}
+
+		/* Errors that hit the same symbol are fewer, not more */
+		print_record<mm, gfpoly, fcr, prim, nroots>(len, "decode_lib",
+			errors, measure(lib_decode));
+		print_record<mm, gfpoly, fcr, prim, nroots>(len, "decode_hpp",
+			errors, measure(hpp_decode));
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+int main()
+{
+	int fail = 0;
+
+	srandom(time(NULL));
+
+	printf("symsize,gfpoly,fcr,prim,nroots,len,metric,errors,erasures,value,unit\n");
+	fail |= bench_code<8, 0x187, 112, 11, 32>(255);   /* CCSDS */
+	fail |= bench_code<8, 0x11d, 0, 1, 16>(204);      /* DVB */
+	fail |= bench_code<10, 0x409, 1, 1, 30>(1023);
+
+	if (fail < 0) {
+		printf("Memory allocation error\n");
+		return -1;
+	}
+
+	return fail != 0;
+}
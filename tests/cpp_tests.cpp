@@ -0,0 +1,186 @@
+/*
+ * cpp_tests.cpp
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that the C++ codecs of librs.hpp give exactly the same results as
+ * the library, for every code in Tab.
+ */
+
+#include "librs.hpp"
+#include "test_codes.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#define TRIALS 300
+#define MAX_LEN 600
+
+/* The codes of Tab, in the same order */
+template <typename... C>
+struct code_list {};
+
+using tab_codes = code_list<
+	rs::code<2,  0x7,     1,   1,  1>,
+	rs::code<3,  0xb,     1,   1,  2>,
+	rs::code<3,  0xb,     1,   1,  3>,
+	rs::code<3,  0xb,     2,   1,  4>,
+	rs::code<4,  0x13,    1,   1,  5>,
+	rs::code<5,  0x25,    1,   1,  6>,
+	rs::code<6,  0x43,    3,   1,  8>,
+	rs::code<7,  0x89,    1,   1,  10>,
+	rs::code<8,  0x11d,   1,   1,  28>,
+	rs::code<8,  0x187,   112, 11, 32>,
+	rs::code<9,  0x211,   1,   1,  29>,
+	rs::code<10, 0x409,   1,   1,  30>,
+	rs::code<11, 0x805,   4,   1,  31>,
+	rs::code<16, 0x1100b, 5,   1,  33>>;
+
+/*
+ * Adds up to nroots + 1 errors to c, and marks some of them as erasures.
+ * Returns the number of erasures.
+ */
+template <typename T>
+static int corrupt(struct rs_code *rs, T *c, int len, int *eras)
+{
+	int errs = random() % (rs->nroots + 2);
+	int no_eras = 0;
+
+	for (int i = 0; i < errs; i++) {
+		int loc = random() % len;
+		c[loc] ^= 1 + random() % rs->nn;
+
+		int dup = 0;
+		for (int k = 0; k < no_eras; k++)
+			dup |= eras[k] == loc;
+		if (!dup && no_eras < rs->nroots && random() % 3 == 0)
+			eras[no_eras++] = loc;
+	}
+
+	return no_eras;
+}
+
+template <typename C, typename T>
+static int test_word(struct rs_code *rs, int len, int stride)
+{
+	std::vector<T> c(len * stride), ref(len * stride);
+	std::vector<int> eras(rs->nroots + 1);
+	std::vector<int> pos(rs->nroots + 1), pos_ref(rs->nroots + 1);
+	int fail = 0;
+
+	for (int i = 0; i < len; i++)
+		c[i * stride] = random() & rs->nn;
+	ref = c;
+
+	C::encode(c.data(), len, stride);
+	if (sizeof(T) == 1)
+		rs_encode8(rs, (uint8_t *) ref.data(), len, stride);
+	else
+		rs_encode(rs, (uint16_t *) ref.data(), len, stride);
+	if (c != ref || !C::is_cword(c.data(), len, stride))
+		fail++;
+
+	std::vector<T> d(len);
+	for (int i = 0; i < len; i++)
+		d[i] = c[i * stride];
+	int no_eras = corrupt(rs, d.data(), len, eras.data());
+	for (int i = 0; i < len; i++)
+		c[i * stride] = ref[i * stride] = d[i];
+
+	int ret = C::decode(c.data(), len, stride, eras.data(), no_eras,
+			    pos.data());
+	int ret_ref;
+	if (sizeof(T) == 1) {
+		ret_ref = rs_decode8(rs, (uint8_t *) ref.data(), len, stride,
+				     eras.data(), no_eras, pos_ref.data());
+	} else {
+		ret_ref = rs_decode(rs, (uint16_t *) ref.data(), len, stride,
+				    eras.data(), no_eras, pos_ref.data());
+	}
+
+	if (ret != ret_ref || c != ref)
+		fail++;
+	else if (ret > 0 && memcmp(pos.data(), pos_ref.data(),
+				   ret * sizeof(int)))
+		fail++;
+
+	return fail;
+}
+
+template <typename C>
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int nroots = rs->nroots;
+	int maxlen = rs->nn < MAX_LEN ? rs->nn : MAX_LEN;
+
+	for (int j = 0; j < TRIALS; j++) {
+		int len = nroots + 1 + random() % (maxlen - nroots);
+		int stride = 1 + j % 2;
+
+		fail += test_word<C, uint16_t>(rs, len, stride);
+		if constexpr (C::nn <= 0xff)
+			fail += test_word<C, uint8_t>(rs, len, stride);
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+template <typename... C>
+static int test_codes(code_list<C...>)
+{
+	static_assert(sizeof...(C) == ARRAY_SIZE(Tab), "Tab has changed");
+	int (*tests[])(struct etab *) = { test_code<C>... };
+	int fail = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(Tab); i++) {
+		int retval = tests[i](Tab + i);
+		if (retval < 0) {
+			printf("Memory allocation error\n");
+			return -1;
+		}
+
+		if (retval)
+			printf("FAIL: (%d, 0x%x) code: %d mismatches\n",
+			       Tab[i].symsize, Tab[i].gfpoly, retval);
+		fail |= retval;
+	}
+
+	return fail;
+}
+
+int main(void)
+{
+	srandom(time(NULL));
+
+	int fail = test_codes(tab_codes());
+	if (fail < 0)
+		return -1;
+
+	printf("tests %s\n", fail ? "failed" : "passed");
+	return fail;
+}
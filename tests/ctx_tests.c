@@ -0,0 +1,131 @@
+/*
+ * ctx_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that decoding with a decoder context gives exactly the same results
+ * as rs_decode, with errors and erasures. Without a context, the vectorized
+ * syndrome takes the roots in groups, so there are also codes with more roots
+ * than one group holds.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRIALS 300
+#define MAX_LEN 600
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Codes with many roots */
+static struct etab Big[] = {
+	{ 8,  0x11d,  1,   1,  150, 0 },
+	{ 10, 0x409,  1,   1,  100, 0 },
+};
+
+static int test_word(struct rs_code *rs, struct rs_decoder *dec, int len)
+{
+	int nroots = rs->nroots;
+	uint16_t c[len], ref[len];
+	uint8_t c8[len], ref8[len];
+	int eras[nroots + 1];
+	int pos[nroots], pos_ref[nroots];
+	int fail = 0;
+
+	for (int i = 0; i < len; i++)
+		c[i] = random() & rs->nn;
+
+	rs_encode(rs, c, len, 1);
+	int no_eras = corrupt(rs, c, len, eras);
+	memcpy(ref, c, sizeof(c));
+
+	int ret = rs_decode_ctx(dec, c, len, 1, eras, no_eras, pos);
+	int ret_ref = rs_decode(rs, ref, len, 1, eras, no_eras, pos_ref);
+	if (ret != ret_ref || memcmp(c, ref, sizeof(c)))
+		fail++;
+	else if (ret > 0 && memcmp(pos, pos_ref, ret * sizeof(*pos)))
+		fail++;
+
+	if (rs->mm > 8)
+		return fail;
+
+	for (int i = 0; i < len; i++)
+		c8[i] = c[i];
+
+	rs_encode8(rs, c8, len, 1);
+	for (int i = 0; i < len; i++)
+		c[i] = c8[i];
+	no_eras = corrupt(rs, c, len, eras);
+	for (int i = 0; i < len; i++)
+		ref8[i] = c8[i] = c[i];
+
+	ret = rs_decode8_ctx(dec, c8, len, 1, eras, no_eras, pos);
+	ret_ref = rs_decode8(rs, ref8, len, 1, eras, no_eras, pos_ref);
+	if (ret != ret_ref || memcmp(c8, ref8, sizeof(c8)))
+		fail++;
+	else if (ret > 0 && memcmp(pos, pos_ref, ret * sizeof(*pos)))
+		fail++;
+
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	struct rs_decoder *dec;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	dec = rs_decoder_create(rs);
+	if (!dec) {
+		rs_free(rs);
+		return -1;
+	}
+
+	int nroots = rs->nroots;
+	int maxlen = MIN(rs->nn, MAX_LEN);
+
+	for (int j = 0; j < TRIALS; j++) {
+		int len = nroots + 1 + random() % (maxlen - nroots);
+		fail += test_word(rs, dec, len);
+	}
+
+	rs_decoder_destroy(dec);
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	int fail, big;
+
+	srandom(time(NULL));
+
+	fail = run_codes(Tab, ARRAY_SIZE(Tab), test_code);
+	if (fail < 0)
+		return -1;
+
+	big = run_codes(Big, ARRAY_SIZE(Big), test_code);
+	return report(big < 0 ? big : fail | big);
+}
@@ -0,0 +1,130 @@
+/*
+ * encoder_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds random messages to the incremental encoder in segments of random
+ * size, mixing the symbol widths, and checks that the parity matches
+ * rs_encode.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 300
+#define MAX_LEN 600
+#define MAX_STRIDE 3
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static int test_message(struct rs_code *rs, struct rs_encoder *enc, int len,
+			int stride)
+{
+	int nroots = rs->nroots;
+	int dlen = len - nroots;
+	uint16_t c[len * stride];
+	uint16_t par[nroots * stride];
+	uint8_t c8[len * stride];
+	uint8_t par8[nroots * stride];
+	int narrow = rs->mm <= 8;
+	int fail = 0;
+
+	for (int i = 0; i < len * stride; i++) {
+		c[i] = random() & rs->nn;
+		c8[i] = c[i];
+	}
+
+	/* Segments of random size, some of them empty */
+	for (int i = 0; i < dlen;) {
+		int n = random() % (dlen - i + 1);
+		if (random() % 4 == 0)
+			n = MIN(n, 3);
+
+		if (narrow && random() % 2)
+			rs_encoder_update8(enc, c8 + i * stride, n, stride);
+		else
+			rs_encoder_update(enc, c + i * stride, n, stride);
+		i += n;
+	}
+
+	if (narrow && random() % 2) {
+		rs_encoder_final8(enc, par8, stride);
+		for (int i = 0; i < nroots; i++)
+			par[i * stride] = par8[i * stride];
+	} else {
+		rs_encoder_final(enc, par, stride);
+	}
+
+	rs_encode(rs, c, len, stride);
+	for (int i = 0; i < nroots; i++)
+		fail += par[i * stride] != c[(dlen + i) * stride];
+
+	/* The encoder starts over after rs_encoder_final */
+	rs_encoder_update(enc, c, dlen, stride);
+	rs_encoder_final(enc, par, stride);
+	for (int i = 0; i < nroots; i++)
+		fail += par[i * stride] != c[(dlen + i) * stride];
+
+	if (narrow) {
+		rs_encoder_init(enc);
+		rs_encoder_update(enc, c, 1, stride);
+		rs_encoder_init(enc);
+		rs_encoder_update8(enc, c8, dlen, stride);
+		rs_encoder_final8(enc, par8, stride);
+		for (int i = 0; i < nroots; i++)
+			fail += par8[i * stride] != c[(dlen + i) * stride];
+	}
+
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	struct rs_encoder *enc;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	enc = rs_encoder_create(rs);
+	if (!enc) {
+		rs_free(rs);
+		return -1;
+	}
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+
+	for (int j = 0; j < TRIALS; j++) {
+		int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+		int stride = 1 + random() % MAX_STRIDE;
+		fail += test_message(rs, enc, len, stride);
+	}
+
+	rs_encoder_destroy(enc);
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
@@ -0,0 +1,235 @@
+/*
+ * erasure_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the erasure-only decoders: up to nroots erasures are recovered with
+ * the same result as rs_decode, and an error outside the erasures makes the
+ * word uncorrectable without touching it. The batch decoders must give the
+ * same results as rs_decode_erasures word by word, also when the erasure
+ * patterns come back from the cache of the context.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 200
+#define MAX_LEN 600
+#define BATCH 70
+#define PATTERNS 12
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static int test_word(struct rs_code *rs, const uint16_t *cword, int len)
+{
+	int nroots = rs->nroots;
+	int no_eras = random() % (nroots + 1);
+	uint16_t w[len], r[len], w8[len];
+	uint8_t d8[len];
+	int eras[nroots + 1], err_pos[nroots], ref_pos[nroots];
+	int changed = 0, fail = 0;
+
+	pick(eras, no_eras + 1, len);
+	memcpy(w, cword, sizeof(w));
+
+	/* An erased symbol may also be right */
+	for (int i = 0; i < no_eras; i++) {
+		uint16_t e = random() % (rs->nn + 1);
+		w[eras[i]] ^= e;
+		changed += e != 0;
+	}
+
+	memcpy(r, w, sizeof(w));
+	int ret = rs_decode_erasures(rs, r, len, 1, eras, no_eras, err_pos);
+	fail += ret != changed;
+	fail += memcmp(r, cword, sizeof(r)) != 0;
+
+	/* The same as the general decoder */
+	memcpy(r, w, sizeof(w));
+	fail += rs_decode(rs, r, len, 1, eras, no_eras, ref_pos) != ret;
+	if (ret > 0) {
+		for (int i = 0; i < ret; i++) {
+			int found = 0;
+			for (int k = 0; k < ret; k++)
+				found |= err_pos[i] == ref_pos[k];
+			fail += !found;
+		}
+	}
+
+	if (rs->mm <= 8) {
+		for (int i = 0; i < len; i++)
+			d8[i] = w[i];
+		fail += rs_decode8_erasures(rs, d8, len, 1, eras, no_eras,
+					    NULL) != changed;
+		for (int i = 0; i < len; i++)
+			fail += d8[i] != cword[i];
+	}
+
+	/* An error outside the erasures leaves the word alone */
+	if (no_eras < nroots) {
+		w[eras[no_eras]] ^= 1 + random() % rs->nn;
+		memcpy(r, w, sizeof(w));
+		fail += rs_decode_erasures(rs, r, len, 1, eras, no_eras,
+					   NULL) != RS_ERROR_NOT_A_CODEWORD;
+		fail += memcmp(r, w, sizeof(r)) != 0;
+
+		if (rs->mm <= 8) {
+			for (int i = 0; i < len; i++)
+				w8[i] = d8[i] = w[i];
+			fail += rs_decode8_erasures(rs, d8, len, 1, eras,
+						    no_eras, NULL)
+				!= RS_ERROR_NOT_A_CODEWORD;
+			for (int i = 0; i < len; i++)
+				fail += d8[i] != w8[i];
+		}
+	}
+
+	return fail;
+}
+
+/* Decodes BATCH words with the erasures eras, some with an extra error */
+static int test_batch(struct rs_decoder *dec, struct rs_code *rs,
+		      const uint16_t *cword, int len, const int *eras,
+		      int no_eras)
+{
+	uint16_t w[BATCH][len], r[BATCH][len];
+	uint8_t w8[BATCH][len];
+	uint16_t *data[BATCH];
+	uint8_t *data8[BATCH];
+	int status[BATCH], status8[BATCH], failed = 0, fail = 0;
+
+	for (int c = 0; c < BATCH; c++) {
+		memcpy(w[c], cword, sizeof(w[c]));
+		for (int i = 0; i < no_eras; i++)
+			w[c][eras[i]] ^= random() % (rs->nn + 1);
+		if (random() % 8 == 0)
+			w[c][random() % len] ^= 1 + random() % rs->nn;
+
+		memcpy(r[c], w[c], sizeof(r[c]));
+		for (int i = 0; i < len; i++)
+			w8[c][i] = w[c][i];
+		data[c] = w[c];
+		data8[c] = w8[c];
+	}
+
+	int ret = rs_decode_erasures_batch(dec, data, BATCH, len, 1, eras,
+					   no_eras, status);
+	if (rs->mm <= 8)
+		fail += rs_decode8_erasures_batch(dec, data8, BATCH, len, 1,
+						  eras, no_eras, status8) != ret;
+
+	for (int c = 0; c < BATCH; c++) {
+		int s = rs_decode_erasures(rs, r[c], len, 1, eras, no_eras, NULL);
+		failed += s < 0;
+		fail += status[c] != s;
+		fail += memcmp(w[c], r[c], sizeof(r[c])) != 0;
+		if (rs->mm <= 8) {
+			fail += status8[c] != s;
+			for (int i = 0; i < len; i++)
+				fail += w8[c][i] != r[c][i];
+		}
+	}
+	fail += ret != failed;
+
+	return fail;
+}
+
+/* More patterns than the cache keeps, each used a few times */
+static int test_patterns(struct rs_code *rs, const uint16_t *cword, int len)
+{
+	int eras[PATTERNS][rs->nroots + 1], no_eras[PATTERNS];
+	int fail = 0;
+
+	struct rs_decoder *dec = rs_decoder_create(rs);
+	if (!dec)
+		return -1;
+
+	for (int k = 0; k < PATTERNS; k++) {
+		no_eras[k] = random() % (rs->nroots + 1);
+		pick(eras[k], no_eras[k], len);
+	}
+
+	for (int t = 0; t < 3 * PATTERNS; t++) {
+		int k = random() % PATTERNS;
+		fail += test_batch(dec, rs, cword, len, eras[k], no_eras[k]);
+	}
+
+	/* Repeated erasures have no pattern */
+	if (rs->nroots >= 2) {
+		int rep[2] = { eras[0][0], eras[0][0] };
+		if (no_eras[0] > 0)
+			fail += test_batch(dec, rs, cword, len, rep, 2);
+	}
+
+	rs_decoder_destroy(dec);
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+	for (int j = 0; j < TRIALS; j++) {
+		int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+		uint16_t cword[len];
+
+		for (int i = 0; i < len; i++)
+			cword[i] = random() & rs->nn;
+		rs_encode(rs, cword, len, 1);
+
+		fail += test_word(rs, cword, len);
+		if (j % 20 == 0) {
+			int ret = test_patterns(rs, cword, len);
+			if (ret < 0) {
+				rs_free(rs);
+				return -1;
+			}
+			fail += ret;
+		}
+	}
+
+	/* Too many erasures, and an erasure outside the word */
+	int len = MIN(rs->nn, MAX_LEN);
+	uint16_t w[len];
+	int eras[rs->nroots + 1];
+
+	memset(w, 0, sizeof(w));
+	pick(eras, rs->nroots + 1, len);
+	fail += rs_decode_erasures(rs, w, len, 1, eras, rs->nroots + 1,
+				   NULL) != RS_ERROR_TOO_MANY_ERASURES;
+	w[0] = 1;
+	eras[0] = len;
+	fail += rs_decode_erasures(rs, w, len, 1, eras, 1,
+				   NULL) != RS_ERROR_IMPOSSIBLE_ERR_POS;
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
@@ -20,6 +20,8 @@
 #include "test_codes.h"
 #include "librs.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static uint16_t arr[] = {
 	7, 5, 6, 4, 7, 6, 3,
@@ -80,7 +82,56 @@ static int trans_is_equal(const uint16_t *rec, const uint16_t *t_rec,
 	return 1;
 }
 
-int main(void)
+/* Encodes with and without the encoder tables, and compares the parity */
+static int test_table_limit(struct etab *e)
+{
+	struct rs_code *rsc;
+	int nn = (1 << e->symsize) - 1;
+	uint16_t c[nn], c_tab[nn];
+	int retval = -1;
+
+	for (int i = 0; i < nn; i++)
+		c[i] = c_tab[i] = random() & nn;
+
+	rs_set_table_limit(0);
+	rsc = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	rs_set_table_limit(RS_DEFAULT_TABLE_LIMIT);
+	if (!rsc)
+		return -1;
+
+	int no_tab = rsc->enc_rows == NULL;
+	rs_encode(rsc, c, nn, 1);
+	rs_free(rsc);
+
+	rsc = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rsc)
+		return -1;
+
+	/* The code in use has tables, a lower limit gives another code */
+	rs_set_table_limit(0);
+	struct rs_code *small = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim,
+					e->nroots);
+	rs_set_table_limit(RS_DEFAULT_TABLE_LIMIT);
+	if (!small) {
+		rs_free(rsc);
+		return -1;
+	}
+
+	rs_encode(rsc, c_tab, nn, 1);
+	if (!no_tab || !rsc->enc_rows || small == rsc || small->enc_rows)
+		printf("FAIL: table limit not respected\n");
+	else if (memcmp(c, c_tab, sizeof(c)) || !rs_is_cword(rsc, c, nn, 1))
+		printf("FAIL: encoders do not agree\n");
+	else
+		retval = 0;
+
+	rs_free(small);
+	rs_free(rsc);
+	return retval;
+}
+
+/* Decodes the same words with and without a stride */
+static int test_stride(void)
 {
 	uint16_t rec[ARRAY_SIZE(arr)];
 	uint16_t t_rec[ARRAY_SIZE(arr)];
@@ -117,3 +168,11 @@ err:
 	rs_free(rsc);
 	return retval;
 }
+
+int main(void)
+{
+	int retval = test_stride();
+
+	retval |= test_table_limit(&Tab[10]);
+	return retval;
+}
@@ -0,0 +1,191 @@
+/*
+ * pool_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that the worker pool gives the same results as encoding and decoding
+ * the words one by one, also when several threads share the pool and the
+ * code.
+ */
+
+#include "librs.h"
+#include "test_codes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define TRIALS 4
+#define MAX_N 300
+#define MAX_LEN 300
+#define NUSERS 3
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+struct user {
+	struct rs_pool *pool;
+	struct rs_code *rs;
+	unsigned int seed;
+	int fail;
+};
+
+static int test_words(struct rs_pool *pool, struct rs_code *rs,
+		      unsigned int *seed)
+{
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	int len = nroots + 1 + rand_r(seed) % (MIN(nn, MAX_LEN) - nroots);
+	int n = 1 + rand_r(seed) % MAX_N;
+	uint16_t *c = malloc(n * len * sizeof(*c));
+	uint16_t *ref = malloc(n * len * sizeof(*ref));
+	uint16_t **ptr = malloc(n * sizeof(*ptr));
+	int *status = malloc(n * sizeof(*status));
+	int fail = 0, failed = 0;
+
+	if (!c || !ref || !ptr || !status) {
+		fail = -1;
+		goto out;
+	}
+
+	for (int i = 0; i < n * len; i++)
+		ref[i] = c[i] = rand_r(seed) & nn;
+
+	for (int k = 0; k < n; k++) {
+		ptr[k] = c + k * len;
+		rs_encode(rs, ref + k * len, len, 1);
+	}
+
+	rs_pool_encode_batch(pool, rs, ptr, n, len, 1);
+	if (memcmp(c, ref, n * len * sizeof(*c)))
+		fail++;
+
+	/* Corrupt every fourth word */
+	for (int k = 0; k < n; k += 4) {
+		int errs = 1 + rand_r(seed) % nroots;
+		for (int i = 0; i < errs; i++) {
+			int loc = k * len + rand_r(seed) % len;
+			uint16_t val = rand_r(seed) & nn;
+			c[loc] ^= val;
+			ref[loc] ^= val;
+		}
+	}
+
+	int ret = rs_pool_decode_batch(pool, rs, ptr, n, len, 1, status);
+	for (int k = 0; k < n; k++) {
+		int ret1 = rs_decode(rs, ref + k * len, len, 1, NULL, 0, NULL);
+		if (ret1 != status[k])
+			fail++;
+		if (ret1 < 0)
+			failed++;
+	}
+
+	if (ret != failed)
+		fail++;
+	if (memcmp(c, ref, n * len * sizeof(*c)))
+		fail++;
+
+out:
+	free(c);
+	free(ref);
+	free(ptr);
+	free(status);
+	return fail;
+}
+
+static void *user_main(void *arg)
+{
+	struct user *u = arg;
+
+	for (int j = 0; j < TRIALS && u->fail >= 0; j++) {
+		int ret = test_words(u->pool, u->rs, &u->seed);
+		u->fail = ret < 0 ? ret : u->fail + ret;
+	}
+
+	return NULL;
+}
+
+static int test_code(struct etab *e, struct rs_pool *pool)
+{
+	struct rs_code *rs;
+	struct user users[NUSERS];
+	pthread_t threads[NUSERS];
+	int created[NUSERS];
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	/* One user alone, then several users sharing the pool and the code */
+	users[0] = (struct user) { pool, rs, 1, 0 };
+	user_main(users);
+	fail = users[0].fail;
+
+	for (int i = 0; i < NUSERS; i++) {
+		users[i] = (struct user) { pool, rs, 2 + i, 0 };
+		created[i] = !pthread_create(threads + i, NULL, user_main,
+					     users + i);
+		if (!created[i])
+			users[i].fail = -1;
+	}
+
+	for (int i = 0; i < NUSERS; i++) {
+		if (created[i])
+			pthread_join(threads[i], NULL);
+		if (fail >= 0)
+			fail = users[i].fail < 0 ? -1 : fail + users[i].fail;
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	int nthreads[] = { 1, 4, 0 };
+	int fail = 0;
+
+	for (size_t p = 0; p < ARRAY_SIZE(nthreads); p++) {
+		struct rs_pool *pool = rs_pool_create(nthreads[p]);
+		if (!pool) {
+			printf("Memory allocation error\n");
+			return -1;
+		}
+
+		for (size_t i = 0; i < ARRAY_SIZE(Tab); i++) {
+			int retval = test_code(Tab + i, pool);
+			if (retval < 0) {
+				printf("Memory allocation error\n");
+				rs_pool_destroy(pool);
+				return -1;
+			}
+
+			if (retval)
+				printf("FAIL: (%d, 0x%x) code, %d threads: "
+				       "%d mismatches\n", Tab[i].symsize,
+				       Tab[i].gfpoly, nthreads[p], retval);
+			fail |= retval;
+		}
+
+		rs_pool_destroy(pool);
+	}
+
+	printf("tests %s\n", fail ? "failed" : "passed");
+	return fail;
+}
@@ -0,0 +1,128 @@
+/*
+ * rs8_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that the byte symbol interface gives exactly the same results as the
+ * 16-bit interface.
+ */
+
+#include "librs.h"
+#include "test_codes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRIALS 2000
+#define MAX_STRIDE 3
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int nn = rs->nn;
+	int nroots = rs->nroots;
+	uint16_t c[nn * MAX_STRIDE];
+	uint8_t c8[nn * MAX_STRIDE];
+	int eras[nroots], pos[nroots], pos8[nroots];
+
+	for (int j = 0; j < TRIALS; j++) {
+		int len = nroots + 1 + random() % (nn - nroots);
+		int stride = 1 + random() % MAX_STRIDE;
+
+		for (int i = 0; i < len * stride; i++)
+			c8[i] = c[i] = random() & nn;
+
+		rs_encode(rs, c, len, stride);
+		rs_encode8(rs, c8, len, stride);
+
+		/* Add up to nroots errors, half of them marked as erasures */
+		int errs = random() % (nroots + 1);
+		int no_eras = 0;
+		for (int i = 0; i < errs; i++) {
+			int loc = random() % len;
+			uint16_t val = random() & nn;
+			c[loc * stride] ^= val;
+			c8[loc * stride] ^= val;
+			if (random() & 1)
+				eras[no_eras++] = loc;
+		}
+
+		/* The erasure list must not contain duplicates */
+		for (int i = 0; i < no_eras; i++) {
+			for (int k = i + 1; k < no_eras; k++) {
+				if (eras[k] == eras[i])
+					eras[k--] = eras[--no_eras];
+			}
+		}
+
+		if (rs_is_cword(rs, c, len, stride)
+		    != rs_is_cword8(rs, c8, len, stride))
+			fail++;
+
+		int ret = rs_decode(rs, c, len, stride, eras, no_eras, pos);
+		int ret8 = rs_decode8(rs, c8, len, stride, eras, no_eras, pos8);
+
+		if (ret != ret8)
+			fail++;
+		if (ret > 0 && memcmp(pos, pos8, ret * sizeof(*pos)))
+			fail++;
+
+		for (int i = 0; i < len * stride; i++) {
+			if (c[i] != c8[i]) {
+				fail++;
+				break;
+			}
+		}
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	int fail = 0;
+
+	srandom(time(NULL));
+
+	for (size_t i = 0; i < ARRAY_SIZE(Tab); i++) {
+		if (Tab[i].symsize > 8)
+			continue;
+
+		int retval = test_code(Tab + i);
+		if (retval < 0) {
+			printf("Memory allocation error\n");
+			return -1;
+		}
+
+		if (retval)
+			printf("FAIL: (%d, 0x%x) code: %d mismatches\n",
+			       Tab[i].symsize, Tab[i].gfpoly, retval);
+		fail |= retval;
+	}
+
+	printf("tests %s\n", fail ? "failed" : "passed");
+	return fail;
+}
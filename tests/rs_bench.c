@@ -0,0 +1,339 @@
+/*
+ * rs_bench.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks every code in Tab and prints one record per measurement, as CSV
+ * or, with -j, as JSON:
+ *
+ *   encode, encode8            MB/s of message data, mm bits per symbol
+ *   decode_clean, decode8_clean  MB/s of message data of codewords
+ *   decode_p50, _p90, _p99     ns per rs_decode, for each number of errors
+ *                              (without erasures) and each number of
+ *                              erasures (without errors)
+ *   decode_classic_p50, ...    the same with each Berlekamp-Massey variant
+ *   decode_inversionless_p50, ...  of rs_set_bm, for nroots / 2 errors
+ *   init, init_cached          ns per rs_init/rs_free pair for a new code
+ *                              and for a code that is already in use
+ *
+ * -t sets the time per throughput measurement in seconds, and -n the
+ * number of decodes per latency point.
+ */
+
+#include "test_common.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+/* Longer codes are shortened to this length */
+#define MAX_LEN 1023
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+struct bench {
+	double time;            /* Seconds per throughput measurement */
+	int samples;            /* Decodes per latency point */
+	int json;
+	int records;            /* Records printed so far */
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void print_header(struct bench *b)
+{
+	if (b->json)
+		printf("{\"results\": [\n");
+	else
+		printf("symsize,gfpoly,fcr,prim,nroots,len,metric,errors,erasures,value,unit\n");
+}
+
+static void print_footer(struct bench *b)
+{
+	if (b->json)
+		printf("\n]}\n");
+}
+
+static void print_record(struct bench *b, struct etab *e, int len,
+			 const char *metric, int errs, int eras, double value,
+			 const char *unit)
+{
+	if (b->json) {
+		printf("%s  {\"symsize\": %d, \"gfpoly\": \"0x%x\", "
+		       "\"fcr\": %d, \"prim\": %d, \"nroots\": %d, \"len\": %d, "
+		       "\"metric\": \"%s\", \"errors\": %d, \"erasures\": %d, "
+		       "\"value\": %.6g, \"unit\": \"%s\"}",
+		       b->records ? ",\n" : "", e->symsize, e->gfpoly, e->fcr,
+		       e->prim, e->nroots, len, metric, errs, eras, value, unit);
+	} else {
+		printf("%d,0x%x,%d,%d,%d,%d,%s,%d,%d,%.6g,%s\n", e->symsize,
+		       e->gfpoly, e->fcr, e->prim, e->nroots, len, metric, errs,
+		       eras, value, unit);
+	}
+
+	b->records++;
+	fflush(stdout);
+}
+
+/*
+ * Runs fn on word until b->time seconds have passed, and returns the
+ * throughput in MB/s for bytes of message data per call.
+ */
+static double throughput(struct bench *b, void (*fn)(struct rs_code *, void *,
+						     int),
+			 struct rs_code *rs, void *word, int len, double bytes)
+{
+	long iters = 0;
+	long batch = 1;
+	double t = now();
+	double elapsed;
+
+	do {
+		for (long i = 0; i < batch; i++)
+			fn(rs, word, len);
+		iters += batch;
+		batch *= 2;
+		elapsed = now() - t;
+	} while (elapsed < b->time);
+
+	return iters * bytes / elapsed * 1e-6;
+}
+
+static void encode16(struct rs_code *rs, void *word, int len)
+{
+	rs_encode(rs, word, len, 1);
+}
+
+static void encode8(struct rs_code *rs, void *word, int len)
+{
+	rs_encode8(rs, word, len, 1);
+}
+
+static void decode16(struct rs_code *rs, void *word, int len)
+{
+	rs_decode(rs, word, len, 1, NULL, 0, NULL);
+}
+
+static void decode8(struct rs_code *rs, void *word, int len)
+{
+	rs_decode8(rs, word, len, 1, NULL, 0, NULL);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/* Measures the latency percentiles of rs_decode with errs errors and eras
+ * erasures, as records named metric_p50 and so on */
+static int latency(struct bench *b, struct etab *e, struct rs_code *rs,
+		   const uint16_t *cword, int len, int errs, int eras,
+		   const char *metric)
+{
+	static const int pct[] = { 50, 90, 99 };
+	double *t = malloc(sizeof(*t) * b->samples);
+	uint16_t *w = malloc(sizeof(*w) * len);
+	int pos[rs->nroots + 1];
+
+	if (!t || !w) {
+		free(t);
+		free(w);
+		return -1;
+	}
+
+	for (int s = 0; s < b->samples; s++) {
+		memcpy(w, cword, sizeof(*w) * len);
+		pick(pos, errs + eras, len);
+		for (int i = 0; i < errs + eras; i++)
+			w[pos[i]] ^= 1 + random() % rs->nn;
+
+		double t0 = now();
+		rs_decode(rs, w, len, 1, pos + errs, eras, NULL);
+		t[s] = (now() - t0) * 1e9;
+	}
+
+	qsort(t, b->samples, sizeof(*t), cmp_double);
+	for (size_t i = 0; i < ARRAY_SIZE(pct); i++) {
+		char name[64];
+		snprintf(name, sizeof(name), "%s_p%d", metric, pct[i]);
+		print_record(b, e, len, name, errs, eras,
+			     t[b->samples * pct[i] / 100], "ns");
+	}
+
+	free(t);
+	free(w);
+	return 0;
+}
+
+/* ns per rs_init/rs_free pair, with the code held elsewhere if cached */
+static double init_cost(struct bench *b, struct etab *e, int cached)
+{
+	struct rs_code *held = NULL;
+	long iters = 0;
+	double t, elapsed;
+
+	if (cached) {
+		held = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim,
+			       e->nroots);
+		if (!held)
+			return -1;
+	}
+
+	t = now();
+	do {
+		struct rs_code *rs = rs_init(e->symsize, e->gfpoly, e->fcr,
+					     e->prim, e->nroots);
+		if (!rs) {
+			rs_free(held);
+			return -1;
+		}
+		rs_free(rs);
+		iters++;
+		elapsed = now() - t;
+	} while (elapsed < b->time);
+
+	rs_free(held);
+	return elapsed / iters * 1e9;
+}
+
+static int bench_code(struct bench *b, struct etab *e)
+{
+	struct rs_code *rs;
+	uint16_t *w = NULL;
+	uint8_t *w8 = NULL;
+	int ret = -1;
+
+	/* Measured before the code is held below */
+	double init = init_cost(b, e, 0);
+	double init_cached = init_cost(b, e, 1);
+	if (init < 0 || init_cached < 0)
+		return -1;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int len = MIN(rs->nn, MAX_LEN);
+	double bytes = (double) (len - rs->nroots) * rs->mm / 8;
+
+	w = malloc(sizeof(*w) * len);
+	w8 = malloc(len);
+	if (!w || !w8)
+		goto out;
+
+	/* Use every bit of the symbols, the wide codes split them at bit 8 */
+	for (int i = 0; i < len; i++) {
+		w[i] = random() & rs->nn;
+		w8[i] = random() & rs->nn & 0xff;
+	}
+
+	print_record(b, e, len, "encode", 0, 0,
+		     throughput(b, encode16, rs, w, len, bytes), "MB/s");
+	if (rs->mm <= 8) {
+		print_record(b, e, len, "encode8", 0, 0,
+			     throughput(b, encode8, rs, w8, len, bytes),
+			     "MB/s");
+	}
+
+	rs_encode(rs, w, len, 1);
+	print_record(b, e, len, "decode_clean", 0, 0,
+		     throughput(b, decode16, rs, w, len, bytes), "MB/s");
+	if (rs->mm <= 8) {
+		rs_encode8(rs, w8, len, 1);
+		print_record(b, e, len, "decode8_clean", 0, 0,
+			     throughput(b, decode8, rs, w8, len, bytes),
+			     "MB/s");
+	}
+
+	for (int errs = 0; 2 * errs <= rs->nroots; errs++) {
+		if (latency(b, e, rs, w, len, errs, 0, "decode"))
+			goto out;
+	}
+	for (int eras = 1; eras <= rs->nroots; eras++) {
+		if (latency(b, e, rs, w, len, 0, eras, "decode"))
+			goto out;
+	}
+
+	/* The Berlekamp-Massey variants at the capacity of the code */
+	rs_set_bm(rs, RS_BM_CLASSIC);
+	if (latency(b, e, rs, w, len, rs->nroots / 2, 0, "decode_classic"))
+		goto out;
+	rs_set_bm(rs, RS_BM_INVERSIONLESS);
+	if (latency(b, e, rs, w, len, rs->nroots / 2, 0,
+		    "decode_inversionless"))
+		goto out;
+	rs_set_bm(rs, RS_BM_AUTO);
+
+	print_record(b, e, len, "init", 0, 0, init, "ns");
+	print_record(b, e, len, "init_cached", 0, 0, init_cached, "ns");
+	ret = 0;
+
+out:
+	free(w);
+	free(w8);
+	rs_free(rs);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b = { 0.1, 1000, 0, 0 };
+	int opt;
+
+	while ((opt = getopt(argc, argv, "jt:n:")) != -1) {
+		switch (opt) {
+		case 'j':
+			b.json = 1;
+			break;
+		case 't':
+			b.time = atof(optarg);
+			break;
+		case 'n':
+			b.samples = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-j] [-t seconds] "
+				"[-n samples]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (b.samples < 1)
+		b.samples = 1;
+
+	srandom(1);
+	print_header(&b);
+	for (size_t i = 0; i < ARRAY_SIZE(Tab); i++) {
+		if (bench_code(&b, Tab + i)) {
+			fprintf(stderr, "Memory allocation error\n");
+			return 1;
+		}
+	}
+	print_footer(&b);
+
+	return 0;
+}
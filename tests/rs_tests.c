@@ -196,9 +196,12 @@ static void test_uc(struct rs_code *rs, int len, int errs,
 		if (derrs != nerrs)
 			stat->irv++;
 
+		/* In increasing order */
 		for (int i = 0; i < derrs; i++) {
 			if (errlocs[derrlocs[i]] != 1)
 				stat->wepos++;
+			if (i > 0 && derrlocs[i] <= derrlocs[i - 1])
+				stat->wepos++;
 		}
 
 		if (memcmp(r, c, len * sizeof(*r)))
@@ -0,0 +1,160 @@
+/*
+ * sim_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs simulations on and off a pool and checks that the results are the
+ * same, that the counts add up, and that every word within the capacity of
+ * the code is corrected.
+ */
+
+#include "librs.h"
+#include "test_codes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRIALS 300
+#define MAX_LEN 255
+#define THREADS 3
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static int check_point(struct rs_code *rs, const struct rs_sim_params *p,
+		       const struct rs_sim_result *r)
+{
+	uint64_t failed = 0;
+	int fail = 0;
+
+	for (int i = 0; i < RS_NUM_ERRORS; i++)
+		failed += r->failures[i];
+
+	fail += r->trials != p->trials;
+	fail += r->word_errors != r->miscorrections + failed;
+	fail += r->symbol_errors > r->word_errors * p->len;
+
+	if (2 * r->errors + r->erasures <= rs->nroots)
+		fail += r->word_errors != 0;
+	if (r->erasures > rs->nroots)
+		fail += r->failures[-1 - RS_ERROR_TOO_MANY_ERASURES] != p->trials;
+
+	return fail;
+}
+
+static int run(struct rs_code *rs, struct rs_pool *pool,
+	       const struct rs_sim_params *p)
+{
+	int npoints = (p->max_errors - p->min_errors + 1)
+		      * (p->max_erasures - p->min_erasures + 1);
+	struct rs_sim_result res[npoints], pres[npoints];
+	int fail = 0;
+
+	memset(res, 0, sizeof(res));
+	memset(pres, 0, sizeof(pres));
+	if (rs_sim_run(NULL, rs, p, res) || rs_sim_run(pool, rs, p, pres))
+		return 1;
+
+	fail += memcmp(res, pres, sizeof(res)) != 0;
+
+	for (int i = 0; i < npoints; i++) {
+		fail += res[i].errors != p->min_errors
+					 + i / (p->max_erasures - p->min_erasures + 1);
+		fail += res[i].erasures != p->min_erasures
+					   + i % (p->max_erasures - p->min_erasures + 1);
+		fail += check_point(rs, p, res + i);
+	}
+
+	return fail;
+}
+
+static int test_code(struct etab *e, struct rs_pool *pool)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int nroots = rs->nroots;
+	int len = MIN(rs->nn, MAX_LEN);
+	struct rs_sim_params p = {
+		.len = len,
+		.trials = TRIALS,
+		.seed = ((uint64_t) random() << 32) | random(),
+	};
+
+	/* Errors up to one past the capacity */
+	p.max_errors = MIN(nroots / 2 + 1, len);
+	fail += run(rs, pool, &p);
+
+	/* Erasures around nroots, with and without an error */
+	p.max_errors = 1;
+	p.min_erasures = nroots - 1;
+	p.max_erasures = MIN(nroots + 1, len - 1);
+	fail += run(rs, pool, &p);
+
+	/* Invalid parameters */
+	struct rs_sim_result r;
+	struct rs_sim_params q = p;
+	q.max_erasures = len;
+	fail += rs_sim_run(NULL, rs, &q, &r) != -1;
+	q = p;
+	q.len = nroots;
+	fail += rs_sim_run(NULL, rs, &q, &r) != -1;
+	q = p;
+	q.min_errors = 2;
+	fail += rs_sim_run(NULL, rs, &q, &r) != -1;
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	struct rs_pool *pool;
+	int fail = 0;
+
+	srandom(time(NULL));
+
+	pool = rs_pool_create(THREADS);
+	if (!pool) {
+		printf("Memory allocation error\n");
+		return -1;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(Tab); i++) {
+		int retval = test_code(Tab + i, pool);
+		if (retval < 0) {
+			printf("Memory allocation error\n");
+			rs_pool_destroy(pool);
+			return -1;
+		}
+
+		if (retval)
+			printf("FAIL: (%d, 0x%x) code: %d mismatches\n",
+			       Tab[i].symsize, Tab[i].gfpoly, retval);
+		fail |= retval;
+	}
+
+	rs_pool_destroy(pool);
+	printf("tests %s\n", fail ? "failed" : "passed");
+	return fail;
+}
@@ -0,0 +1,192 @@
+/*
+ * stats_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decodes random words with all the decode functions and checks that the
+ * statistics of the code add up to the values the decoders returned.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 200
+#define MAX_LEN 600
+#define BATCH 6
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* The counts the statistics should have */
+struct expect {
+	uint64_t hist[65536];
+	uint64_t failures[RS_NUM_ERRORS];
+};
+
+static void count(struct expect *x, int ret)
+{
+	if (ret >= 0)
+		x->hist[ret]++;
+	else
+		x->failures[-1 - ret]++;
+}
+
+static void decode_words(struct rs_code *rs, struct rs_decoder *dec,
+			 struct expect *x, int len)
+{
+	int nroots = rs->nroots;
+	uint16_t c[len];
+	uint8_t c8[len];
+	int eras[nroots + 1];
+
+	for (int i = 0; i < len; i++)
+		c[i] = random() & rs->nn;
+	rs_encode(rs, c, len, 1);
+
+	int no_eras = corrupt(rs, c, len, eras);
+	for (int i = 0; i < len; i++)
+		c8[i] = c[i];
+
+	count(x, rs_decode_ctx(dec, c, len, 1, eras, no_eras, NULL));
+	if (rs->mm <= 8)
+		count(x, rs_decode8(rs, c8, len, 1, eras, no_eras, NULL));
+
+	/* Too many erasures */
+	count(x, rs_decode(rs, c, len, 1, eras, nroots + 1, NULL));
+}
+
+static void decode_batch(struct rs_code *rs, struct expect *x, int len)
+{
+	uint16_t w[BATCH][len];
+	uint16_t *data[BATCH];
+	int eras[rs->nroots + 1];
+	int status[BATCH];
+
+	for (int c = 0; c < BATCH; c++) {
+		for (int i = 0; i < len; i++)
+			w[c][i] = random() & rs->nn;
+		rs_encode(rs, w[c], len, 1);
+		corrupt(rs, w[c], len, eras);
+		data[c] = w[c];
+	}
+
+	rs_decode_batch(rs, data, BATCH, len, 1, status);
+	for (int c = 0; c < BATCH; c++)
+		count(x, status[c]);
+}
+
+static int check_stats(struct rs_code *rs, struct expect *x)
+{
+	struct rs_stats st;
+	uint64_t hist[rs->nroots + 1];
+	uint64_t decoded = 0, corrected = 0, failed = 0, cycles = 0;
+	int fail = 0;
+
+	if (rs_get_stats(rs, &st, hist))
+		return 1;
+
+	for (int k = 0; k <= rs->nroots; k++) {
+		fail += hist[k] != x->hist[k];
+		decoded += x->hist[k];
+		corrected += k * x->hist[k];
+	}
+
+	for (int i = 0; i < RS_NUM_ERRORS; i++) {
+		fail += st.failures[i] != x->failures[i];
+		failed += x->failures[i];
+	}
+
+	fail += st.decoded != decoded + failed;
+	fail += st.clean != x->hist[0];
+	fail += st.corrected != corrected;
+	fail += st.failed != failed;
+
+	/* The stages are only timed with --enable-stage-timing */
+	for (int i = 0; i < RS_NUM_STAGES; i++)
+		cycles += st.cycles[i];
+#ifdef RS_STAGE_TIMING
+	fail += (cycles > 0) != (st.decoded > 0);
+#else
+	fail += cycles != 0;
+#endif
+
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	static struct expect x, y;
+	struct rs_code *rs;
+	struct rs_decoder *dec;
+	struct rs_stats st;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	/* Not counted until turned on */
+	fail += !rs_get_stats(rs, &st, NULL);
+
+	/* The switch is per code, so it reaches the code already in use */
+	struct rs_code *other = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim,
+					e->nroots);
+	if (!other || rs_set_stats(other, 1)) {
+		rs_free(other);
+		rs_free(rs);
+		return -1;
+	}
+	rs_free(other);
+
+	dec = rs_decoder_create(rs);
+	if (!dec) {
+		rs_free(rs);
+		return -1;
+	}
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+
+	memset(&x, 0, sizeof(x));
+	for (int j = 0; j < TRIALS; j++) {
+		int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+		decode_words(rs, dec, &x, len);
+		if (j % 10 == 0)
+			decode_batch(rs, &x, len);
+	}
+	fail += check_stats(rs, &x);
+
+	rs_reset_stats(rs);
+	memset(&x, 0, sizeof(x));
+	fail += check_stats(rs, &x);
+
+	/* Turned off, the counters stay readable but do not change */
+	rs_set_stats(rs, 0);
+	decode_words(rs, dec, &y, rs->nroots + 1);
+	fail += check_stats(rs, &x);
+
+	rs_decoder_destroy(dec);
+	rs_free(rs);
+
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
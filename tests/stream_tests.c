@@ -0,0 +1,177 @@
+/*
+ * stream_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pushes random streams through the stream encoder and decoder in chunks of
+ * random size. Every frame gets a burst of symbol errors that the interleaver
+ * spreads over its codewords, at most nroots / 2 per codeword, and the
+ * decoder must return the stream and the number of errors in each codeword.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 20
+#define MAX_LEN 300
+#define MAX_DEPTH 8
+#define MAX_FRAMES 6
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Pushes n bytes of in through push in random chunks and returns the output */
+static size_t push_chunks(struct rs_stream *st, const uint8_t *in, size_t n,
+			  uint8_t *out, int *status, int depth,
+			  size_t max_chunk, int decode)
+{
+	size_t written = 0;
+
+	while (n > 0) {
+		size_t chunk = 1 + random() % max_chunk;
+		size_t w;
+
+		chunk = MIN(chunk, n);
+
+		if (decode) {
+			w = rs_stream_decoder_push(st, in, chunk,
+						   out + written, status);
+			status += w / rs_stream_payload_len(st) * depth;
+		} else {
+			w = rs_stream_encoder_push(st, in, chunk,
+						   out + written);
+		}
+
+		in += chunk;
+		n -= chunk;
+		written += w;
+	}
+
+	return written;
+}
+
+/* XORs val into symbol j of the packed frame */
+static void flip_symbol(uint8_t *frame, size_t j, int mm, int val)
+{
+	for (int b = 0; b < mm; b++) {
+		if (val >> (mm - 1 - b) & 1) {
+			size_t bit = j * mm + b;
+			frame[bit / 8] ^= 0x80 >> (bit % 8);
+		}
+	}
+}
+
+static int test_stream(struct rs_code *rs, int len, int depth)
+{
+	struct rs_stream *enc = rs_stream_create(rs, len, depth);
+	struct rs_stream *dec = rs_stream_create(rs, len, depth);
+	uint8_t *in = NULL, *frames = NULL, *out = NULL;
+	int *status = NULL, *errs = NULL;
+	int fail = -1;
+
+	if (!enc || !dec)
+		goto out;
+
+	size_t flen = rs_stream_frame_len(enc);
+	size_t plen = rs_stream_payload_len(enc);
+	size_t n = random() % (MAX_FRAMES * plen);
+	size_t nframes = (n + plen - 1) / plen;
+
+	in = malloc(n + 1);
+	frames = malloc((nframes + 1) * flen);
+	out = malloc((nframes + 1) * plen);
+	status = malloc(sizeof(*status) * (nframes + 1) * depth);
+	errs = calloc((nframes + 1) * depth, sizeof(*errs));
+	if (!in || !frames || !out || !status || !errs)
+		goto out;
+
+	for (size_t i = 0; i < n; i++)
+		in[i] = random();
+
+	fail = 0;
+	size_t w = push_chunks(enc, in, n, frames, NULL, depth, 3 * plen, 0);
+	w += rs_stream_encoder_flush(enc, frames + w);
+	if (w != nframes * flen)
+		fail++;
+
+	/* A burst of depth * nroots / 2 symbols in every frame */
+	int burst = depth * (rs->nroots / 2);
+	for (size_t f = 0; f < nframes; f++) {
+		size_t start = random() % (depth * len - burst + 1);
+		for (int k = 0; k < burst; k++) {
+			size_t j = start + k;
+			flip_symbol(frames + f * flen, j, rs->mm,
+				    1 + random() % rs->nn);
+			errs[f * depth + j % depth]++;
+		}
+	}
+
+	w = push_chunks(dec, frames, nframes * flen, out, status, depth,
+			3 * flen, 1);
+	if (w != nframes * plen || memcmp(in, out, n))
+		fail++;
+
+	for (size_t i = n; i < w; i++)
+		fail += out[i] != 0;
+
+	for (size_t c = 0; c < nframes * depth; c++)
+		fail += status[c] != errs[c];
+
+out:
+	free(in);
+	free(frames);
+	free(out);
+	free(status);
+	free(errs);
+	rs_stream_destroy(enc);
+	rs_stream_destroy(dec);
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+
+	for (int j = 0; j < TRIALS && fail >= 0; j++) {
+		int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+		int depth = 1 + random() % MAX_DEPTH;
+
+		/* The payload must be at least a byte */
+		while (depth * (len - rs->nroots) * rs->mm < 8)
+			depth++;
+
+		int retval = test_stream(rs, len, depth);
+		fail = retval < 0 ? retval : fail + retval;
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}
@@ -0,0 +1,109 @@
+/*
+ * test_common.h
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Helpers shared by the tests that loop over the codes in test_codes.h */
+
+#ifndef FB_LIBRS_TEST_COMMON_H
+#define FB_LIBRS_TEST_COMMON_H
+
+#include "librs.h"
+#include "test_codes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Picks n distinct positions in [0, len) */
+static inline void pick(int *pos, int n, int len)
+{
+	int perm[len];
+
+	for (int i = 0; i < len; i++)
+		perm[i] = i;
+
+	for (int i = 0; i < n; i++) {
+		int k = i + random() % (len - i);
+		int tmp = perm[i];
+		perm[i] = perm[k];
+		perm[k] = tmp;
+		pos[i] = perm[i];
+	}
+}
+
+/*
+ * Adds up to nroots + 1 errors to c, and marks some of them as erasures.
+ * Returns the number of erasures.
+ */
+static inline int corrupt(struct rs_code *rs, uint16_t *c, int len, int *eras)
+{
+	int errs = random() % (rs->nroots + 2);
+	int no_eras = 0;
+
+	for (int i = 0; i < errs; i++) {
+		int loc = random() % len;
+		c[loc] ^= 1 + random() % rs->nn;
+
+		int dup = 0;
+		for (int k = 0; k < no_eras; k++)
+			dup |= eras[k] == loc;
+		if (!dup && no_eras < rs->nroots && random() % 3 == 0)
+			eras[no_eras++] = loc;
+	}
+
+	return no_eras;
+}
+
+/*
+ * Runs test_code on the n codes in tab, and reports the codes that fail.
+ * Returns the failures or'ed together, or -1 on allocation errors.
+ */
+static inline int run_codes(struct etab *tab, size_t n,
+			    int (*test_code)(struct etab *e))
+{
+	int fail = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		int retval = test_code(tab + i);
+		if (retval < 0) {
+			printf("Memory allocation error\n");
+			return -1;
+		}
+
+		if (retval)
+			printf("FAIL: (%d, 0x%x) code: %d mismatches\n",
+			       tab[i].symsize, tab[i].gfpoly, retval);
+		fail |= retval;
+	}
+
+	return fail;
+}
+
+/* Prints the verdict on fail, and returns it as the exit status */
+static inline int report(int fail)
+{
+	if (fail >= 0)
+		printf("tests %s\n", fail ? "failed" : "passed");
+	return fail;
+}
+
+/* The main of a test: runs test_code on every code in Tab */
+static inline int run_all(int (*test_code)(struct etab *e))
+{
+	srandom(time(NULL));
+	return report(run_codes(Tab, ARRAY_SIZE(Tab), test_code));
+}
+
+#endif /* FB_LIBRS_TEST_COMMON_H */
@@ -0,0 +1,115 @@
+/*
+ * update_tests.c
+ * Copyright (C) 2019 Ferdinand Blomqvist
+ *
+ * This file is part of librs.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Changes random message symbols of codewords and checks that the parity
+ * updates give the same parity as encoding the new message, with and without
+ * the position table.
+ */
+
+#include "test_common.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIALS 200
+#define MAX_LEN 600
+#define MAX_CHANGES 8
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static int test_update(struct rs_code *rs, int len)
+{
+	int nroots = rs->nroots;
+	int dlen = len - nroots;
+	uint16_t c[len], par[nroots];
+	uint16_t old_sym[MAX_CHANGES], new_sym[MAX_CHANGES];
+	uint8_t par8[nroots];
+	uint8_t old8[MAX_CHANGES], new8[MAX_CHANGES];
+	int pos[MAX_CHANGES];
+	int fail = 0;
+
+	for (int i = 0; i < len; i++)
+		c[i] = random() & rs->nn;
+	rs_encode(rs, c, len, 1);
+	memcpy(par, c + dlen, sizeof(par));
+	for (int i = 0; i < nroots; i++)
+		par8[i] = par[i];
+
+	/* Positions may repeat, and some symbols do not change */
+	int n = random() % (MAX_CHANGES + 1);
+	for (int i = 0; i < n; i++) {
+		pos[i] = random() % dlen;
+		old_sym[i] = c[pos[i]];
+		if (random() % 4)
+			c[pos[i]] = random() & rs->nn;
+		new_sym[i] = c[pos[i]];
+		old8[i] = old_sym[i];
+		new8[i] = new_sym[i];
+	}
+
+	fail += rs_update_parity(rs, par, len, pos, old_sym, new_sym, n) != 0;
+	rs_encode(rs, c, len, 1);
+	fail += memcmp(par, c + dlen, sizeof(par)) != 0;
+
+	if (rs->mm <= 8) {
+		fail += rs_update_parity8(rs, par8, len, pos, old8, new8, n) != 0;
+		for (int i = 0; i < nroots; i++)
+			fail += par8[i] != c[dlen + i];
+	}
+
+	/* Parity symbols cannot be changed this way */
+	pos[0] = dlen + random() % nroots;
+	fail += rs_update_parity(rs, par, len, pos, old_sym, new_sym, 1) == 0;
+	fail += memcmp(par, c + dlen, sizeof(par)) != 0;
+
+	return fail;
+}
+
+static int test_code(struct etab *e)
+{
+	struct rs_code *rs;
+	int fail = 0;
+
+	rs = rs_init(e->symsize, e->gfpoly, e->fcr, e->prim, e->nroots);
+	if (!rs)
+		return -1;
+
+	int maxlen = MIN(rs->nn, MAX_LEN);
+
+	for (int cached = 0; cached < 2; cached++) {
+		if (cached && rs_update_parity_cache(rs)) {
+			rs_free(rs);
+			return -1;
+		}
+
+		for (int j = 0; j < TRIALS; j++) {
+			int len = rs->nroots + 1 + random() % (maxlen - rs->nroots);
+			fail += test_update(rs, len);
+		}
+	}
+
+	rs_free(rs);
+	return fail;
+}
+
+int main(void)
+{
+	return run_all(test_code);
+}